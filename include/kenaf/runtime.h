@@ -26,6 +26,7 @@
 #ifndef KENAF_RUNTIME_H
 #define KENAF_RUNTIME_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <exception>
 #include <string_view>
@@ -54,6 +55,140 @@ KF_API void release_runtime( runtime* r );
 KF_API void set_runtime_value( runtime* r, size_t index, value v );
 KF_API value get_runtime_value( runtime* r, size_t index );
 
+/*
+    Garbage collector pacing.  A collection starts once the program has
+    allocated growth times the heap that survived the last collection, or
+    min_trigger bytes, whichever is larger.  As the heap approaches the soft
+    limit, collections start earlier.  Allocating past the hard limit raises
+    ERROR_MEMORY.  If there is no soft limit, the hard limit is used to pace
+    collections instead.  Limits of zero mean no limit.
+
+    Heap size is measured as the heap that survived the last collection, plus
+    objects allocated or promoted from the nursery since.  Memory held outside
+    the heap, by cothread stacks and by the embedder, is added when pacing
+    collections, but does not count towards the hard limit.
+
+    The stacks of completed cothreads are kept for reuse, up to the cothread
+    pool limit.  A limit of zero disables the pool.
+
+    The collector marks and sweeps using the given number of threads, which
+    must be at least one.  With lazy sweeping, the collector does not sweep,
+    and the program instead sweeps parts of the heap as it allocates from
+    them.  After sweeping, the pages of free chunks of at least release_size
+    bytes, which have stayed free for the last release_idle sweeps, are
+    returned to the system.  A release size of zero disables this.  Changes
+    to these parameters take effect when the next collection starts.
+
+    Where an environment variable is listed, it overrides the default.
+*/
+
+struct gc_tuning
+{
+    double growth;              // Default 0.5.
+    size_t min_trigger;         // Default 512KiB.
+    size_t soft_limit;
+    size_t hard_limit;
+    size_t cothread_pool_limit; // Default 64, KENAF_COTHREAD_POOL_LIMIT.
+    unsigned threads;           // Default 1, KENAF_GC_THREADS.
+    bool lazy_sweep;            // Default false, KENAF_GC_LAZY_SWEEP.
+    size_t release_size;        // Default 256KiB, KENAF_GC_RELEASE_SIZE.
+    unsigned release_idle;      // Default 1, KENAF_GC_RELEASE_IDLE.
+};
+
+struct gc_triggers
+{
+    size_t growth;          // Collections started by heap growth.
+    size_t min_trigger;     // Collections started by the minimum trigger.
+    size_t soft_limit;      // Collections started early due to the soft limit.
+    size_t hard_limit;      // Allocations which failed at the hard limit.
+    size_t step;            // Collections started early by gc_step.
+};
+
+KF_API gc_tuning get_gc_tuning( runtime* r );
+KF_API void set_gc_tuning( runtime* r, const gc_tuning& tuning );
+KF_API gc_triggers get_gc_triggers( runtime* r );
+
+/*
+    Reports memory allocated (positive delta) or freed (negative delta) by the
+    embedder on behalf of script objects, e.g. native buffers, so that it
+    counts towards GC pacing.  Call from the thread using the runtime.
+*/
+
+KF_API void adjust_external_memory( runtime* r, ptrdiff_t delta );
+
+/*
+    Garbage collector statistics.  Per-cycle statistics describe the most
+    recently completed collection.  Heap statistics are measured when they
+    are requested, by walking the heap.  Times are in seconds.
+*/
+
+struct gc_statistics
+{
+    // Totals over the lifetime of the runtime.
+    size_t collections;         // Completed collections.
+    size_t minor_collections;   // Minor collections.
+    double total_pause;         // Time the mutator was paused by the GC.
+
+    // Most recent collection.
+    double mark_pause;          // Pause to mark roots.
+    double stack_pause;         // Pauses to mark cothread stacks.
+    double sweep_pause;         // Pause to sweep weak tables.
+    double heap_pause;          // Pauses waiting for the heap.
+    double mark_time;           // Concurrent marking.
+    double sweep_time;          // Concurrent sweeping.
+    size_t alive_bytes;         // Bytes which survived.
+    size_t swept_bytes;         // Bytes which were freed.
+
+    // Minor collections in the same period.
+    size_t minor_count;
+    double minor_pause;
+    size_t promoted_bytes;
+
+    // Heap.
+    size_t heap_segments;       // Memory segments allocated from the system.
+    size_t heap_reserved;       // Bytes in heap segments.
+    size_t heap_resident;       // Bytes in heap segments resident in memory.
+    size_t heap_released;       // Free bytes returned to the system, in total.
+    size_t heap_allocated;      // Bytes in allocated chunks.
+    size_t heap_free;           // Bytes in free chunks.
+    size_t heap_largest_free;   // Largest free chunk.
+    size_t nursery_committed;   // Bytes committed for the nursery.
+    size_t large_objects;       // Objects in the large object space.
+    size_t large_mapped;        // Bytes mapped for large objects.
+    size_t external_bytes;      // Bytes held outside the heap.
+};
+
+struct gc_type_statistics
+{
+    const char* name;
+    size_t alive_count;
+    size_t alive_bytes;
+    size_t swept_count;
+    size_t swept_bytes;
+};
+
+/*
+    Performs garbage collection work for up to budget_ns nanoseconds, e.g.
+    in idle time at the end of a frame.  Starts a collection if more than half
+    of the allocation countdown has been used, and a minor collection if the
+    nursery is more than half full.  While a collection is in progress, gives
+    the GC threads time to work, and performs the handshakes which move the
+    collection on.  Returns true if no collection work remains.
+*/
+
+KF_API bool gc_step( runtime* r, uint64_t budget_ns );
+
+KF_API gc_statistics get_gc_statistics( runtime* r );
+KF_API size_t get_gc_type_statistics( runtime* r, gc_type_statistics* types, size_t count );
+
+/*
+    Writes a snapshot of the heap to a file, for analysis with kenaf-heap.
+    Performs a full collection first, so the snapshot holds only objects which
+    survived.  Returns false if the file could not be written.
+*/
+
+KF_API bool write_heap_snapshot( runtime* r, const char* path );
+
 /*
     A context consists of a runtime and a global object.  Contexts on the same
     runtime can share values.
@@ -87,6 +222,9 @@ enum value_kind
     NUMBER,
     BOOL_VALUE,
     NULL_VALUE,
+    F64ARRAY,
+    I32ARRAY,
+    U8ARRAY,
 };
 
 static const value null_value   = { 0 };
@@ -104,6 +242,9 @@ KF_API bool is_table( value v );
 KF_API bool is_function( value v );
 KF_API bool is_cothread( value v );
 KF_API bool is_u64val( value v );
+KF_API bool is_f64array( value v );
+KF_API bool is_i32array( value v );
+KF_API bool is_u8array( value v );
 KF_API bool is_number( value v );
 KF_API bool is_bool( value v );
 KF_API bool is_null( value v );
@@ -143,6 +284,18 @@ KF_API void array_resize( value array, size_t length );
 KF_API void array_append( value array, value v );
 KF_API void array_clear( value array );
 
+/*
+    Typed arrays have a fixed length.  Their elements can be accessed
+    directly, and stay at the same address for as long as the array is alive.
+*/
+
+KF_API value create_f64array( size_t length, double** out_data = nullptr );
+KF_API value create_i32array( size_t length, int32_t** out_data = nullptr );
+KF_API value create_u8array( size_t length, uint8_t** out_data = nullptr );
+KF_API double* get_f64array( value array, size_t* out_length );
+KF_API int32_t* get_i32array( value array, size_t* out_length );
+KF_API uint8_t* get_u8array( value array, size_t* out_length );
+
 KF_API value create_table();
 KF_API value create_table( size_t capacity );
 KF_API size_t table_length( value table );
@@ -214,6 +367,7 @@ enum error_kind
     ERROR_INVALID,      // Invalid argument.
     ERROR_ARGUMENT,     // Incorrect argument count.
     ERROR_COTHREAD,     // Attempt to resume a dead cothread.
+    ERROR_STACK,        // Stack overflow.
 };
 
 struct stack_trace;
@@ -27,11 +27,75 @@ static void error_handler( kf::error_kind error, std::string_view message, kf::s
     throw kf::script_error( error, message, backtrace, raised );
 }
 
+static void print_gc_stats( kf::runtime* runtime )
+{
+    kf::gc_statistics s = kf::get_gc_statistics( runtime );
+    kf::gc_triggers t = kf::get_gc_triggers( runtime );
+    double fragmentation = s.heap_free ? 1.0 - (double)s.heap_largest_free / s.heap_free : 0.0;
+
+    fprintf( stderr, "{\n" );
+    fprintf( stderr, "  \"collections\": %zu,\n", s.collections );
+    fprintf( stderr, "  \"minor_collections\": %zu,\n", s.minor_collections );
+    fprintf( stderr, "  \"total_pause\": %f,\n", s.total_pause );
+    fprintf( stderr, "  \"triggers\": { \"growth\": %zu, \"min_trigger\": %zu, \"soft_limit\": %zu, \"hard_limit\": %zu, \"step\": %zu },\n", t.growth, t.min_trigger, t.soft_limit, t.hard_limit, t.step );
+    fprintf( stderr, "  \"last_collection\": {\n" );
+    fprintf( stderr, "    \"mark_pause\": %f,\n", s.mark_pause );
+    fprintf( stderr, "    \"stack_pause\": %f,\n", s.stack_pause );
+    fprintf( stderr, "    \"sweep_pause\": %f,\n", s.sweep_pause );
+    fprintf( stderr, "    \"heap_pause\": %f,\n", s.heap_pause );
+    fprintf( stderr, "    \"mark_time\": %f,\n", s.mark_time );
+    fprintf( stderr, "    \"sweep_time\": %f,\n", s.sweep_time );
+    fprintf( stderr, "    \"alive_bytes\": %zu,\n", s.alive_bytes );
+    fprintf( stderr, "    \"swept_bytes\": %zu,\n", s.swept_bytes );
+    fprintf( stderr, "    \"minor_count\": %zu,\n", s.minor_count );
+    fprintf( stderr, "    \"minor_pause\": %f,\n", s.minor_pause );
+    fprintf( stderr, "    \"promoted_bytes\": %zu,\n", s.promoted_bytes );
+    fprintf( stderr, "    \"types\": {" );
+
+    std::vector< kf::gc_type_statistics > types( kf::get_gc_type_statistics( runtime, nullptr, 0 ) );
+    kf::get_gc_type_statistics( runtime, types.data(), types.size() );
+    for ( size_t i = 0; i < types.size(); ++i )
+    {
+        const kf::gc_type_statistics& type = types[ i ];
+        fprintf
+        (
+            stderr,
+            "%s\n      \"%s\": { \"alive_count\": %zu, \"alive_bytes\": %zu, \"swept_count\": %zu, \"swept_bytes\": %zu }",
+            i ? "," : "",
+            type.name,
+            type.alive_count,
+            type.alive_bytes,
+            type.swept_count,
+            type.swept_bytes
+        );
+    }
+
+    fprintf( stderr, "\n    }\n" );
+    fprintf( stderr, "  },\n" );
+    fprintf( stderr, "  \"heap\": {\n" );
+    fprintf( stderr, "    \"segments\": %zu,\n", s.heap_segments );
+    fprintf( stderr, "    \"reserved\": %zu,\n", s.heap_reserved );
+    fprintf( stderr, "    \"resident\": %zu,\n", s.heap_resident );
+    fprintf( stderr, "    \"released\": %zu,\n", s.heap_released );
+    fprintf( stderr, "    \"allocated\": %zu,\n", s.heap_allocated );
+    fprintf( stderr, "    \"free\": %zu,\n", s.heap_free );
+    fprintf( stderr, "    \"largest_free\": %zu,\n", s.heap_largest_free );
+    fprintf( stderr, "    \"fragmentation\": %f,\n", fragmentation );
+    fprintf( stderr, "    \"nursery_committed\": %zu,\n", s.nursery_committed );
+    fprintf( stderr, "    \"large_objects\": %zu,\n", s.large_objects );
+    fprintf( stderr, "    \"large_mapped\": %zu,\n", s.large_mapped );
+    fprintf( stderr, "    \"external\": %zu\n", s.external_bytes );
+    fprintf( stderr, "  }\n" );
+    fprintf( stderr, "}\n" );
+}
+
 int main( int argc, char* argv[] )
 {
     // Parse arguments.
     const char* filename = nullptr;
     unsigned debug_print = kf::PRINT_NONE;
+    bool gc_stats = false;
+    const char* heap_snapshot = nullptr;
 
     int i = 1;
     for ( ; i < argc; ++i )
@@ -75,6 +139,14 @@ int main( int argc, char* argv[] )
             {
                 debug_print |= kf::PRINT_CODE;
             }
+            if ( strcmp( option, "--gc-stats" ) == 0 )
+            {
+                gc_stats = true;
+            }
+            if ( strcmp( option, "--heap-snapshot" ) == 0 && i + 1 < argc )
+            {
+                heap_snapshot = argv[ ++i ];
+            }
         }
         else
         {
@@ -144,6 +216,7 @@ int main( int argc, char* argv[] )
     compiler.reset();
 
     // Executes script, passing remaining command line arguments.
+    int result = EXIT_SUCCESS;
     try
     {
         kf::scoped_frame frame;
@@ -155,14 +228,12 @@ int main( int argc, char* argv[] )
         }
 
         kf::stack_values results = kf::call_frame( frame, main );
-        int result = EXIT_SUCCESS;
         if ( results.count && is_number( results.values[ 0 ] ) )
         {
             result = (int)get_number( results.values[ 0 ] );
         }
 
         kf::pop_frame( frame );
-        return result;
     }
     catch ( const kf::script_error& e )
     {
@@ -172,7 +243,22 @@ int main( int argc, char* argv[] )
         {
             fprintf( stderr, "    %s\n", stack_trace_frame( s, i ) );
         }
-        return EXIT_FAILURE;
+        result = EXIT_FAILURE;
+    }
+
+    // Write heap snapshot.
+    if ( heap_snapshot && ! kf::write_heap_snapshot( runtime.get(), heap_snapshot ) )
+    {
+        fprintf( stderr, "cannot write heap snapshot '%s'\n", heap_snapshot );
+        result = EXIT_FAILURE;
+    }
+
+    // Dump GC statistics as JSON.
+    if ( gc_stats )
+    {
+        print_gc_stats( runtime.get() );
     }
+
+    return result;
 }
 
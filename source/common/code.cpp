@@ -138,6 +138,8 @@ const char* const OPCODE_PRINT[] =
     INIT( OP_APPEND     ) "APPEND %$a, %$b",
     INIT( OP_CALL       ) "CALL @$r:$b, @$r:$a",
     INIT( OP_CALLR      ) "CALLR %$b, @$r:$a",
+    INIT( OP_MCALL      ) "MCALL @$r:$b, @$r:$a, #$*Sc",
+    INIT( OP_MCALLR     ) "MCALLR %$b, @$r:$a, #$*Sc",
     INIT( OP_YCALL      ) "YCALL @$r:$b, @$r:$a",
     INIT( OP_YIELD      ) "YIELD @$r:$b, @$r:$a",
     INIT( OP_RETURN     ) "RETURN @$r:$a",
@@ -164,6 +166,22 @@ const char* const OPCODE_PRINT[] =
     INIT( OP_F_METHOD   ) "F_METHOD %$r, %$a",
     INIT( OP_F_VARENV   ) "F_VARENV %$r, #$a, %$b",
     INIT( OP_F_OUTENV   ) "F_OUTENV %$r, #$a, ^$b",
+    INIT( OP_JLT_NN     ) "JLT$Br_NN, %$a, %$b, $*Jj",
+    INIT( OP_JLE_NN     ) "JLE$Br_NN, %$a, %$b, $*Jj",
+    INIT( OP_GET_ARRAY  ) "GET_ARRAY %$r, %$a, %$b",
+    INIT( OP_GET_TABLE  ) "GET_TABLE %$r, %$a, %$b",
+    INIT( OP_GET_ARRAYI ) "GET_ARRAYI %$r, %$a, #$b",
+    INIT( OP_SET_ARRAY  ) "SET_ARRAY %$r, %$a, %$b",
+    INIT( OP_SET_TABLE  ) "SET_TABLE %$r, %$a, %$b",
+    INIT( OP_SET_ARRAYI ) "SET_ARRAYI %$r, %$a, #$b",
+    INIT( OP_GET_TYPED  ) "GET_TYPED %$r, %$a, %$b",
+    INIT( OP_SET_TYPED  ) "SET_TYPED %$r, %$a, %$b",
+    INIT( OP_JLT_ANY    ) "JLT$Br_ANY, %$a, %$b, $*Jj",
+    INIT( OP_JLE_ANY    ) "JLE$Br_ANY, %$a, %$b, $*Jj",
+    INIT( OP_GET_INDEX_ANY ) "GET_INDEX_ANY %$r, %$a, %$b",
+    INIT( OP_GET_INDEXI_ANY ) "GET_INDEXI_ANY %$r, %$a, #$b",
+    INIT( OP_SET_INDEX_ANY ) "SET_INDEX_ANY %$r, %$a, %$b",
+    INIT( OP_SET_INDEXI_ANY ) "SET_INDEXI_ANY %$r, %$a, #$b",
 };
 
 void code_script::debug_print() const
@@ -200,6 +218,8 @@ void code_function::debug_print( const code_script* script ) const
         printf( "  DIRECT\n" );
     if ( code_flags & CODE_GENERATOR )
         printf( "  GENERATOR\n" );
+    if ( code_flags & CODE_STACKLESS )
+        printf( "  STACKLESS\n" );
 
     if ( debug )
     {
@@ -88,6 +88,8 @@ enum opcode : uint8_t
 
     OP_CALL,            // r:b = call( r:a )        | X | r | a | b |
     OP_CALLR,           // b = call( r:a )          | X | r | a | b |
+    OP_MCALL,           // r:b = call( r:a ) method | X | r | a | b || X | - |   c   |
+    OP_MCALLR,          // b = call( r:a ) method   | X | r | a | b || X | - |   c   |
     OP_YCALL,           // r:b = call( r:a )        | X | r | a | b |
     OP_YIELD,           // r:b = yield r:a          | X | r | a | b |
     OP_RETURN,          // return r:a               | X | r | a | - |
@@ -120,6 +122,26 @@ enum opcode : uint8_t
     OP_F_METHOD,        // r.omethod = a            | N | r | a | - |
     OP_F_VARENV,        // r.out[ %a ] = b          | G | r | a | b |
     OP_F_OUTENV,        // r.out[ %a ] = out[b]     | G | r | a | b |
+
+    // Quickened instructions, only produced by the interpreter at runtime.
+    OP_JLT_NN,          // if a < b then jump       | T | ! | a | b || J | - |   j   |
+    OP_JLE_NN,          // if a <= b then jump      | T | ! | a | b || J | - |   j   |
+    OP_GET_ARRAY,       // r = a[ b ]               | G | r | a | b |
+    OP_GET_TABLE,       // r = a[ b ]               | G | r | a | b |
+    OP_GET_ARRAYI,      // r = a[ %b ]              | G | r | a | b |
+    OP_SET_ARRAY,       // a[ b ] = r               | G | r | a | b |
+    OP_SET_TABLE,       // a[ b ] = r               | G | r | a | b |
+    OP_SET_ARRAYI,      // a[ %b ] = r              | G | r | a | b |
+    OP_GET_TYPED,       // r = a[ b ]               | G | r | a | b |
+    OP_SET_TYPED,       // a[ b ] = r               | G | r | a | b |
+
+    // Generic instructions which failed a quickened guard, never quickened again.
+    OP_JLT_ANY,         // if a < b then jump       | T | ! | a | b || J | - |   j   |
+    OP_JLE_ANY,         // if a <= b then jump      | T | ! | a | b || J | - |   j   |
+    OP_GET_INDEX_ANY,   // r = a[ b ]               | G | r | a | b |
+    OP_GET_INDEXI_ANY,  // r = a[ %b ]              | G | r | a | b |
+    OP_SET_INDEX_ANY,   // a[ b ] = r               | G | r | a | b |
+    OP_SET_INDEXI_ANY,  // a[ %b ] = r              | G | r | a | b |
 };
 
 const uint8_t OP_STACK_MARK = 0xFF;
@@ -173,6 +195,7 @@ enum
     CODE_VARARG     = 1 << 0,
     CODE_DIRECT     = 1 << 1,
     CODE_GENERATOR  = 1 << 2,
+    CODE_STACKLESS  = 1 << 3,
 };
 
 struct code_function
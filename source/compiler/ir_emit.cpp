@@ -88,6 +88,7 @@ ir_emit::ir_emit( report* report, code_unit* unit )
     ,   _unit( unit )
     ,   _f( nullptr )
     ,   _max_r( 0 )
+    ,   _method_key( IR_INVALID_INDEX )
 {
 }
 
@@ -112,6 +113,10 @@ void ir_emit::emit( ir_function* function )
     if ( _f->ast->is_generator )
     {
         _u->function.code_flags |= CODE_GENERATOR;
+        if ( is_stackless() )
+        {
+            _u->function.code_flags |= CODE_STACKLESS;
+        }
     }
     _u->debug.function_name = _unit->debug_heap.size();
     _unit->debug_heap.insert( _unit->debug_heap.end(), _f->ast->name.begin(), _f->ast->name.end() );
@@ -126,10 +131,24 @@ void ir_emit::emit( ir_function* function )
     _fixups.clear();
     _labels.clear();
     _max_r = 0;
+    _method_key = IR_INVALID_INDEX;
 
     _unit->functions.push_back( std::move( _u ) );
 }
 
+bool ir_emit::is_stackless()
+{
+    // A generator which never uses 'yield for' only suspends its own frame.
+    for ( const ir_op& iop : _f->ops )
+    {
+        if ( iop.opcode == IR_YCALL )
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
 void ir_emit::emit_constants()
 {
     _u->constants.reserve( _f->constants.size() );
@@ -172,6 +191,13 @@ void ir_emit::assemble()
             continue;
         }
 
+        // Key lookups which are immediately called are fused with the call.
+        if ( iop->opcode == IR_GET_KEY && match_method_call( op_index, iop ) )
+        {
+            _method_key = op_index;
+            continue;
+        }
+
         // Search for entry in shapes.
         const emit_shape* shape = std::lower_bound
         (
@@ -641,21 +667,33 @@ unsigned ir_emit::with_stacked( unsigned op_index, const ir_op* iop )
     unsigned a = IR_INVALID_REGISTER; // arguments
     unsigned b = IR_INVALID_REGISTER; // results
 
+    unsigned c = IR_INVALID_INDEX; // method selector
+
     opcode opcode;
     switch ( iop->opcode )
     {
     case IR_CALL:
+        // Check if the function was looked up by a fused GET_KEY.
+        if ( _method_key != IR_INVALID_INDEX && _f->operands[ iop->oindex ].index == _method_key )
+        {
+            const ir_op* kop = &_f->ops[ _method_key ];
+            ir_operand selector = _f->operands[ kop->oindex + 1 ];
+            assert( selector.kind == IR_O_SELECTOR );
+            c = selector.index;
+            _method_key = IR_INVALID_INDEX;
+        }
+
         // Check if we can encode as CALLR.
         if ( iop->unpack() == 1 && iop->r != iop->s )
         {
-            opcode = OP_CALLR;
+            opcode = c == IR_INVALID_INDEX ? OP_CALLR : OP_MCALLR;
             if ( ! check_r( iop, "call result" ) ) return op_index;
             _max_r = std::max( _max_r, iop->r );
             b = iop->r; // explicitly encoded result.
         }
         else
         {
-            opcode = OP_CALL;
+            opcode = c == IR_INVALID_INDEX ? OP_CALL : OP_MCALL;
         }
         break;
 
@@ -755,6 +793,10 @@ unsigned ir_emit::with_stacked( unsigned op_index, const ir_op* iop )
 
     // Emit.
     emit( iop->sloc, op::op_ab( opcode, r, a, b ) );
+    if ( c != IR_INVALID_INDEX )
+    {
+        emit( iop->sloc, op::op_c( opcode, 0, c ) );
+    }
 
     // Move single result if necessary.
     if ( m != IR_INVALID_REGISTER )
@@ -945,6 +987,90 @@ unsigned ir_emit::next( unsigned op_index, ir_opcode iopcode )
     return IR_INVALID_INDEX;
 }
 
+bool ir_emit::match_method_call( unsigned op_index, const ir_op* iop )
+{
+    /*
+        intermediate:
+            %0 <- GET_KEY o, 'key'
+            ... only ops which cannot throw or have side effects
+            CALL %0, o, ...
+
+        code:
+            MCALL @s:b, @s:a, #'key'
+
+        The result of the GET_KEY must already be allocated to the call's
+        stack top, and must not be used by any op other than the call.
+    */
+
+    assert( iop->opcode == IR_GET_KEY );
+    assert( iop->ocount == 2 );
+    ir_operand object = _f->operands[ iop->oindex + 0 ];
+    if ( object.kind != IR_O_OP || _f->operands[ iop->oindex + 1 ].kind != IR_O_SELECTOR )
+    {
+        return false;
+    }
+
+    for ( unsigned index = op_index + 1; index < _f->ops.size(); ++index )
+    {
+        const ir_op* cop = &_f->ops[ index ];
+        switch ( cop->opcode )
+        {
+        case IR_PHI:
+        case IR_REF:
+        case IR_NOP:
+            continue;
+
+        case IR_CONST:
+        case IR_MOV:
+        case IR_GET_ENV:
+            for ( unsigned j = 0; j < cop->ocount; ++j )
+            {
+                ir_operand operand = _f->operands[ cop->oindex + j ];
+                if ( operand.kind == IR_O_OP && operand.index == op_index )
+                {
+                    return false;
+                }
+            }
+            continue;
+
+        case IR_CALL:
+        {
+            if ( cop->ocount < 2 || cop->s == IR_INVALID_REGISTER || cop->s != iop->r )
+            {
+                return false;
+            }
+
+            ir_operand function = _f->operands[ cop->oindex + 0 ];
+            ir_operand self = _f->operands[ cop->oindex + 1 ];
+            if ( function.kind != IR_O_OP || function.index != op_index )
+            {
+                return false;
+            }
+            if ( self.kind != IR_O_OP || self.index != object.index )
+            {
+                return false;
+            }
+
+            for ( unsigned j = 2; j < cop->ocount; ++j )
+            {
+                ir_operand operand = _f->operands[ cop->oindex + j ];
+                if ( operand.kind == IR_O_OP && operand.index == op_index )
+                {
+                    return false;
+                }
+            }
+
+            return _f->ops[ self.index ].unpack() != IR_UNPACK_ALL;
+        }
+
+        default:
+            return false;
+        }
+    }
+
+    return false;
+}
+
 bool ir_emit::match_operands( const ir_op* iop, const emit_shape* shape )
 {
     if ( iop->ocount != shape->ocount )
@@ -64,6 +64,7 @@ private:
         unsigned source;
     };
 
+    bool is_stackless();
     void emit_constants();
 
     void assemble();
@@ -74,6 +75,7 @@ private:
     unsigned with_for_step( unsigned op_index, const ir_op* iop );
 
     unsigned next( unsigned op_index, ir_opcode iopcode );
+    bool match_method_call( unsigned op_index, const ir_op* iop );
     bool match_operands( const ir_op* iop, const emit_shape* shape );
 
     const ir_op* u_operand( const ir_op* iop );
@@ -96,6 +98,7 @@ private:
     std::vector< jump_label > _labels;
     std::vector< move_entry > _moves;
     unsigned _max_r;
+    unsigned _method_key;
 
 };
 
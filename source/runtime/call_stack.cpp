@@ -28,29 +28,34 @@ stack_frame* active_frame( vmachine* vm )
 value* resize_stack( vmachine* vm, unsigned xp )
 {
     cothread_object* cothread = vm->c->cothread;
-    return resize_stack( cothread, cothread->stack_frames.back().fp, xp );
+    return resize_stack( vm, cothread, cothread->stack_frames.back().fp, xp );
 }
 
-value* resize_stack( cothread_object* cothread, unsigned fp, unsigned xp )
+value* resize_stack( vmachine* vm, cothread_object* cothread, unsigned fp, unsigned xp )
 {
     // xp is relative to current frame pointer.
-    cothread->xp = fp + xp;
+    unsigned size = fp + xp;
 
-    // Increase stack size.
-    if ( cothread->xp > cothread->stack.size() )
+    // Increase stack size, committing more memory if required.
+    if ( size > cothread->stack_size )
     {
-        size_t size = ( cothread->xp + 31u ) & ~(size_t)31u;
-        cothread->stack.resize( size );
+        if ( size > cothread->stack_commit )
+        {
+            cothread_commit_stack( cothread, size );
+        }
+        cothread->stack_size = ( size + 31u ) & ~31u;
+        cothread_charge_stack( vm, cothread );
     }
 
-    // Return possibly reallocated stack.
-    return cothread->stack.data() + fp;
+    // Stack never moves.
+    cothread->xp = size;
+    return cothread->stack + fp;
 }
 
 value* entire_stack( vmachine* vm )
 {
     cothread_object* cothread = vm->c->cothread;
-    return cothread->stack.data();
+    return cothread->stack;
 }
 
 bool call_value( vmachine* vm, value u, unsigned rp, unsigned xp, bool ycall, xstate* out_state )
@@ -64,6 +69,7 @@ bool call_value( vmachine* vm, value u, unsigned rp, unsigned xp, bool ycall, xs
             Functions       Construct call frame for function, continue.
             Generators      Create cothread for generator, assign initial parameters.
             Cothreads       Push cothread on stack, resume yielded cothread.
+            Stackless       Restore generator's frame on top of stack, resume.
     */
 
     if ( type == FUNCTION_OBJECT )
@@ -102,6 +108,14 @@ bool call_value( vmachine* vm, value u, unsigned rp, unsigned xp, bool ycall, xs
         return true;
     }
 
+    if ( type == GENERATOR_OBJECT )
+    {
+        // Resume stackless generator.
+        generator_object* callee_generator = (generator_object*)unbox_object( u );
+        *out_state = call_stackless( vm, callee_generator, rp, xp );
+        return true;
+    }
+
     if ( type == LOOKUP_OBJECT )
     {
         // Call prototype constructor.
@@ -129,6 +143,14 @@ xstate call_function( vmachine* vm, function_object* function, unsigned rp, unsi
         raise_error( ERROR_ARGUMENT, "incorrect argument count, expected %u, got %u", program->param_count, argument_count );
     }
 
+#ifdef KF_JIT
+    // Compile hot programs.
+    if ( program->jit_count++ == vm->jit_threshold && ! program->jit )
+    {
+        program->jit = jit_compile( vm, program );
+    }
+#endif
+
     cothread_object* cothread = vm->c->cothread;
     unsigned bp = cothread->stack_frames.back().fp + rp;
     cothread->stack_frames.push_back( { function, bp, bp, 0, RESUME_CALL, 0, 0, 0 } );
@@ -155,7 +177,7 @@ xstate call_function( vmachine* vm, function_object* function, unsigned rp, unsi
                         arg0
                 xp  ->
         */
-        value* r = cothread->stack.data() + bp;
+        value* r = cothread->stack + bp;
         unsigned total_count = xp - rp;
         unsigned split_count = program->param_count + 1;
         std::reverse( r, r + split_count );
@@ -164,7 +186,7 @@ xstate call_function( vmachine* vm, function_object* function, unsigned rp, unsi
         stack_frame->fp = bp + total_count - split_count;
     }
 
-    value* r = resize_stack( cothread, stack_frame->fp, program->stack_size );
+    value* r = resize_stack( vm, cothread, stack_frame->fp, program->stack_size );
     return { stack_frame->function, r, stack_frame->ip, cothread->xp - stack_frame->fp };
 }
 
@@ -188,7 +210,7 @@ xstate call_native( vmachine* vm, native_function_object* function, unsigned rp,
     unsigned bp = cothread->stack_frames.back().fp + rp;
 
     frame native_frame = { cothread, bp };
-    value* arguments = cothread->stack.data() + bp + 1;
+    value* arguments = cothread->stack + bp + 1;
     size_t result_count;
     try
     {
@@ -228,12 +250,7 @@ xstate call_generator( vmachine* vm, function_object* function, unsigned rp, uns
     cothread_object* caller_cothread = vm->c->cothread;
     const stack_frame* caller_frame = &caller_cothread->stack_frames.back();
     unsigned caller_bp = caller_frame->fp + rp;
-    value* caller_r = caller_cothread->stack.data() + caller_bp;
-
-    // Create new cothread.
-    cothread_object* generator_cothread = cothread_new( vm );
-    generator_cothread->stack_frames.push_back( { function, 0, 0, 0, RESUME_YIELD, 0, 0, 0 } );
-    stack_frame* generator_frame = &generator_cothread->stack_frames.back();
+    value* caller_r = caller_cothread->stack + caller_bp;
 
     /*
         Arguments are on caller's stack:
@@ -254,11 +271,37 @@ xstate call_generator( vmachine* vm, function_object* function, unsigned rp, uns
                     arg0
     */
 
-    // Copy arguments to cothread's stack.
-    unsigned stack_size = std::max< unsigned >( program->stack_size, 1 + argument_count );
-    value* generator_r = resize_stack( generator_cothread, 0, stack_size );
     unsigned actual_count = 1 + program->param_count;
     unsigned vararg_count = xp - rp - actual_count;
+
+    if ( program->code_flags & CODE_STACKLESS )
+    {
+        // Save arguments in generator object.
+        unsigned stack_size = std::max< unsigned >( program->stack_size, actual_count );
+        generator_object* generator = generator_new( vm, function, vararg_count + stack_size );
+        generator->fp = vararg_count;
+        for ( unsigned i = 0; i < vararg_count; ++i )
+        {
+            winit( generator->slots[ i ], caller_r[ actual_count + i ] );
+        }
+        for ( unsigned i = 0; i < actual_count; ++i )
+        {
+            winit( generator->slots[ vararg_count + i ], caller_r[ i ] );
+        }
+
+        // Return with the generator as the result.
+        caller_r[ 0 ] = box_object( generator );
+        return stack_return( vm, caller_cothread, caller_frame, caller_bp, 0, 1 );
+    }
+
+    // Create new cothread.
+    cothread_object* generator_cothread = cothread_new( vm );
+    generator_cothread->stack_frames.push_back( { function, 0, 0, 0, RESUME_YIELD, 0, 0, 0 } );
+    stack_frame* generator_frame = &generator_cothread->stack_frames.back();
+
+    // Copy arguments to cothread's stack.
+    unsigned stack_size = std::max< unsigned >( program->stack_size, 1 + argument_count );
+    value* generator_r = resize_stack( vm, generator_cothread, 0, stack_size );
     memcpy( generator_r, caller_r + actual_count, vararg_count * sizeof( value ) );
     memcpy( generator_r + vararg_count, caller_r, actual_count * sizeof( value ) );
     generator_frame->fp = vararg_count;
@@ -288,7 +331,7 @@ xstate call_cothread( vmachine* vm, cothread_object* cothread, unsigned rp, unsi
 
     // Get current stack.
     cothread_object* caller_cothread = vm->c->cothread;
-    value* caller_r = caller_cothread->stack.data() + caller_cothread->stack_frames.back().fp;
+    value* caller_r = caller_cothread->stack + caller_cothread->stack_frames.back().fp;
 
     // Get stack frame we are resuming into.
     const stack_frame* stack_frame = &cothread->stack_frames.back();
@@ -298,7 +341,7 @@ xstate call_cothread( vmachine* vm, cothread_object* cothread, unsigned rp, unsi
     // Work out place in stack to copy to.
     unsigned xr = stack_frame->xr;
     unsigned xb = stack_frame->xb != OP_STACK_MARK ? stack_frame->xb : xr + ( xp - rp );
-    value* r = resize_stack( cothread, stack_frame->fp, xb );
+    value* r = resize_stack( vm, cothread, stack_frame->fp, xb );
 
     // Copy parameters into cothread.
     while ( xr < xb )
@@ -312,6 +355,67 @@ xstate call_cothread( vmachine* vm, cothread_object* cothread, unsigned rp, unsi
     return { stack_frame->function, r, stack_frame->ip, cothread->xp - stack_frame->fp };
 }
 
+xstate call_stackless( vmachine* vm, generator_object* generator, unsigned rp, unsigned xp )
+{
+    /*
+        Resume stackless generator on the current cothread.  The generator's
+        saved registers are restored above the arguments:
+
+            rp  ->  generator
+                    arg0
+            xp  ->  ...
+            bp  ->  vararg0
+            fp  ->  function
+                    ...
+    */
+
+    assert( rp < xp );
+    rp += 1;
+
+    // Generator might have completed, or be resuming itself.
+    function_object* function = read( generator->function );
+    if ( ! function )
+    {
+        raise_error( ERROR_COTHREAD, "cothread is done" );
+    }
+    if ( generator->running )
+    {
+        raise_error( ERROR_COTHREAD, "cothread is running" );
+    }
+
+    // Get current stack.  For-each resumes generators from the middle of
+    // the caller's frame, so keep clear of all the caller's registers.
+    cothread_object* cothread = vm->c->cothread;
+    const stack_frame* caller_frame = &cothread->stack_frames.back();
+    unsigned caller_fp = caller_frame->fp;
+    unsigned caller_size = caller_frame->function ? read( caller_frame->function->program )->stack_size : 0;
+    unsigned bp = caller_fp + std::max( xp, caller_size );
+    unsigned fp = bp + generator->fp;
+
+    // Work out place in stack to copy to.
+    unsigned xr = generator->xr;
+    unsigned xb = generator->xb != OP_STACK_MARK ? generator->xb : xr + ( xp - rp );
+    value* r = resize_stack( vm, cothread, fp, std::max( generator->size - generator->fp, xb ) );
+    value* caller_r = cothread->stack + caller_fp;
+
+    // Restore registers.
+    value* generator_r = r - generator->fp;
+    for ( unsigned i = 0; i < generator->size; ++i )
+    {
+        generator_r[ i ] = read( generator->slots[ i ] );
+    }
+
+    // Copy parameters into yield results.
+    while ( xr < xb )
+    {
+        r[ xr++ ] = rp < xp ? caller_r[ rp++ ] : null_value;
+    }
+
+    // Push frame and continue.
+    generator->running = true;
+    cothread->stack_frames.push_back( { function, bp, fp, generator->ip, RESUME_YIELD, 0, 0, 0, generator } );
+    return { function, r, generator->ip, cothread->xp - fp };
+}
 
 xstate call_prototype( vmachine* vm, lookup_object* prototype, unsigned rp, unsigned xp )
 {
@@ -386,6 +490,27 @@ xstate call_return( vmachine* vm, unsigned rp, unsigned xp )
     stack_frame return_frame = cothread->stack_frames.back();
     cothread->stack_frames.pop_back();
 
+    if ( return_frame.generator )
+    {
+        // Complete stackless generator.
+        generator_object* generator = return_frame.generator;
+        write( vm, generator->function, (function_object*)nullptr );
+        generator->running = false;
+
+        const stack_frame* stack_frame = &cothread->stack_frames.back();
+        if ( stack_frame->resume != RESUME_FOR_EACH )
+        {
+            return stack_return( vm, cothread, stack_frame, return_frame.fp, rp, xp );
+        }
+        else
+        {
+            // No results, end iteration by jumping.
+            program_object* program = read( stack_frame->function->program );
+            value* r = resize_stack( vm, cothread, stack_frame->fp, program->stack_size );
+            return { stack_frame->function, r, stack_frame->ip - 1, cothread->xp - stack_frame->fp };
+        }
+    }
+
     if ( cothread->stack_frames.size() )
     {
         // Normal return.
@@ -407,13 +532,16 @@ xstate call_return( vmachine* vm, unsigned rp, unsigned xp )
         if ( stack_frame->resume != RESUME_FOR_EACH )
         {
             // Return across cothreads.
-            const value* yield_r = yield_cothread->stack.data() + return_frame.fp;
-            return yield_return( vm, cothread, stack_frame, yield_r, rp, xp );
+            const value* yield_r = yield_cothread->stack + return_frame.fp;
+            xstate state = yield_return( vm, cothread, stack_frame, yield_r, rp, xp );
+            cothread_recycle_stack( vm, yield_cothread );
+            return state;
         }
         else
         {
             // No results, end iteration by jumping.
-            value* r = resize_stack( cothread, stack_frame->fp, rp );
+            cothread_recycle_stack( vm, yield_cothread );
+            value* r = resize_stack( vm, cothread, stack_frame->fp, rp );
             return { stack_frame->function, r, stack_frame->ip - 1, cothread->xp - stack_frame->fp };
         }
     }
@@ -423,9 +551,33 @@ xstate call_yield( vmachine* vm, unsigned rp, unsigned xp )
 {
     assert( rp <= xp );
 
+    // Suspend stackless generator.
+    cothread_object* current = vm->c->cothread;
+    if ( current->stack_frames.back().generator )
+    {
+        stack_frame yield_frame = current->stack_frames.back();
+        current->stack_frames.pop_back();
+
+        // Save registers.
+        generator_object* generator = yield_frame.generator;
+        const value* generator_r = current->stack + yield_frame.bp;
+        for ( unsigned i = 0; i < generator->size; ++i )
+        {
+            write( vm, generator->slots[ i ], generator_r[ i ] );
+        }
+
+        generator->ip = yield_frame.ip;
+        generator->xr = yield_frame.xr;
+        generator->xb = yield_frame.xb;
+        generator->running = false;
+
+        // Yielded values are returned to the resumer on this stack.
+        return stack_return( vm, current, &current->stack_frames.back(), yield_frame.fp, rp, xp );
+    }
+
     // Suspend cothread.
     cothread_object* yield_cothread = vm->c->cothread;
-    value* yield_r = yield_cothread->stack.data() + yield_cothread->stack_frames.back().fp;
+    value* yield_r = yield_cothread->stack + yield_cothread->stack_frames.back().fp;
 
     // Get cothread we are yielding into.
     assert( ! vm->c->cothread_stack.empty() );
@@ -447,12 +599,12 @@ static xstate stack_return( vmachine* vm, cothread_object* cothread, const stack
     unsigned xb = stack_frame->xb != OP_STACK_MARK ? stack_frame->xb : xr + result_count;
 
     // return_r with function we're returning from, r with function we're returning to.
-    value* return_r = cothread->stack.data() + return_fp;
-    value* r = cothread->stack.data() + stack_frame->fp;
+    value* return_r = cothread->stack + return_fp;
+    value* r = cothread->stack + stack_frame->fp;
 
     assert( r <= return_r );
     assert( r + xr <= return_r + rp );
-    assert( stack_frame->fp + xb <= cothread->stack.size() );
+    assert( stack_frame->fp + xb <= cothread->stack_size );
 
     if ( stack_frame->resume == RESUME_CONSTRUCT && result_count == 0 )
     {
@@ -463,7 +615,7 @@ static xstate stack_return( vmachine* vm, cothread_object* cothread, const stack
     size_t value_count = std::min< size_t >( result_count, xb - xr );
     if ( r + xr < return_r + rp )
     {
-        memmove( r + xr, return_r + rp, value_count + sizeof( value ) );
+        memmove( r + xr, return_r + rp, value_count * sizeof( value ) );
     }
     xr += value_count;
 
@@ -490,10 +642,10 @@ static xstate yield_return( vmachine* vm, cothread_object* cothread, const stack
     assert( rp <= xp );
 
     // Copy results.
-    size_t result_count = rp - xp;
+    size_t result_count = xp - rp;
     unsigned xr = stack_frame->xr;
     unsigned xb = stack_frame->xb != OP_STACK_MARK ? stack_frame->xb : xr + result_count;
-    value* r = resize_stack( cothread, stack_frame->fp, xb );
+    value* r = resize_stack( vm, cothread, stack_frame->fp, xb );
 
     if ( stack_frame->resume == RESUME_CONSTRUCT && result_count == 0 )
     {
@@ -541,6 +693,13 @@ void unwind( vmachine* vm, unsigned ip )
         source_location sloc = program_source_location( vm, program, ip );
         append_stack_trace( "%.*s:%u:%u: %.*s", (int)sname.size(), sname.data(), sloc.line, sloc.column, (int)fname.size(), fname.data() );
 
+        if ( frame.generator )
+        {
+            // Exception completes stackless generator.
+            write( vm, frame.generator->function, (function_object*)nullptr );
+            frame.generator->running = false;
+        }
+
         cothread->stack_frames.pop_back();
         if ( cothread->stack_frames.empty() )
         {
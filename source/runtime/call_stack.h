@@ -60,6 +60,8 @@ struct stack_frame
     uint8_t xr;         // lower index of call/yield results
     uint8_t xb;         // upper index of call/yield results
     uint8_t rr;         // callr result register
+
+    generator_object* generator; // stackless generator running in frame
 };
 
 /*
@@ -68,7 +70,7 @@ struct stack_frame
 
 stack_frame* active_frame( vmachine* vm );
 value* resize_stack( vmachine* vm, unsigned xp );
-value* resize_stack( cothread_object* cothread, unsigned fp, unsigned xp );
+value* resize_stack( vmachine* vm, cothread_object* cothread, unsigned fp, unsigned xp );
 value* entire_stack( vmachine* vm );
 
 /*
@@ -80,6 +82,7 @@ xstate call_function( vmachine* vm, function_object* function, unsigned rp, unsi
 xstate call_native( vmachine* vm, native_function_object* function, unsigned rp, unsigned xp );
 xstate call_generator( vmachine* vm, function_object* function, unsigned rp, unsigned xp );
 xstate call_cothread( vmachine* vm, cothread_object* cothread, unsigned rp, unsigned xp );
+xstate call_stackless( vmachine* vm, generator_object* generator, unsigned rp, unsigned xp );
 xstate call_prototype( vmachine* vm, lookup_object* prototype, unsigned rp, unsigned xp );
 
 xstate call_return( vmachine* vm, unsigned rp, unsigned xp );
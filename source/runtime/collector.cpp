@@ -15,6 +15,15 @@
 
         GC is not running.
 
+        MINOR COLLECTION
+
+            Minor collections mark and sweep young objects on the mutator
+            thread while the GC thread waits.  Young objects are marked using
+            the colour of dead objects.  No live object has this colour, but
+            dead old objects in arenas left unswept by a lazy sweep may.
+            Minor marking only tests and recolours young objects, so it never
+            confuses them with young marks.
+
     DURING MARK PHASE
 
         Handshake ensures both threads start with the same view of memory.
@@ -74,6 +83,18 @@
 
             Any weak references to this object must be coloured.
 
+        MARK OF OBJECT (HELPER MARK THREADS)
+
+            lock W
+            move grey objects between mark stacks
+            unlock W
+
+            Helper threads mark objects exactly as the GC thread does.  Two
+            markers can both see an object as white, and both push it.  Like a
+            re-mark by the mutator, this just duplicates work.  Grey objects
+            are handed between markers under a lock, which orders the
+            colouring of an object before another marker processes it.
+
         MARK OF COTHREAD (GC THREAD)
 
             lock
@@ -84,7 +105,7 @@
             When the GC thread starts to mark a cothread, it must lock the
             cothread until it's visited all references on the stack.  We have
             to prevent the mutator from using the cothread (particularly,
-            resizing it) while we are marking.
+            overwriting stack slots) while we are marking.
 
         MARK OF COTHREAD (MUTATOR THREAD)
 
@@ -104,35 +125,54 @@
 
         OBJECT CONSTRUCTION
 
-            lock H
+            try lock A, for each arena A until one succeeds
             construct object
-            unlock H
+            unlock A
 
-            During sweeping, we must lock to serialize access to the heap.
+            During sweeping, we must lock to serialize access to the arena.
+            The mutator prefers an arena that no sweeper holds.
 
-        SWEEPING
+        SWEEPING (GC THREAD/HELPER THREADS)
 
+            claim arena A : CAS unswept -> sweeping
             while true
-                lock H
+                lock A
                 next/free heap
-                unlock H
+                unlock A
                 check if object must be swept
+            mark arena A swept
+
+            Each arena is swept by exactly one sweeper.  Must lock to serialize
+            access to the arena's heap.
+
+        LAZY SWEEPING (MUTATOR THREAD)
+
+            lock A
+            claim arena A : CAS unswept -> sweeping
+            sweep arena A
+            unlock A
 
-            Must lock to serialize access to the heap.
+            In lazy mode, the mutator sweeps an arena before allocating from
+            it.  This can also happen after the sweep phase has ended.  Any
+            unswept arenas are swept before the next mark phase starts.
 */
 
 #include "collector.h"
+#include <atomic>
 #include <thread>
 #include <condition_variable>
 #include "vmachine.h"
 #include "call_stack.h"
 #include "heap.h"
+#include "heap_snapshot.h"
 #include "tick.h"
 #include "objects/array_object.h"
 #include "objects/cothread_object.h"
+#include "objects/function_object.h"
 #include "objects/string_object.h"
 #include "objects/table_object.h"
 #include "objects/u64val_object.h"
+#include "objects/typed_array_object.h"
 
 namespace kf
 {
@@ -141,18 +181,62 @@ static void safepoint_handshake( vmachine* vm );
 static void safepoint_start_mark( vmachine* vm );
 static void safepoint_start_sweep( vmachine* vm );
 static void safepoint_new_epoch( vmachine* vm );
+static void update_countdown( vmachine* vm );
+static bool step_expired( uint64_t step_start, uint64_t budget_ns );
+static bool step_pending_sweep( vmachine* vm, uint64_t step_start, uint64_t budget_ns );
+static void minor_collection( vmachine* vm );
+static void clear_remembered( nursery_space* n );
+template < typename F > static void sweep_weak_tables( vmachine* vm, F is_dead );
+
+struct mark_worker;
+
+enum gc_trigger
+{
+    GC_TRIGGER_GROWTH,
+    GC_TRIGGER_MIN_TRIGGER,
+    GC_TRIGGER_SOFT_LIMIT,
+};
+
+enum gc_round_kind
+{
+    GC_ROUND_MARK,
+    GC_ROUND_SWEEP,
+};
 
 static void gc_thread( vmachine* vm );
 static void gc_mark( vmachine* vm );
-static void gc_mark_value( collector* gc, value v );
-static void gc_mark_object_ref( collector* gc, object* o );
-static void gc_mark_string_ref( collector* gc, string_object* s );
-static void gc_mark_cothread( collector* gc, vmachine* vm, cothread_object* cothread );
+static void gc_resize_workers( collector* gc, size_t count );
+static void gc_start_helpers( vmachine* vm );
+static void gc_stop_helpers( collector* gc );
+static void gc_helper_thread( vmachine* vm, mark_worker* w, uint64_t round );
+static void gc_start_round( collector* gc, gc_round_kind kind );
+static void gc_wait_round( collector* gc );
+static void gc_mark_work( vmachine* vm, mark_worker* w );
+static void gc_mark_share( mark_worker* w );
+static bool gc_mark_steal( collector* gc, mark_worker* w );
+static void gc_mark_object( vmachine* vm, mark_worker* w, object* o );
+static bool gc_is_white( mark_worker* w, object* o );
+static void gc_mark_old( vmachine* vm, mark_worker* w, object* o );
+static void gc_mark_value( mark_worker* w, value v );
+static void gc_mark_object_ref( mark_worker* w, object* o );
+static void gc_mark_string_ref( mark_worker* w, string_object* s );
+static void gc_mark_cothread( mark_worker* w, vmachine* vm, cothread_object* cothread );
 static void gc_sweep( vmachine* vm );
-static void gc_destroy( object* o );
+static void gc_sweep_work( vmachine* vm, size_t index );
+static void gc_sweep_arena( vmachine* vm, heap_arena* arena, bool locked );
+static void gc_finish_sweep( vmachine* vm );
+static void gc_sweep_blocks( vmachine* vm );
+static void gc_sweep_large( vmachine* vm );
+static void gc_destroy( vmachine* vm, object* o );
+
+static void report_statistics( vmachine* vm );
 
 static void sweep_entire_heap( vmachine* vm );
 
+struct snapshot_writer;
+static void snapshot_object( vmachine* vm, snapshot_writer* sw, object* o );
+static std::string_view snapshot_label( vmachine* vm, object* o );
+
 enum gc_state
 {
     GC_STATE_WAIT,
@@ -163,6 +247,38 @@ enum gc_state
     GC_STATE_QUIT,
 };
 
+/*
+    Each marking thread has a private mark stack.  Periodically, if another
+    worker is idle, some work is moved to a shared list, protected by a lock,
+    where it can be stolen.  Marking is complete when every worker is idle.
+*/
+
+const unsigned MARK_SHARE_INTERVAL = 256;
+const size_t MARK_SHARE_BATCH = 64;
+
+struct mark_worker
+{
+    collector* gc;
+    size_t index;
+
+    // Colours for this marking.  A minor collection only marks young objects.
+    gc_color white_color;
+    gc_color black_color;
+    nursery_space* young;
+
+    // Private mark stack.
+    segment_list< object* > mark_list;
+
+    // Work shared with other workers.
+    std::mutex steal_mutex;
+    std::vector< object* > steal_list;
+    std::atomic< size_t > steal_count;
+
+    // Helper thread, if this is not the GC thread's worker.  Helper threads
+    // also sweep arenas during the sweep phase.
+    std::thread thread;
+};
+
 struct collector
 {
     collector();
@@ -172,37 +288,123 @@ struct collector
     std::mutex work_mutex;
     std::condition_variable work_wait;
 
-    // Mark list.
-    segment_list< object* > mark_list;
+    // Mark workers.  The first worker marks on the GC thread itself.
+    std::vector< mark_worker* > workers;
+    std::atomic< unsigned > idle_count;
+
+    // Minor collections mark on the mutator thread.
+    mark_worker minor_worker;
+
+    // Synchronization with helper threads.
+    std::mutex round_mutex;
+    std::condition_variable round_wait;
+    std::condition_variable round_done_wait;
+    gc_round_kind round_kind;
+    uint64_t round;
+    size_t round_running;
+    bool round_quit;
 
     // State.
     gc_state state;
     gc_color white_color; // objects this colour are unmarked
     gc_color black_color; // object and all refs have been processed by marker.
     bool print_stats;
+    bool lazy_sweep; // copied from tuning as each collection starts.
+    bool sweep_pending;
 
-    // Sweep state.
+    // Sweep state.  Sweepers accumulate results under the sweep mutex.
+    std::mutex sweep_mutex;
     size_t heap_size;
+    size_t swept_heap_size;
+
+    // Free chunks of at least release_size bytes, which stay free for
+    // release_idle sweeps, are returned to the system.  Copied from tuning
+    // as each collection starts.
+    size_t release_size;
+    unsigned release_idle;
+    size_t released_bytes;
+
+    // Retired nursery blocks, owned by the GC thread while sweeping.
+    std::vector< uint32_t > sweep_blocks;
+    std::vector< uint32_t > free_blocks;
+
+    // Pacing.  The trigger is the reason for the current countdown.
+    gc_tuning tuning;
+    gc_trigger trigger;
+    gc_triggers triggers;
+    size_t countdown_start;
 
     // GC thread.
     std::thread thread;
 
-    // Statistics.
+    // Statistics.  The report is a copy of the statistics for the most
+    // recently completed collection.
     collector_statistics statistics;
+    collector_statistics report;
+    size_t collection_count;
+    size_t minor_total;
+    uint64_t tick_total_pause;
 };
 
 collector::collector()
-    :   state( GC_STATE_WAIT )
+    :   idle_count( 0 )
+    ,   round_kind( GC_ROUND_MARK )
+    ,   round( 0 )
+    ,   round_running( 0 )
+    ,   round_quit( false )
+    ,   state( GC_STATE_WAIT )
     ,   white_color( GC_COLOR_ORANGE )
     ,   black_color( GC_COLOR_PURPLE )
     ,   print_stats( getenv( "KENAF_GC_PRINT_STATS" ) != nullptr )
+    ,   lazy_sweep( false )
+    ,   sweep_pending( false )
     ,   heap_size( 0 )
+    ,   swept_heap_size( 0 )
+    ,   release_size( GC_DEFAULT_RELEASE_SIZE )
+    ,   release_idle( GC_DEFAULT_RELEASE_IDLE )
+    ,   released_bytes( 0 )
+    ,   tuning{ GC_DEFAULT_GROWTH, GC_DEFAULT_MIN_TRIGGER, 0, 0, COTHREAD_POOL_DEFAULT_LIMIT, 1, false, GC_DEFAULT_RELEASE_SIZE, GC_DEFAULT_RELEASE_IDLE }
+    ,   trigger( GC_TRIGGER_MIN_TRIGGER )
+    ,   triggers{}
+    ,   countdown_start( GC_DEFAULT_MIN_TRIGGER )
     ,   statistics{}
+    ,   report{}
+    ,   collection_count( 0 )
+    ,   minor_total( 0 )
+    ,   tick_total_pause( 0 )
 {
+    if ( const char* threads = getenv( "KENAF_GC_THREADS" ) )
+    {
+        tuning.threads = std::max< unsigned >( strtoul( threads, nullptr, 10 ), 1 );
+    }
+
+    tuning.lazy_sweep = getenv( "KENAF_GC_LAZY_SWEEP" ) != nullptr;
+    lazy_sweep = tuning.lazy_sweep;
+
+    if ( const char* size = getenv( "KENAF_GC_RELEASE_SIZE" ) )
+    {
+        tuning.release_size = strtoul( size, nullptr, 10 );
+    }
+    if ( const char* idle = getenv( "KENAF_GC_RELEASE_IDLE" ) )
+    {
+        tuning.release_idle = strtoul( idle, nullptr, 10 );
+    }
+    release_size = tuning.release_size;
+    release_idle = tuning.release_idle;
+
+    gc_resize_workers( this, tuning.threads );
+
+    minor_worker.gc = this;
+    minor_worker.index = 0;
+    minor_worker.young = nullptr;
 }
 
 collector::~collector()
 {
+    for ( mark_worker* w : workers )
+    {
+        delete w;
+    }
 }
 
 collector* collector_create()
@@ -216,9 +418,73 @@ void collector_destroy( collector* c )
     delete c;
 }
 
+heap_arena* heap_arena_create( unsigned heap_flags )
+{
+    heap_arena* arena = new heap_arena();
+    arena->heap = heap_create( heap_flags );
+    arena->state = ARENA_SWEPT;
+    return arena;
+}
+
+void heap_arena_destroy( heap_arena* arena )
+{
+    heap_destroy( arena->heap );
+    delete arena;
+}
+
+heap_arena* acquire_arena( vmachine* vm, size_t size, std::unique_lock< std::mutex >& lock )
+{
+    // Spread allocations across arenas, so that they can be swept in parallel.
+    size_t arena_count = vm->arenas.size();
+    if ( vm->arena_countdown < size )
+    {
+        vm->arena_index = ( vm->arena_index + 1 ) % arena_count;
+        vm->arena_countdown = HEAP_ARENA_STRIDE;
+    }
+    vm->arena_countdown -= std::min< size_t >( vm->arena_countdown, size );
+
+    // Outside the sweep phase, swept arenas belong to the mutator.
+    heap_arena* arena = vm->arenas[ vm->arena_index ];
+    if ( vm->phase != GC_PHASE_SWEEP && arena->state.load( std::memory_order_relaxed ) == ARENA_SWEPT )
+    {
+        return arena;
+    }
+
+    // Lock an arena that no sweeper is holding, or wait for this one.
+    uint64_t pause_start = tick();
+    for ( size_t i = 0; i < arena_count; ++i )
+    {
+        size_t index = ( vm->arena_index + i ) % arena_count;
+        std::unique_lock try_lock( vm->arenas[ index ]->mutex, std::try_to_lock );
+        if ( try_lock.owns_lock() )
+        {
+            vm->arena_index = index;
+            arena = vm->arenas[ index ];
+            lock = std::move( try_lock );
+            break;
+        }
+    }
+    if ( ! lock.owns_lock() )
+    {
+        lock = std::unique_lock( arena->mutex );
+    }
+
+    // In lazy mode, sweep the arena before allocating from it.
+    uint8_t unswept = ARENA_UNSWEPT;
+    if ( vm->gc->lazy_sweep && arena->state.compare_exchange_strong( unswept, ARENA_SWEEPING ) )
+    {
+        gc_sweep_arena( vm, arena, true );
+    }
+
+    add_heap_pause( vm->gc, tick() - pause_start );
+    return arena;
+}
+
 void start_collector( vmachine* vm )
 {
-    vm->gc->thread = std::thread( gc_thread, vm );
+    collector* gc = vm->gc;
+    gc->thread = std::thread( gc_thread, vm );
+    gc_start_helpers( vm );
 }
 
 void stop_collector( vmachine* vm )
@@ -235,6 +501,7 @@ void stop_collector( vmachine* vm )
         gc->work_wait.notify_all();
     }
     gc->thread.join();
+    gc_stop_helpers( gc );
 
     // Sweep entire heap to destroy live objects.
     sweep_entire_heap( vm );
@@ -250,9 +517,48 @@ void add_heap_pause( collector* c, uint64_t tick )
     c->statistics.tick_heap_pause += tick;
 }
 
+gc_tuning get_tuning( vmachine* vm )
+{
+    gc_tuning tuning = vm->gc->tuning;
+    tuning.cothread_pool_limit = vm->pool->limit.load( std::memory_order_relaxed );
+    return tuning;
+}
+
+void set_tuning( vmachine* vm, const gc_tuning& tuning )
+{
+    if ( !( tuning.growth >= 0.0 ) )
+    {
+        raise_error( ERROR_INVALID, "invalid GC growth factor" );
+    }
+    if ( tuning.threads < 1 )
+    {
+        raise_error( ERROR_INVALID, "invalid GC thread count" );
+    }
+
+    cothread_pool_set_limit( vm->pool, tuning.cothread_pool_limit );
+
+    // Recalculate countdown now if no collection is in progress.
+    vm->gc->tuning = tuning;
+    if ( vm->phase == GC_PHASE_NONE )
+    {
+        update_countdown( vm );
+    }
+}
+
+gc_triggers get_triggers( collector* c )
+{
+    return c->triggers;
+}
+
+void heap_limit_exceeded( vmachine* vm, size_t size )
+{
+    vm->gc->triggers.hard_limit += 1;
+    raise_error( ERROR_MEMORY, "heap limit exceeded allocating %zu bytes", size );
+}
+
 void safepoint( vmachine* vm )
 {
-    if ( vm->countdown > 0 )
+    if ( ! safepoint_due( vm ) )
     {
         return;
     }
@@ -260,7 +566,21 @@ void safepoint( vmachine* vm )
     if ( vm->phase == GC_PHASE_NONE )
     {
         std::lock_guard lock( vm->gc->work_mutex );
-        safepoint_start_mark( vm );
+        if ( vm->nursery.countdown == 0 )
+        {
+            minor_collection( vm );
+        }
+        if ( vm->countdown == 0 )
+        {
+            gc_triggers* triggers = &vm->gc->triggers;
+            switch ( vm->gc->trigger )
+            {
+            case GC_TRIGGER_GROWTH: triggers->growth += 1; break;
+            case GC_TRIGGER_MIN_TRIGGER: triggers->min_trigger += 1; break;
+            case GC_TRIGGER_SOFT_LIMIT: triggers->soft_limit += 1; break;
+            }
+            safepoint_start_mark( vm );
+        }
         return;
     }
 
@@ -291,9 +611,109 @@ void wait_for_collection( vmachine* vm )
     }
 }
 
+bool step_collection( vmachine* vm, uint64_t budget_ns )
+{
+    collector* gc = vm->gc;
+    uint64_t step_start = tick();
+
+    // Finish sweeping left over from the last collection.
+    if ( ! step_pending_sweep( vm, step_start, budget_ns ) )
+    {
+        return false;
+    }
+
+    // Do work that is due soon.
+    if ( vm->phase == GC_PHASE_NONE )
+    {
+        std::lock_guard lock( gc->work_mutex );
+        nursery_space* n = &vm->nursery;
+        if ( n->size && n->countdown < n->size / 2 )
+        {
+            minor_collection( vm );
+        }
+        if ( vm->countdown < gc->countdown_start / 2 )
+        {
+            gc->triggers.step += 1;
+            safepoint_start_mark( vm );
+        }
+    }
+
+    // Advance the collection until it's done or we run out of time.
+    while ( vm->phase != GC_PHASE_NONE && ! step_expired( step_start, budget_ns ) )
+    {
+        // In lazy mode, sweep arenas on this thread.
+        if ( vm->phase == GC_PHASE_SWEEP && gc->lazy_sweep )
+        {
+            bool swept = false;
+            for ( heap_arena* arena : vm->arenas )
+            {
+                uint8_t unswept = ARENA_UNSWEPT;
+                if ( arena->state.compare_exchange_strong( unswept, ARENA_SWEEPING ) )
+                {
+                    gc_sweep_arena( vm, arena, false );
+                    swept = true;
+                    break;
+                }
+            }
+            if ( swept )
+            {
+                continue;
+            }
+        }
+
+        // Handshake if the GC thread is waiting for us, otherwise give it
+        // time to work.
+        {
+            std::unique_lock lock( gc->work_mutex, std::try_to_lock );
+            if ( lock.owns_lock() )
+            {
+                safepoint_handshake( vm );
+            }
+        }
+        std::this_thread::yield();
+    }
+
+    return vm->phase == GC_PHASE_NONE && step_pending_sweep( vm, step_start, budget_ns );
+}
+
+bool step_expired( uint64_t step_start, uint64_t budget_ns )
+{
+    return tick_seconds( tick() - step_start ) * 1e9 >= (double)budget_ns;
+}
+
+bool step_pending_sweep( vmachine* vm, uint64_t step_start, uint64_t budget_ns )
+{
+    collector* gc = vm->gc;
+    if ( vm->phase != GC_PHASE_NONE || ! gc->sweep_pending )
+    {
+        return true;
+    }
+
+    // Sweep one arena at a time.  The GC thread is idle.
+    for ( heap_arena* arena : vm->arenas )
+    {
+        if ( step_expired( step_start, budget_ns ) )
+        {
+            return false;
+        }
+
+        uint8_t unswept = ARENA_UNSWEPT;
+        if ( arena->state.compare_exchange_strong( unswept, ARENA_SWEEPING ) )
+        {
+            gc_sweep_arena( vm, arena, false );
+        }
+    }
+
+    gc_finish_sweep( vm );
+    report_statistics( vm );
+    gc->sweep_pending = false;
+    return true;
+}
+
 void safepoint_handshake( vmachine* vm )
 {
     collector* gc = vm->gc;
+    vm->handshake_pending.store( false, std::memory_order_relaxed );
 
     if ( gc->state == GC_STATE_MARK_DONE )
     {
@@ -302,8 +722,9 @@ void safepoint_handshake( vmachine* vm )
         if ( ! vm->mark_list.empty() )
         {
             // Swap mark lists.
-            assert( gc->mark_list.empty() );
-            gc->mark_list.swap( vm->mark_list );
+            mark_worker* w = gc->workers.front();
+            assert( w->mark_list.empty() );
+            w->mark_list.swap( vm->mark_list );
             assert( vm->mark_list.empty() );
             gc->state = GC_STATE_MARK;
             gc->work_wait.notify_all();
@@ -324,11 +745,38 @@ void safepoint_start_mark( vmachine* vm )
     collector* gc = vm->gc;
     uint64_t pause_start = tick();
 
-    // Reset statistics.
-    gc->statistics = {};
+    // Arenas left unswept by the last collection must be swept before the
+    // colours are swapped.
+    if ( gc->sweep_pending )
+    {
+        gc_finish_sweep( vm );
+        report_statistics( vm );
+        gc->sweep_pending = false;
+    }
 
-    // Initialize phase.
+    // Reset statistics, but keep minor collections since the last report.
+    collector_statistics statistics = {};
+    statistics.tick_minor_pause = gc->statistics.tick_minor_pause;
+    statistics.minor_count = gc->statistics.minor_count;
+    statistics.promoted_bytes = gc->statistics.promoted_bytes;
+    gc->statistics = statistics;
+
+    // Change the number of GC threads between collections, while the
+    // helpers are idle.
     assert( gc->state == GC_STATE_WAIT );
+    if ( gc->workers.size() != gc->tuning.threads )
+    {
+        gc_stop_helpers( gc );
+        gc_resize_workers( gc, gc->tuning.threads );
+        gc_start_helpers( vm );
+    }
+
+    // Sweep parameters can only change once the last sweep is finished.
+    gc->lazy_sweep = gc->tuning.lazy_sweep;
+    gc->release_size = gc->tuning.release_size;
+    gc->release_idle = gc->tuning.release_idle;
+
+    // Initialize phase.
     gc->state = GC_STATE_MARK;
     std::swap( gc->white_color, gc->black_color );
 
@@ -337,38 +785,45 @@ void safepoint_start_mark( vmachine* vm )
     vm->old_color = gc->white_color;
     vm->new_color = gc->black_color;
 
+    for ( mark_worker* w : gc->workers )
+    {
+        w->white_color = gc->white_color;
+        w->black_color = gc->black_color;
+    }
+
     // Add all roots to mark list.
-    assert( gc->mark_list.empty() );
+    mark_worker* w = gc->workers.front();
+    assert( w->mark_list.empty() );
 
-    gc_mark_string_ref( gc, vm->self_key );
+    gc_mark_string_ref( w, vm->self_key );
 
     for ( const auto& root : vm->roots )
     {
         object* o = root.first;
         if ( header( o )->type != STRING_OBJECT )
         {
-            gc_mark_object_ref( gc, o );
+            gc_mark_object_ref( w, o );
         }
         else
         {
-            gc_mark_string_ref( gc, (string_object*)o );
+            gc_mark_string_ref( w, (string_object*)o );
         }
     }
 
     for ( vcontext* c = vm->context_list; c; c = c->next )
     {
-        gc_mark_object_ref( gc, c->global_object );
+        gc_mark_object_ref( w, c->global_object );
         for ( cothread_object* cothread : c->cothread_stack )
         {
-            gc_mark_object_ref( gc, cothread );
+            gc_mark_object_ref( w, cothread );
         }
         if ( c != vm->c )
         {
-            gc_mark_object_ref( gc, c->cothread );
+            gc_mark_object_ref( w, c->cothread );
         }
     }
 
-    gc_mark_cothread( gc, vm, vm->c->cothread );
+    gc_mark_cothread( w, vm, vm->c->cothread );
 
     // Signal GC thread.
     gc->work_wait.notify_all();
@@ -386,6 +841,11 @@ void safepoint_start_sweep( vmachine* vm )
     assert( gc->state == GC_STATE_MARK_DONE );
     gc->state = GC_STATE_SWEEP;
     gc->heap_size = 0;
+    for ( heap_arena* arena : vm->arenas )
+    {
+        assert( arena->state == ARENA_SWEPT );
+        arena->state = ARENA_UNSWEPT;
+    }
 
     assert( vm->phase == GC_PHASE_MARK );
     vm->phase = GC_PHASE_SWEEP;
@@ -394,11 +854,37 @@ void safepoint_start_sweep( vmachine* vm )
     // Get colour for dead objects.
     gc_color dead_color = gc->white_color;
 
+    // Clear references to dead keys and layouts.
+    sweep_weak_tables( vm, [=]( object* o ) { return atomic_load( header( o )->color ) == dead_color; } );
+
+    // Promote all young objects.  Retired blocks are swept by the GC thread.
+    nursery_space* n = &vm->nursery;
+    nursery_close_block( n );
+    for ( uint32_t block : n->young_blocks )
+    {
+        n->block_state[ block ] = NURSERY_BLOCK_RETIRED;
+        n->old_blocks.push_back( block );
+    }
+    n->young_blocks.clear();
+    clear_remembered( n );
+
+    assert( gc->sweep_blocks.empty() && gc->free_blocks.empty() );
+    gc->sweep_blocks.swap( n->old_blocks );
+
+    // Signal GC thread.
+    gc->work_wait.notify_all();
+
+    // Set pause time.
+    gc->statistics.tick_sweep_pause = tick() - pause_start;
+}
+
+template < typename F > void sweep_weak_tables( vmachine* vm, F is_dead )
+{
     // Clear references to dead keys and layouts.
     auto keys_end = vm->keys.end();
     for ( auto i = vm->keys.begin(); i != keys_end; )
     {
-        if ( atomic_load( header( i->second )->color ) == dead_color )
+        if ( is_dead( i->second ) )
         {
             i = vm->keys.erase( i );
         }
@@ -411,7 +897,7 @@ void safepoint_start_sweep( vmachine* vm )
     auto instance_layouts_end = vm->instance_layouts.end();
     for ( auto i = vm->instance_layouts.begin(); i != instance_layouts_end; )
     {
-        if ( atomic_load( header( i->second )->color ) == dead_color )
+        if ( is_dead( i->second ) )
         {
             i = vm->instance_layouts.erase( i );
             continue;
@@ -421,7 +907,7 @@ void safepoint_start_sweep( vmachine* vm )
         layout_object* layout = i->second;
         while ( layout_object* next = layout->next )
         {
-            if ( atomic_load( header( next )->color ) == dead_color )
+            if ( is_dead( next ) )
             {
                 layout->next = nullptr;
                 break;
@@ -435,7 +921,7 @@ void safepoint_start_sweep( vmachine* vm )
     auto splitkey_layouts_end = vm->splitkey_layouts.end();
     for ( auto i = vm->splitkey_layouts.begin(); i != splitkey_layouts_end; )
     {
-        if ( atomic_load( header( i->second )->color ) == dead_color )
+        if ( is_dead( i->second ) )
         {
             i = vm->splitkey_layouts.erase( i );
             continue;
@@ -445,7 +931,7 @@ void safepoint_start_sweep( vmachine* vm )
         layout_object* layout = i->second;
         while ( layout_object* next = layout->next )
         {
-            if ( atomic_load( header( next )->color ) == dead_color )
+            if ( is_dead( next ) )
             {
                 layout->next = nullptr;
                 break;
@@ -460,7 +946,7 @@ void safepoint_start_sweep( vmachine* vm )
     auto u64vals_end = vm->u64vals.end();
     for ( auto i = vm->u64vals.begin(); i != u64vals_end; )
     {
-        if ( atomic_load( header( i->second )->color ) == dead_color )
+        if ( is_dead( i->second ) )
         {
             i = vm->u64vals.erase( i );
         }
@@ -469,12 +955,6 @@ void safepoint_start_sweep( vmachine* vm )
             ++i;
         }
     }
-
-    // Signal GC thread.
-    gc->work_wait.notify_all();
-
-    // Set pause time.
-    gc->statistics.tick_sweep_pause = tick() - pause_start;
 }
 
 #ifdef _MSC_VER
@@ -492,7 +972,11 @@ const char* const TYPE_NAMES[ TYPE_COUNT ] =
     INIT( FUNCTION_OBJECT           ) "function",
     INIT( NATIVE_FUNCTION_OBJECT    ) "fnative",
     INIT( COTHREAD_OBJECT           ) "cothread",
+    INIT( GENERATOR_OBJECT          ) "generator",
     INIT( U64VAL_OBJECT             ) "u64val",
+    INIT( F64ARRAY_OBJECT           ) "f64array",
+    INIT( I32ARRAY_OBJECT           ) "i32array",
+    INIT( U8ARRAY_OBJECT            ) "u8array",
     INIT( NUMBER_OBJECT             ) nullptr,
     INIT( BOOL_OBJECT               ) nullptr,
     INIT( NULL_OBJECT               ) nullptr,
@@ -503,11 +987,9 @@ const char* const TYPE_NAMES[ TYPE_COUNT ] =
     INIT( SCRIPT_OBJECT             ) "script",
 };
 
-void safepoint_new_epoch( vmachine* vm )
+void report_statistics( vmachine* vm )
 {
     collector* gc = vm->gc;
-
-    // Report statistics.
     if ( gc->print_stats )
     {
         const collector_statistics& stats = gc->statistics;
@@ -516,6 +998,7 @@ void safepoint_new_epoch( vmachine* vm )
         printf( "    stack : %f\n", tick_seconds( stats.tick_stack_pause ) );
         printf( "    sweep : %f\n", tick_seconds( stats.tick_sweep_pause ) );
         printf( "    heap  : %f\n", tick_seconds( stats.tick_heap_pause ) );
+        printf( "    minor : %f (%zu collections, %zu bytes promoted)\n", tick_seconds( stats.tick_minor_pause ), stats.minor_count, stats.promoted_bytes );
         printf( "    swept :\n" );
         for ( size_t i = 0; i < TYPE_COUNT; ++i )
         {
@@ -532,182 +1015,829 @@ void safepoint_new_epoch( vmachine* vm )
         }
     }
 
-    // Update phase and allocation countdown.
-    assert( gc->state == GC_STATE_SWEEP_DONE );
-    gc->state = GC_STATE_WAIT;
+    // Keep report.
+    const collector_statistics& stats = gc->statistics;
+    gc->report = stats;
+    gc->collection_count += 1;
+    gc->tick_total_pause += stats.tick_mark_pause + stats.tick_stack_pause + stats.tick_sweep_pause + stats.tick_heap_pause;
 
-    assert( vm->phase == GC_PHASE_SWEEP );
-    vm->phase = GC_PHASE_NONE;
-    vm->countdown = std::min< size_t >( std::max< size_t >( gc->heap_size / 2, 512 * 1024 ), UINT_MAX );
+    // Minor collections are counted from one report to the next.
+    gc->statistics.tick_minor_pause = 0;
+    gc->statistics.minor_count = 0;
+    gc->statistics.promoted_bytes = 0;
 }
 
-void gc_thread( vmachine* vm )
+void get_statistics( vmachine* vm, gc_statistics* statistics )
 {
     collector* gc = vm->gc;
-    std::unique_lock lock( gc->work_mutex );
-    while ( true )
+    const collector_statistics& stats = gc->report;
+
+    statistics->collections = gc->collection_count;
+    statistics->minor_collections = gc->minor_total;
+    statistics->total_pause = tick_seconds( gc->tick_total_pause );
+
+    statistics->mark_pause = tick_seconds( stats.tick_mark_pause );
+    statistics->stack_pause = tick_seconds( stats.tick_stack_pause );
+    statistics->sweep_pause = tick_seconds( stats.tick_sweep_pause );
+    statistics->heap_pause = tick_seconds( stats.tick_heap_pause );
+    statistics->mark_time = tick_seconds( stats.tick_mark );
+    statistics->sweep_time = tick_seconds( stats.tick_sweep );
+    for ( size_t i = 0; i < TYPE_COUNT; ++i )
     {
-        while ( gc->state == GC_STATE_WAIT || gc->state == GC_STATE_MARK_DONE || gc->state == GC_STATE_SWEEP_DONE )
-        {
-            gc->work_wait.wait( lock );
-        }
-        if ( gc->state == GC_STATE_MARK )
-        {
-            gc_mark( vm );
-        }
-        else if ( gc->state == GC_STATE_SWEEP )
-        {
-            gc_sweep( vm );
-        }
-        else if ( gc->state == GC_STATE_QUIT )
+        statistics->alive_bytes += stats.alive_bytes[ i ];
+        statistics->swept_bytes += stats.swept_bytes[ i ];
+    }
+
+    statistics->minor_count = stats.minor_count;
+    statistics->minor_pause = tick_seconds( stats.tick_minor_pause );
+    statistics->promoted_bytes = stats.promoted_bytes;
+
+    // Walk each arena's heap, waiting for it if it's being swept.
+    heap_info info = {};
+    for ( heap_arena* arena : vm->arenas )
+    {
+        std::lock_guard lock( arena->mutex );
+        heap_statistics( arena->heap, &info );
+    }
+
+    statistics->heap_segments = info.segment_count;
+    statistics->heap_reserved = info.segment_bytes;
+    statistics->heap_resident = info.resident_bytes;
+    statistics->heap_allocated = info.allocated_bytes;
+    statistics->heap_free = info.free_bytes;
+    statistics->heap_largest_free = info.largest_free;
+    statistics->nursery_committed = vm->nursery.next_block * NURSERY_BLOCK_SIZE;
+    statistics->external_bytes = vm->external_size.load( std::memory_order_relaxed );
+
+    {
+        std::lock_guard lock( vm->large.mutex );
+        statistics->large_objects = vm->large.count;
+        statistics->large_mapped = vm->large.mapped;
+    }
+
+    std::lock_guard lock( gc->sweep_mutex );
+    statistics->heap_released = gc->released_bytes;
+}
+
+size_t get_type_statistics( collector* gc, gc_type_statistics* types, size_t count )
+{
+    const collector_statistics& stats = gc->report;
+    size_t index = 0;
+    for ( size_t i = 0; i < TYPE_COUNT; ++i )
+    {
+        const char* name = TYPE_NAMES[ i ];
+        if ( ! name ) continue;
+        if ( index < count )
         {
-            break;
+            types[ index ] = { name, stats.alive_count[ i ], stats.alive_bytes[ i ], stats.swept_count[ i ], stats.swept_bytes[ i ] };
         }
+        index += 1;
     }
+    return index;
 }
 
-void gc_mark( vmachine* vm )
+void safepoint_new_epoch( vmachine* vm )
 {
     collector* gc = vm->gc;
-    assert( gc->state == GC_STATE_MARK );
 
-    gc_color black_color = gc->black_color;
+    // Report statistics.  In lazy mode, sweeping isn't finished yet.
+    if ( ! gc->lazy_sweep )
+    {
+        gc->swept_heap_size = gc->heap_size;
+        report_statistics( vm );
+    }
+    else
+    {
+        gc->sweep_pending = true;
+    }
 
-    // Mark until work list is empty.
-    while ( ! gc->mark_list.empty() )
+    // Return swept nursery blocks.
+    nursery_space* n = &vm->nursery;
+    for ( uint32_t block : gc->free_blocks )
     {
-        object* o = gc->mark_list.back();
-        gc->mark_list.pop_back();
+        n->block_state[ block ] = NURSERY_BLOCK_FREE;
+        n->free_blocks.push_back( block );
+    }
+    n->old_blocks.insert( n->old_blocks.end(), gc->sweep_blocks.begin(), gc->sweep_blocks.end() );
+    gc->free_blocks.clear();
+    gc->sweep_blocks.clear();
 
-        switch ( header( o )->type )
-        {
-        case LOOKUP_OBJECT:
-        {
-            lookup_object* lookup = (lookup_object*)o;
-            gc_mark_object_ref( gc, atomic_consume( lookup->oslots ) );
-            gc_mark_object_ref( gc, atomic_consume( lookup->layout ) );
-            break;
-        }
+    // Update phase and allocation countdown.
+    assert( gc->state == GC_STATE_SWEEP_DONE );
+    gc->state = GC_STATE_WAIT;
 
-        case STRING_OBJECT:
-        {
-            assert( ! "string object should not be on mark list" );
-            break;
-        }
+    assert( vm->phase == GC_PHASE_SWEEP );
+    vm->phase = GC_PHASE_NONE;
+    update_countdown( vm );
+}
 
-        case ARRAY_OBJECT:
-        {
-            array_object* array = (array_object*)o;
-            gc_mark_object_ref( gc, atomic_consume( array->aslots ) );
-            break;
-        }
+void update_countdown( vmachine* vm )
+{
+    collector* gc = vm->gc;
+    const gc_tuning& tuning = gc->tuning;
+    size_t heap_size = gc->swept_heap_size;
 
-        case TABLE_OBJECT:
-        {
-            table_object* table = (table_object*)o;
-            gc_mark_object_ref( gc, atomic_consume( table->kvslots ) );
-            break;
-        }
+    // External memory is paced along with the heap, but the hard limit only
+    // applies to the heap itself.
+    size_t paced_size = heap_size + vm->external_size.load( std::memory_order_relaxed );
 
-        case FUNCTION_OBJECT:
-        {
-            function_object* function = (function_object*)o;
-            gc_mark_object_ref( gc, atomic_consume( function->program ) );
-            gc_mark_object_ref( gc, atomic_consume( function->omethod ) );
-            size_t count = ( heap_malloc_size( function ) - offsetof( function_object, outenvs ) ) / sizeof( ref< vslots_object > );
-            for ( size_t i = 0; i < count; ++i )
+    // Allow the heap to grow in proportion to its size.
+    size_t countdown = (size_t)std::min( paced_size * tuning.growth, (double)SIZE_MAX );
+    gc->trigger = GC_TRIGGER_GROWTH;
+    if ( countdown < tuning.min_trigger )
+    {
+        countdown = tuning.min_trigger;
+        gc->trigger = GC_TRIGGER_MIN_TRIGGER;
+    }
+
+    // Start collecting halfway to the soft limit, to leave room for the
+    // allocations made while collecting.  Without a soft limit, pace
+    // collections using the hard limit instead.
+    size_t soft_limit = tuning.soft_limit ? tuning.soft_limit : tuning.hard_limit;
+    if ( soft_limit )
+    {
+        size_t headroom = soft_limit > paced_size ? ( soft_limit - paced_size ) / 2 : 0;
+        headroom = std::max( headroom, GC_SOFT_LIMIT_MIN_TRIGGER );
+        if ( headroom < countdown )
+        {
+            countdown = headroom;
+            gc->trigger = GC_TRIGGER_SOFT_LIMIT;
+        }
+    }
+
+    vm->countdown = std::min< size_t >( countdown, UINT_MAX );
+    gc->countdown_start = vm->countdown;
+    vm->limit_countdown = tuning.hard_limit ? tuning.hard_limit - std::min( tuning.hard_limit, heap_size ) : SIZE_MAX;
+}
+
+void minor_collection( vmachine* vm )
+{
+    collector* gc = vm->gc;
+    nursery_space* n = &vm->nursery;
+    uint64_t pause_start = tick();
+
+    assert( vm->phase == GC_PHASE_NONE );
+    assert( gc->state == GC_STATE_WAIT );
+
+    // Outside a collection, no live object has the colour used for dead
+    // objects, so young objects can use it as their mark colour.  Dead old
+    // objects still awaiting a lazy sweep may have it, but gc_is_white and
+    // gc_mark_old only test and recolour young objects.
+    mark_worker* w = &gc->minor_worker;
+    w->white_color = vm->new_color;
+    w->black_color = gc->white_color;
+    w->young = n;
+    assert( w->white_color != w->black_color );
+    assert( w->mark_list.empty() );
+
+    nursery_close_block( n );
+
+    // Mark young objects reachable from roots.
+    gc_mark_string_ref( w, vm->self_key );
+
+    for ( const auto& root : vm->roots )
+    {
+        object* o = root.first;
+        if ( header( o )->type != STRING_OBJECT )
+        {
+            gc_mark_object_ref( w, o );
+        }
+        else
+        {
+            gc_mark_string_ref( w, (string_object*)o );
+        }
+    }
+
+    for ( vcontext* c = vm->context_list; c; c = c->next )
+    {
+        gc_mark_object_ref( w, c->global_object );
+        for ( cothread_object* cothread : c->cothread_stack )
+        {
+            gc_mark_old( vm, w, cothread );
+        }
+        gc_mark_old( vm, w, c->cothread );
+    }
+
+    // Mark young objects reachable from the remembered set.
+    for ( atomic_u64* slot : n->remembered_values )
+    {
+        gc_mark_value( w, { atomic_load( *slot ) } );
+    }
+
+    for ( ref< object >* slot : n->remembered_refs )
+    {
+        object* o = atomic_load( *slot );
+        if ( o && header( o )->type != STRING_OBJECT )
+        {
+            gc_mark_object_ref( w, o );
+        }
+        else
+        {
+            gc_mark_string_ref( w, (string_object*)o );
+        }
+    }
+
+    for ( object* o : n->remembered_objects )
+    {
+        gc_mark_old( vm, w, o );
+    }
+
+    clear_remembered( n );
+
+    // Mark.
+    while ( ! w->mark_list.empty() )
+    {
+        object* o = w->mark_list.back();
+        w->mark_list.pop_back();
+        gc_mark_object( vm, w, o );
+    }
+
+    // Clear references to dead young keys and layouts.
+    sweep_weak_tables( vm, [=]( object* o ) { return gc_is_white( w, o ); } );
+
+    // Sweep young blocks.  Blocks with survivors are retired.
+    size_t promoted_bytes = 0;
+    for ( uint32_t block : n->young_blocks )
+    {
+        bool retire = false;
+        char* end = nursery_block_end( n, block );
+        for ( char* chunk = nursery_block_begin( n, block ); chunk < end; )
+        {
+            object* o = (object*)( chunk + sizeof( uint64_t ) );
+            size_t size = heap_malloc_size( o );
+            chunk += size + sizeof( uint64_t );
+
+            gc_color color = (gc_color)atomic_load( header( o )->color );
+            if ( color == w->black_color )
             {
-                gc_mark_object_ref( gc, atomic_consume( function->outenvs[ i ] ) );
+                atomic_store( header( o )->color, vm->new_color );
+                promoted_bytes += size;
+                retire = true;
             }
+            else
+            {
+                assert( color == w->white_color );
+                gc_destroy( vm, o );
+                atomic_store( header( o )->color, GC_COLOR_NONE );
+            }
+        }
+
+        if ( retire )
+        {
+            n->block_state[ block ] = NURSERY_BLOCK_RETIRED;
+            n->old_blocks.push_back( block );
+        }
+        else
+        {
+            n->block_state[ block ] = NURSERY_BLOCK_FREE;
+            n->free_blocks.push_back( block );
+        }
+    }
+    n->young_blocks.clear();
+    w->young = nullptr;
+
+    // Promoted objects count towards the next full collection.
+    n->countdown = n->size;
+    vm->countdown -= std::min< size_t >( vm->countdown, promoted_bytes );
+    vm->limit_countdown -= std::min( vm->limit_countdown, promoted_bytes );
+
+    uint64_t pause = tick() - pause_start;
+    gc->statistics.minor_count += 1;
+    gc->statistics.promoted_bytes += promoted_bytes;
+    gc->statistics.tick_minor_pause += pause;
+    gc->minor_total += 1;
+    gc->tick_total_pause += pause;
+}
+
+void clear_remembered( nursery_space* n )
+{
+    for ( object* o : n->remembered_objects )
+    {
+        header( o )->flags &= ~FLAG_REMEMBERED;
+    }
+    n->remembered_values.clear();
+    n->remembered_refs.clear();
+    n->remembered_objects.clear();
+}
+
+void gc_thread( vmachine* vm )
+{
+    collector* gc = vm->gc;
+    std::unique_lock lock( gc->work_mutex );
+    while ( true )
+    {
+        while ( gc->state == GC_STATE_WAIT || gc->state == GC_STATE_MARK_DONE || gc->state == GC_STATE_SWEEP_DONE )
+        {
+            gc->work_wait.wait( lock );
+        }
+        if ( gc->state == GC_STATE_MARK )
+        {
+            gc_mark( vm );
+        }
+        else if ( gc->state == GC_STATE_SWEEP )
+        {
+            gc_sweep( vm );
+        }
+        else if ( gc->state == GC_STATE_QUIT )
+        {
             break;
         }
+    }
+}
+
+void gc_mark( vmachine* vm )
+{
+    collector* gc = vm->gc;
+    assert( gc->state == GC_STATE_MARK );
+
+    // Start a round of marking on the helper threads.
+    uint64_t mark_start = tick();
+    gc->idle_count = 0;
+    gc_start_round( gc, GC_ROUND_MARK );
+
+    // Mark on this thread until there is no work left anywhere.
+    gc_mark_work( vm, gc->workers.front() );
+
+    // Wait for all helpers to notice that marking is complete.
+    gc_wait_round( gc );
+    gc->statistics.tick_mark = tick() - mark_start;
+
+    gc->state = GC_STATE_MARK_DONE;
+    vm->handshake_pending.store( true, std::memory_order_relaxed );
+}
+
+void gc_start_round( collector* gc, gc_round_kind kind )
+{
+    size_t helper_count = gc->workers.size() - 1;
+    if ( helper_count )
+    {
+        std::lock_guard lock( gc->round_mutex );
+        gc->round_kind = kind;
+        gc->round += 1;
+        gc->round_running = helper_count;
+        gc->round_wait.notify_all();
+    }
+}
+
+void gc_wait_round( collector* gc )
+{
+    std::unique_lock lock( gc->round_mutex );
+    while ( gc->round_running )
+    {
+        gc->round_done_wait.wait( lock );
+    }
+}
+
+void gc_resize_workers( collector* gc, size_t count )
+{
+    // Helper threads must be stopped.
+    while ( gc->workers.size() > count )
+    {
+        delete gc->workers.back();
+        gc->workers.pop_back();
+    }
+    while ( gc->workers.size() < count )
+    {
+        mark_worker* w = new mark_worker();
+        w->gc = gc;
+        w->index = gc->workers.size();
+        w->young = nullptr;
+        gc->workers.push_back( w );
+    }
+}
+
+void gc_start_helpers( vmachine* vm )
+{
+    // The first worker marks on the GC thread itself.
+    collector* gc = vm->gc;
+    uint64_t round;
+    {
+        std::lock_guard lock( gc->round_mutex );
+        gc->round_quit = false;
+        round = gc->round;
+    }
+    for ( size_t i = 1; i < gc->workers.size(); ++i )
+    {
+        gc->workers[ i ]->thread = std::thread( gc_helper_thread, vm, gc->workers[ i ], round );
+    }
+}
+
+void gc_stop_helpers( collector* gc )
+{
+    {
+        std::lock_guard lock( gc->round_mutex );
+        gc->round_quit = true;
+        gc->round_wait.notify_all();
+    }
+    for ( size_t i = 1; i < gc->workers.size(); ++i )
+    {
+        gc->workers[ i ]->thread.join();
+    }
+}
 
-        case NATIVE_FUNCTION_OBJECT:
+void gc_helper_thread( vmachine* vm, mark_worker* w, uint64_t round )
+{
+    collector* gc = vm->gc;
+
+    std::unique_lock lock( gc->round_mutex );
+    while ( true )
+    {
+        while ( gc->round == round && ! gc->round_quit )
+        {
+            gc->round_wait.wait( lock );
+        }
+        if ( gc->round_quit )
         {
             break;
         }
 
-        case COTHREAD_OBJECT:
-        {
-            cothread_object* cothread = (cothread_object*)o;
-            gc_mark_cothread( gc, vm, cothread );
-            break;
-        }
+        round = gc->round;
+        gc_round_kind kind = gc->round_kind;
+        lock.unlock();
+        if ( kind == GC_ROUND_MARK )
+        {
+            gc_mark_work( vm, w );
+        }
+        else
+        {
+            gc_sweep_work( vm, w->index );
+        }
+        lock.lock();
+
+        if ( --gc->round_running == 0 )
+        {
+            gc->round_done_wait.notify_all();
+        }
+    }
+}
+
+void gc_mark_work( vmachine* vm, mark_worker* w )
+{
+    collector* gc = vm->gc;
+    size_t worker_count = gc->workers.size();
+    unsigned share_countdown = MARK_SHARE_INTERVAL;
+
+    while ( true )
+    {
+        // Mark until private mark stack is empty.
+        while ( ! w->mark_list.empty() )
+        {
+            object* o = w->mark_list.back();
+            w->mark_list.pop_back();
+            gc_mark_object( vm, w, o );
+
+            // Periodically make work available to idle workers.
+            if ( --share_countdown == 0 )
+            {
+                share_countdown = MARK_SHARE_INTERVAL;
+                if ( worker_count > 1 && gc->idle_count.load( std::memory_order_relaxed ) && ! w->steal_count.load( std::memory_order_relaxed ) )
+                {
+                    gc_mark_share( w );
+                }
+            }
+        }
+
+        if ( worker_count == 1 )
+        {
+            return;
+        }
+
+        // Look for work shared by this or another worker.
+        if ( gc_mark_steal( gc, w ) )
+        {
+            continue;
+        }
+
+        // Wait until some worker shares work, or every worker is idle.
+        unsigned idle_count = gc->idle_count.fetch_add( 1 ) + 1;
+        while ( true )
+        {
+            if ( idle_count == worker_count )
+            {
+                return;
+            }
+
+            bool has_work = false;
+            for ( mark_worker* victim : gc->workers )
+            {
+                if ( victim->steal_count.load( std::memory_order_relaxed ) )
+                {
+                    has_work = true;
+                    break;
+                }
+            }
+
+            if ( has_work )
+            {
+                gc->idle_count.fetch_sub( 1 );
+                break;
+            }
+
+            std::this_thread::yield();
+            idle_count = gc->idle_count.load();
+        }
+    }
+}
+
+void gc_mark_share( mark_worker* w )
+{
+    // Move some work from the top of the private mark stack, but keep some.
+    std::lock_guard lock( w->steal_mutex );
+    for ( size_t i = 0; i < MARK_SHARE_BATCH && ! w->mark_list.empty(); ++i )
+    {
+        object* o = w->mark_list.back();
+        w->mark_list.pop_back();
+        if ( w->mark_list.empty() )
+        {
+            w->mark_list.push_back( o );
+            break;
+        }
+        w->steal_list.push_back( o );
+    }
+    w->steal_count.store( w->steal_list.size() );
+}
+
+bool gc_mark_steal( collector* gc, mark_worker* w )
+{
+    // Search workers starting from this one, taking half of the shared work.
+    size_t worker_count = gc->workers.size();
+    size_t index = w->index;
+    for ( size_t i = 0; i < worker_count; ++i )
+    {
+        mark_worker* victim = gc->workers[ ( index + i ) % worker_count ];
+        if ( ! victim->steal_count.load( std::memory_order_relaxed ) )
+        {
+            continue;
+        }
+
+        std::lock_guard lock( victim->steal_mutex );
+        size_t count = victim->steal_list.size();
+        size_t steal = victim == w ? count : ( count + 1 ) / 2;
+        for ( size_t j = 0; j < steal; ++j )
+        {
+            w->mark_list.push_back( victim->steal_list.back() );
+            victim->steal_list.pop_back();
+        }
+        victim->steal_count.store( victim->steal_list.size() );
+
+        if ( steal )
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+    Each reference held by an object is passed to the visitor, which has
+    object_ref, string_ref and value_ref methods.  The marker and heap
+    snapshots both walk the object graph this way.  Cothread objects are
+    passed to the visitor's cothread method, as they must be locked before
+    their stacks are visited.
+*/
+
+template < typename V > void visit_references( V& v, object* o )
+{
+    switch ( header( o )->type )
+    {
+    case LOOKUP_OBJECT:
+    {
+        lookup_object* lookup = (lookup_object*)o;
+        v.object_ref( atomic_consume( lookup->oslots ) );
+        v.object_ref( atomic_consume( lookup->layout ) );
+        break;
+    }
+
+    case STRING_OBJECT:
+    {
+        break;
+    }
+
+    case ARRAY_OBJECT:
+    {
+        array_object* array = (array_object*)o;
+        v.object_ref( atomic_consume( array->aslots ) );
+        break;
+    }
+
+    case TABLE_OBJECT:
+    {
+        table_object* table = (table_object*)o;
+        v.object_ref( atomic_consume( table->kvslots ) );
+        v.object_ref( atomic_consume( table->aslots ) );
+        v.object_ref( atomic_consume( table->old_kvslots ) );
+        break;
+    }
+
+    case FUNCTION_OBJECT:
+    {
+        function_object* function = (function_object*)o;
+        v.object_ref( atomic_consume( function->program ) );
+        v.object_ref( atomic_consume( function->omethod ) );
+        size_t count = ( heap_malloc_size( function ) - offsetof( function_object, outenvs ) ) / sizeof( ref< vslots_object > );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            v.object_ref( atomic_consume( function->outenvs[ i ] ) );
+        }
+        break;
+    }
+
+    case NATIVE_FUNCTION_OBJECT:
+    {
+        break;
+    }
+
+    case COTHREAD_OBJECT:
+    {
+        cothread_object* cothread = (cothread_object*)o;
+        v.cothread( cothread );
+        break;
+    }
+
+    case GENERATOR_OBJECT:
+    {
+        generator_object* generator = (generator_object*)o;
+        v.object_ref( atomic_consume( generator->function ) );
+        for ( size_t i = 0; i < generator->size; ++i )
+        {
+            v.value_ref( { atomic_consume( generator->slots[ i ] ) } );
+        }
+        break;
+    }
+
+    case U64VAL_OBJECT:
+    {
+        break;
+    }
+
+    case F64ARRAY_OBJECT:
+    case I32ARRAY_OBJECT:
+    case U8ARRAY_OBJECT:
+    {
+        // Elements are not references.
+        break;
+    }
+
+    case LAYOUT_OBJECT:
+    {
+        layout_object* layout = (layout_object*)o;
+        v.object_ref( atomic_consume( layout->parent ) );
+        v.string_ref( atomic_consume( layout->key ) );
+        break;
+    }
+
+    case VSLOTS_OBJECT:
+    {
+        vslots_object* vslots = (vslots_object*)o;
+        size_t count = heap_malloc_size( vslots ) / sizeof( ref_value );
+        for ( size_t i = 0; i < count; ++i )
+        {
+            v.value_ref( { atomic_consume( vslots->slots[ i ] ) } );
+        }
+        break;
+    }
+
+    case KVSLOTS_OBJECT:
+    {
+        kvslots_object* kvslots = (kvslots_object*)o;
+        size_t count = kvslots->count;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            const kvslot* kv = kvslots->slots + i;
+            v.value_ref( { atomic_consume( kv->k ) } );
+            v.value_ref( { atomic_consume( kv->v ) } );
+        }
+        break;
+    }
+
+    case PROGRAM_OBJECT:
+    {
+        program_object* program = (program_object*)o;
+        v.object_ref( atomic_consume( program->script ) );
+        size_t count = program->constant_count;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            v.value_ref( { atomic_consume( program->constants[ i ] ) } );
+        }
+        count = program->selector_count;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            v.string_ref( atomic_consume( program->selectors[ i ].key ) );
+        }
+        count = program->function_count;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            v.object_ref( atomic_consume( program->functions[ i ] ) );
+        }
+        count = program->msite_count;
+        for ( size_t i = 0; i < count; ++i )
+        {
+            v.object_ref( atomic_consume( program->msites[ i ].callee ) );
+        }
+        break;
+    }
+
+    case SCRIPT_OBJECT:
+    {
+        break;
+    }
+
+    default: break;
+    }
+}
+
+template < typename V > void visit_cothread( V& v, cothread_object* cothread )
+{
+    // Stack references.
+    for ( unsigned i = 0; i < cothread->stack_size; ++i )
+    {
+        v.value_ref( cothread->stack[ i ] );
+    }
+
+    // References to functions and generators in call stack.
+    for ( const stack_frame& frame : cothread->stack_frames )
+    {
+        v.object_ref( frame.function );
+        v.object_ref( frame.generator );
+    }
+}
+
+struct mark_visitor
+{
+    vmachine* vm;
+    mark_worker* w;
 
-        case U64VAL_OBJECT:
-        {
-            break;
-        }
+    void object_ref( object* o ) { gc_mark_object_ref( w, o ); }
+    void string_ref( string_object* s ) { gc_mark_string_ref( w, s ); }
+    void value_ref( value v ) { gc_mark_value( w, v ); }
+    void cothread( cothread_object* cothread ) { gc_mark_cothread( w, vm, cothread ); }
+};
 
-        case LAYOUT_OBJECT:
-        {
-            layout_object* layout = (layout_object*)o;
-            gc_mark_object_ref( gc, atomic_consume( layout->parent ) );
-            gc_mark_string_ref( gc, atomic_consume( layout->key ) );
-            break;
-        }
+struct snapshot_writer
+{
+    FILE* file;
+    std::vector< uint64_t > refs;
 
-        case VSLOTS_OBJECT:
-        {
-            vslots_object* vslots = (vslots_object*)o;
-            size_t count = heap_malloc_size( vslots ) / sizeof( ref_value );
-            for ( size_t i = 0; i < count; ++i )
-            {
-                gc_mark_value( gc, { atomic_consume( vslots->slots[ i ] ) } );
-            }
-            break;
-        }
+    void object_ref( object* o ) { if ( o ) refs.push_back( (uintptr_t)o ); }
+    void string_ref( string_object* s ) { if ( s ) refs.push_back( (uintptr_t)s ); }
+    void value_ref( value v ) { if ( box_is_object_or_string( v ) ) refs.push_back( (uintptr_t)unbox_object_or_string( v ) ); }
+    void cothread( cothread_object* cothread ) { visit_cothread( *this, cothread ); }
 
-        case KVSLOTS_OBJECT:
+    void write( uint64_t u, size_t size )
+    {
+        uint8_t bytes[ 8 ];
+        for ( size_t i = 0; i < size; ++i )
         {
-            kvslots_object* kvslots = (kvslots_object*)o;
-            size_t count = kvslots->count;
-            for ( size_t i = 0; i < count; ++i )
-            {
-                const kvslot* kv = kvslots->slots + i;
-                gc_mark_value( gc, { atomic_consume( kv->k ) } );
-                gc_mark_value( gc, { atomic_consume( kv->v ) } );
-            }
-            break;
+            bytes[ i ] = (uint8_t)( u >> i * 8 );
         }
+        fwrite( bytes, 1, size, file );
+    }
 
-        case PROGRAM_OBJECT:
-        {
-            program_object* program = (program_object*)o;
-            gc_mark_object_ref( gc, atomic_consume( program->script ) );
-            size_t count = program->constant_count;
-            for ( size_t i = 0; i < count; ++i )
-            {
-                gc_mark_value( gc, { atomic_consume( program->constants[ i ] ) } );
-            }
-            count = program->selector_count;
-            for ( size_t i = 0; i < count; ++i )
-            {
-                gc_mark_string_ref( gc, atomic_consume( program->selectors[ i ].key ) );
-            }
-            count = program->function_count;
-            for ( size_t i = 0; i < count; ++i )
-            {
-                gc_mark_object_ref( gc, atomic_consume( program->functions[ i ] ) );
-            }
-            break;
-        }
+    void write_text( std::string_view text )
+    {
+        assert( text.size() <= UINT8_MAX );
+        write( text.size(), 1 );
+        fwrite( text.data(), 1, text.size(), file );
+    }
 
-        case SCRIPT_OBJECT:
-        {
-            break;
-        }
+    void write_root( snapshot_root_kind kind, object* o )
+    {
+        if ( ! o ) return;
+        write( SNAPSHOT_ROOT, 1 );
+        write( kind, 1 );
+        write( (uintptr_t)o, 8 );
+    }
+};
 
-        default: break;
-        }
+void gc_mark_object( vmachine* vm, mark_worker* w, object* o )
+{
+    assert( header( o )->type != STRING_OBJECT );
+    mark_visitor visitor = { vm, w };
+    visit_references( visitor, o );
+    atomic_store( header( o )->color, w->black_color );
+}
+
+bool gc_is_white( mark_worker* w, object* o )
+{
+    return atomic_load( header( o )->color ) == w->white_color && ( ! w->young || nursery_young( w->young, o ) );
+}
 
-        atomic_store( header( o )->color, black_color );
+void gc_mark_old( vmachine* vm, mark_worker* w, object* o )
+{
+    // Old objects are scanned for references to young objects, but during a
+    // minor collection are left with their original colour.
+    if ( nursery_young( w->young, o ) )
+    {
+        gc_mark_object_ref( w, o );
+        return;
     }
 
-    gc->state = GC_STATE_MARK_DONE;
+    gc_mark_object( vm, w, o );
+    atomic_store( header( o )->color, w->white_color );
 }
 
-void gc_mark_value( collector* gc, value v )
+void gc_mark_value( mark_worker* w, value v )
 {
     if ( ! box_is_object_or_string( v ) )
     {
@@ -715,7 +1845,7 @@ void gc_mark_value( collector* gc, value v )
     }
 
     object* o = unbox_object_or_string( v );
-    if ( atomic_load( header( o )->color ) != gc->white_color )
+    if ( ! gc_is_white( w, o ) )
     {
         return;
     }
@@ -723,77 +1853,120 @@ void gc_mark_value( collector* gc, value v )
     if ( box_is_object( v ) )
     {
         atomic_store( header( o )->color, GC_COLOR_MARKED );
-        gc->mark_list.push_back( o );
+        w->mark_list.push_back( o );
     }
     else
     {
         assert( box_is_string( v ) );
-        atomic_store( header( o )->color, gc->black_color );
+        atomic_store( header( o )->color, w->black_color );
     }
 }
 
-void gc_mark_object_ref( collector* gc, object* o )
+void gc_mark_object_ref( mark_worker* w, object* o )
 {
-    if ( o && atomic_load( header( o )->color ) == gc->white_color )
+    if ( o && gc_is_white( w, o ) )
     {
         atomic_store( header( o )->color, GC_COLOR_MARKED );
-        gc->mark_list.push_back( o );
+        w->mark_list.push_back( o );
     }
 }
 
-void gc_mark_string_ref( collector* gc, string_object* o )
+void gc_mark_string_ref( mark_worker* w, string_object* o )
 {
-    if ( o && atomic_load( header( o )->color ) == gc->white_color )
+    if ( o && gc_is_white( w, o ) )
     {
-        atomic_store( header( o )->color, gc->black_color );
+        atomic_store( header( o )->color, w->black_color );
     }
 }
 
-void gc_mark_cothread( collector* gc, vmachine* vm, cothread_object* cothread )
+void gc_mark_cothread( mark_worker* w, vmachine* vm, cothread_object* cothread )
 {
     // Lock to synchronize with mutator thread.
     std::lock_guard lock( vm->mark_mutex );
 
     // Don't re-mark if the cothread is black already.
-    if ( atomic_load( header( cothread )->color ) == gc->black_color )
+    if ( atomic_load( header( cothread )->color ) == w->black_color )
     {
         return;
     }
 
     // Mark all stack references.
-    for ( value v : cothread->stack )
+    mark_visitor visitor = { vm, w };
+    visit_cothread( visitor, cothread );
+
+    // Mark.
+    atomic_store( header( cothread )->color, w->black_color );
+}
+
+void gc_sweep( vmachine* vm )
+{
+    collector* gc = vm->gc;
+    assert( gc->state == GC_STATE_SWEEP );
+
+    // In lazy mode, the mutator sweeps arenas when it allocates from them.
+    uint64_t sweep_start = tick();
+    if ( ! gc->lazy_sweep )
     {
-        gc_mark_value( gc, v );
+        gc_start_round( gc, GC_ROUND_SWEEP );
+        gc_sweep_blocks( vm );
+        gc_sweep_large( vm );
+        gc_sweep_work( vm, 0 );
+        gc_wait_round( gc );
     }
-
-    // Mark all references to functions in call stack.
-    for ( const stack_frame& frame : cothread->stack_frames )
+    else
     {
-        gc_mark_object_ref( gc, frame.function );
+        gc_sweep_blocks( vm );
+        gc_sweep_large( vm );
     }
 
-    // Mark.
-    atomic_store( header( cothread )->color, gc->black_color );
+    gc->statistics.tick_sweep = tick() - sweep_start;
+    gc->state = GC_STATE_SWEEP_DONE;
+    vm->handshake_pending.store( true, std::memory_order_relaxed );
 }
 
-void gc_sweep( vmachine* vm )
+void gc_sweep_work( vmachine* vm, size_t index )
+{
+    // Claim and sweep arenas until there are none left.  Each sweeper starts
+    // at a different arena to avoid contending for the same one.
+    size_t arena_count = vm->arenas.size();
+    for ( size_t i = 0; i < arena_count; ++i )
+    {
+        heap_arena* arena = vm->arenas[ ( index + i ) % arena_count ];
+        uint8_t unswept = ARENA_UNSWEPT;
+        if ( arena->state.compare_exchange_strong( unswept, ARENA_SWEEPING ) )
+        {
+            gc_sweep_arena( vm, arena, false );
+        }
+    }
+}
+
+void gc_sweep_arena( vmachine* vm, heap_arena* arena, bool locked )
 {
     collector* gc = vm->gc;
-    assert( gc->state == GC_STATE_SWEEP );
     gc_color white_color = gc->white_color;
+    assert( arena->state == ARENA_SWEEPING );
 
-    heap_state* heap = vm->heap;
+    heap_state* heap = arena->heap;
     void* p = nullptr;
     bool free_chunk = false;
 
-    // Process 'pages' of 64k each in the heap with the lock held.
+    size_t heap_size = 0;
+    collector_statistics statistics = {};
+
+    // Unless the caller holds the lock, process 'pages' of 64k each in the
+    // heap with the lock held.
     uintptr_t PAGE_MASK = ~(uintptr_t)( 64 * 1024 - 1 );
     uintptr_t page_base = 0;
 
     while ( true )
     {
-        std::unique_lock lock_heap( vm->heap_mutex );
-        while ( ( (uintptr_t)p & PAGE_MASK ) == page_base )
+        std::unique_lock lock_heap( arena->mutex, std::defer_lock );
+        if ( ! locked )
+        {
+            lock_heap.lock();
+        }
+
+        while ( ( (uintptr_t)p & PAGE_MASK ) == page_base || locked )
         {
             p = heap_sweep( heap, p, free_chunk );
             if ( ! p )
@@ -809,16 +1982,16 @@ void gc_sweep( vmachine* vm )
             free_chunk = color == white_color;
             if ( ! free_chunk )
             {
-                gc->heap_size += size;
-                gc->statistics.alive_count[ type ] += 1;
-                gc->statistics.alive_bytes[ type ] += size;
+                heap_size += size;
+                statistics.alive_count[ type ] += 1;
+                statistics.alive_bytes[ type ] += size;
             }
             else
             {
-                gc_destroy( (object*)p );
+                gc_destroy( vm, (object*)p );
 //              memset( p, 0xFE, size );
-                gc->statistics.swept_count[ type ] += 1;
-                gc->statistics.swept_bytes[ type ] += size;
+                statistics.swept_count[ type ] += 1;
+                statistics.swept_bytes[ type ] += size;
             }
         }
 
@@ -826,11 +1999,172 @@ void gc_sweep( vmachine* vm )
     }
 
 break_all:
-    gc->state = GC_STATE_SWEEP_DONE;
-    return;
+    // Return memory which has stayed free to the system.
+    size_t released = 0;
+    if ( gc->release_size )
+    {
+        std::unique_lock lock_heap( arena->mutex, std::defer_lock );
+        if ( ! locked )
+        {
+            lock_heap.lock();
+        }
+        released = heap_release( heap, gc->release_size, gc->release_idle );
+    }
+
+    arena->state = ARENA_SWEPT;
+
+    // Merge results with those from other sweepers.
+    std::lock_guard lock( gc->sweep_mutex );
+    gc->heap_size += heap_size;
+    gc->released_bytes += released;
+    for ( size_t i = 0; i < TYPE_COUNT; ++i )
+    {
+        gc->statistics.alive_count[ i ] += statistics.alive_count[ i ];
+        gc->statistics.alive_bytes[ i ] += statistics.alive_bytes[ i ];
+        gc->statistics.swept_count[ i ] += statistics.swept_count[ i ];
+        gc->statistics.swept_bytes[ i ] += statistics.swept_bytes[ i ];
+    }
+}
+
+void gc_sweep_blocks( vmachine* vm )
+{
+    // Mutator does not touch retired blocks being swept, so no locking.
+    collector* gc = vm->gc;
+    gc_color white_color = gc->white_color;
+    const nursery_space* n = &vm->nursery;
+
+    size_t heap_size = 0;
+    collector_statistics statistics = {};
+
+    size_t keep_count = 0;
+    for ( uint32_t block : gc->sweep_blocks )
+    {
+        bool keep = false;
+        char* end = nursery_block_end( n, block );
+        for ( char* chunk = nursery_block_begin( n, block ); chunk < end; )
+        {
+            object* o = (object*)( chunk + sizeof( uint64_t ) );
+            size_t size = heap_malloc_size( o );
+            chunk += size + sizeof( uint64_t );
+
+            type_code type = header( o )->type;
+            gc_color color = (gc_color)atomic_load( header( o )->color );
+            assert( color != GC_COLOR_MARKED );
+            if ( color == GC_COLOR_NONE )
+            {
+                continue;
+            }
+
+            if ( color != white_color )
+            {
+                keep = true;
+                heap_size += size;
+                statistics.alive_count[ type ] += 1;
+                statistics.alive_bytes[ type ] += size;
+            }
+            else
+            {
+                gc_destroy( vm, o );
+                atomic_store( header( o )->color, GC_COLOR_NONE );
+                statistics.swept_count[ type ] += 1;
+                statistics.swept_bytes[ type ] += size;
+            }
+        }
+
+        if ( keep )
+        {
+            gc->sweep_blocks[ keep_count++ ] = block;
+        }
+        else
+        {
+            gc->free_blocks.push_back( block );
+        }
+    }
+    gc->sweep_blocks.resize( keep_count );
+
+    // Merge results with those from other sweepers.
+    std::lock_guard lock( gc->sweep_mutex );
+    gc->heap_size += heap_size;
+    for ( size_t i = 0; i < TYPE_COUNT; ++i )
+    {
+        gc->statistics.alive_count[ i ] += statistics.alive_count[ i ];
+        gc->statistics.alive_bytes[ i ] += statistics.alive_bytes[ i ];
+        gc->statistics.swept_count[ i ] += statistics.swept_count[ i ];
+        gc->statistics.swept_bytes[ i ] += statistics.swept_bytes[ i ];
+    }
+}
+
+void gc_sweep_large( vmachine* vm )
+{
+    collector* gc = vm->gc;
+    gc_color white_color = gc->white_color;
+    large_space* s = &vm->large;
+
+    size_t heap_size = 0;
+    collector_statistics statistics = {};
+
+    // Find dead objects.  The mutator only adds objects while we hold the lock.
+    std::vector< object* > dead;
+    {
+        std::lock_guard lock( s->mutex );
+        for ( large_block* block = s->blocks; block; block = block->next )
+        {
+            object* o = (object*)large_block_object( block );
+            type_code type = header( o )->type;
+            gc_color color = (gc_color)atomic_load( header( o )->color );
+            assert( color != GC_COLOR_MARKED );
+            size_t size = heap_malloc_size( o );
+
+            if ( color != white_color )
+            {
+                heap_size += size;
+                statistics.alive_count[ type ] += 1;
+                statistics.alive_bytes[ type ] += size;
+            }
+            else
+            {
+                dead.push_back( o );
+                statistics.swept_count[ type ] += 1;
+                statistics.swept_bytes[ type ] += size;
+            }
+        }
+    }
+
+    // Unmap dead objects.
+    for ( object* o : dead )
+    {
+        gc_destroy( vm, o );
+        large_free( s, o );
+    }
+
+    // Merge results with those from other sweepers.
+    std::lock_guard lock( gc->sweep_mutex );
+    gc->heap_size += heap_size;
+    for ( size_t i = 0; i < TYPE_COUNT; ++i )
+    {
+        gc->statistics.alive_count[ i ] += statistics.alive_count[ i ];
+        gc->statistics.alive_bytes[ i ] += statistics.alive_bytes[ i ];
+        gc->statistics.swept_count[ i ] += statistics.swept_count[ i ];
+        gc->statistics.swept_bytes[ i ] += statistics.swept_bytes[ i ];
+    }
+}
+
+void gc_finish_sweep( vmachine* vm )
+{
+    // Sweep arenas that lazy sweeping did not reach.
+    collector* gc = vm->gc;
+    for ( heap_arena* arena : vm->arenas )
+    {
+        uint8_t unswept = ARENA_UNSWEPT;
+        if ( arena->state.compare_exchange_strong( unswept, ARENA_SWEEPING ) )
+        {
+            gc_sweep_arena( vm, arena, false );
+        }
+    }
+    gc->swept_heap_size = gc->heap_size;
 }
 
-void gc_destroy( object* o )
+void gc_destroy( vmachine* vm, object* o )
 {
     switch ( header( o )->type )
     {
@@ -860,13 +2194,24 @@ void gc_destroy( object* o )
 
     case COTHREAD_OBJECT:
         // This should be the only object type with a non-trivial destructor.
+        cothread_recycle_stack( vm, (cothread_object*)o );
         ( (cothread_object*)o )->~cothread_object();
         break;
 
+    case GENERATOR_OBJECT:
+        ( (generator_object*)o )->~generator_object();
+        break;
+
     case U64VAL_OBJECT:
         ( (u64val_object*)o )->~u64val_object();
         break;
 
+    case F64ARRAY_OBJECT:
+    case I32ARRAY_OBJECT:
+    case U8ARRAY_OBJECT:
+        ( (typed_array_object*)o )->~typed_array_object();
+        break;
+
     case LAYOUT_OBJECT:
         ( (layout_object*)o )->~layout_object();
         break;
@@ -880,6 +2225,9 @@ void gc_destroy( object* o )
         break;
 
     case PROGRAM_OBJECT:
+#ifdef KF_JIT
+        jit_free( ( (program_object*)o )->jit );
+#endif
         ( (program_object*)o )->~program_object();
         break;
 
@@ -893,24 +2241,231 @@ void gc_destroy( object* o )
 
 void sweep_entire_heap( vmachine* vm )
 {
-    heap_state* heap = vm->heap;
-    void* p = nullptr;
-    bool free_chunk = false;
+    // Runtime is being destroyed, so there's no point recycling stacks.
+    vm->pool->limit = 0;
 
-    while ( true )
+    // Destroy objects in the nursery.
+    nursery_space* n = &vm->nursery;
+    nursery_close_block( n );
+    for ( const std::vector< uint32_t >* blocks : { &n->young_blocks, &n->old_blocks } )
     {
-        p = heap_sweep( heap, p, free_chunk );
-        if ( ! p )
+        for ( uint32_t block : *blocks )
         {
-            break;
+            char* end = nursery_block_end( n, block );
+            for ( char* chunk = nursery_block_begin( n, block ); chunk < end; )
+            {
+                object* o = (object*)( chunk + sizeof( uint64_t ) );
+                chunk += heap_malloc_size( o ) + sizeof( uint64_t );
+                if ( atomic_load( header( o )->color ) != GC_COLOR_NONE )
+                {
+                    gc_destroy( vm, o );
+                    atomic_store( header( o )->color, GC_COLOR_NONE );
+                }
+            }
+        }
+    }
+
+    for ( heap_arena* arena : vm->arenas )
+    {
+        heap_state* heap = arena->heap;
+        void* p = nullptr;
+        bool free_chunk = false;
+
+        while ( true )
+        {
+            p = heap_sweep( heap, p, free_chunk );
+            if ( ! p )
+            {
+                break;
+            }
+
+            free_chunk = atomic_load( header( (object*)p )->color ) != GC_COLOR_NONE;
+            if ( free_chunk )
+            {
+                gc_destroy( vm, (object*)p );
+            }
+        }
+
+        arena->state = ARENA_SWEPT;
+    }
+
+    // Large objects are unmapped when the large object space is destroyed.
+    for ( large_block* block = vm->large.blocks; block; block = block->next )
+    {
+        object* o = (object*)large_block_object( block );
+        if ( atomic_load( header( o )->color ) != GC_COLOR_NONE )
+        {
+            gc_destroy( vm, o );
+            atomic_store( header( o )->color, GC_COLOR_NONE );
+        }
+    }
+}
+
+/*
+    Heap snapshots.
+*/
+
+bool heap_snapshot( vmachine* vm, const char* path )
+{
+    collector* gc = vm->gc;
+
+    // Collect, so that the snapshot holds only objects which survived.
+    wait_for_collection( vm );
+    start_collection( vm );
+    wait_for_collection( vm );
+    if ( gc->sweep_pending )
+    {
+        gc_finish_sweep( vm );
+        report_statistics( vm );
+        gc->sweep_pending = false;
+    }
+
+    FILE* file = fopen( path, "wb" );
+    if ( ! file )
+    {
+        return false;
+    }
+
+    snapshot_writer sw = { file };
+
+    // Header and type names.
+    size_t type_count = 0;
+    for ( size_t i = 0; i < TYPE_COUNT; ++i )
+    {
+        type_count += TYPE_NAMES[ i ] != nullptr;
+    }
+
+    fwrite( SNAPSHOT_MAGIC, 1, sizeof( SNAPSHOT_MAGIC ), file );
+    sw.write( SNAPSHOT_VERSION, 4 );
+    sw.write( type_count, 4 );
+    for ( size_t i = 0; i < TYPE_COUNT; ++i )
+    {
+        const char* name = TYPE_NAMES[ i ];
+        if ( ! name ) continue;
+        sw.write( i, 1 );
+        sw.write_text( name );
+    }
+
+    // Roots, as marked by safepoint_start_mark.
+    sw.write_root( SNAPSHOT_ROOT_KEY, vm->self_key );
+    for ( const auto& root : vm->roots )
+    {
+        sw.write_root( SNAPSHOT_ROOT_HANDLE, root.first );
+    }
+    for ( vcontext* c = vm->context_list; c; c = c->next )
+    {
+        sw.write_root( SNAPSHOT_ROOT_GLOBAL, c->global_object );
+        for ( cothread_object* cothread : c->cothread_stack )
+        {
+            sw.write_root( SNAPSHOT_ROOT_COTHREAD, cothread );
+        }
+        sw.write_root( SNAPSHOT_ROOT_COTHREAD, c->cothread );
+    }
+
+    // Objects in the heap.
+    for ( heap_arena* arena : vm->arenas )
+    {
+        std::lock_guard lock( arena->mutex );
+        void* p = nullptr;
+        while ( ( p = heap_sweep( arena->heap, p, false ) ) != nullptr )
+        {
+            if ( atomic_load( header( (object*)p )->color ) != GC_COLOR_NONE )
+            {
+                snapshot_object( vm, &sw, (object*)p );
+            }
+        }
+    }
+
+    // Large objects.
+    {
+        std::lock_guard lock( vm->large.mutex );
+        for ( large_block* block = vm->large.blocks; block; block = block->next )
+        {
+            object* o = (object*)large_block_object( block );
+            if ( atomic_load( header( o )->color ) != GC_COLOR_NONE )
+            {
+                snapshot_object( vm, &sw, o );
+            }
         }
+    }
 
-        free_chunk = atomic_load( header( (object*)p )->color ) != GC_COLOR_NONE;
-        if ( free_chunk )
+    // Objects in the nursery.  The current block ends at the bump pointer.
+    nursery_space* n = &vm->nursery;
+    for ( const std::vector< uint32_t >* blocks : { &n->young_blocks, &n->old_blocks } )
+    {
+        for ( uint32_t block : *blocks )
         {
-            gc_destroy( (object*)p );
+            char* end = n->top && block == n->block ? n->top : nursery_block_end( n, block );
+            for ( char* chunk = nursery_block_begin( n, block ); chunk < end; )
+            {
+                object* o = (object*)( chunk + sizeof( uint64_t ) );
+                chunk += heap_malloc_size( o ) + sizeof( uint64_t );
+                if ( atomic_load( header( o )->color ) != GC_COLOR_NONE )
+                {
+                    snapshot_object( vm, &sw, o );
+                }
+            }
         }
     }
+
+    sw.write( SNAPSHOT_END, 1 );
+    bool ok = ferror( file ) == 0;
+    ok = fclose( file ) == 0 && ok;
+    return ok;
+}
+
+void snapshot_object( vmachine* vm, snapshot_writer* sw, object* o )
+{
+    // Collect references using the same traversal as the marker.
+    sw->refs.clear();
+    visit_references( *sw, o );
+
+    std::string_view label = snapshot_label( vm, o );
+    label = label.substr( 0, SNAPSHOT_LABEL_LENGTH );
+
+    sw->write( SNAPSHOT_OBJECT, 1 );
+    sw->write( (uintptr_t)o, 8 );
+    sw->write( header( o )->type, 1 );
+    sw->write( heap_malloc_size( o ), 4 );
+    sw->write_text( label );
+    sw->write( sw->refs.size(), 4 );
+    for ( uint64_t ref : sw->refs )
+    {
+        sw->write( ref, 8 );
+    }
+}
+
+std::string_view snapshot_label( vmachine* vm, object* o )
+{
+    switch ( header( o )->type )
+    {
+    case STRING_OBJECT:
+    {
+        string_object* s = (string_object*)o;
+        return std::string_view( s->text, s->size );
+    }
+
+    case FUNCTION_OBJECT:
+        return program_name( vm, read( ( (function_object*)o )->program ) );
+
+    case NATIVE_FUNCTION_OBJECT:
+        return native_function_name( vm, (native_function_object*)o );
+
+    case PROGRAM_OBJECT:
+        return program_name( vm, (program_object*)o );
+
+    case SCRIPT_OBJECT:
+        return script_name( vm, (script_object*)o );
+
+    case LAYOUT_OBJECT:
+    {
+        string_object* key = read( ( (layout_object*)o )->key );
+        return key ? std::string_view( key->text, key->size ) : std::string_view();
+    }
+
+    default:
+        return std::string_view();
+    }
 }
 
 }
@@ -53,17 +53,50 @@
       - When the GC thread runs out of work, it steals the mutator thread's
         mark stack.
       - When the GC thread steals an empty stack, marking is done.
+      - gc_tuning sets the number of threads which mark and sweep, with a
+        default from KENAF_GC_THREADS.  Extra threads help the GC thread,
+        stealing work from each other.
 
     During the sweep phase:
 
-      - The mutator must lock before allocating objects.
-      - The GC thread must lock during sweeping.
+      - The heap is split into arenas, each with its own lock.  The mutator
+        must lock an arena before allocating from it.
+      - Sweepers claim whole arenas, and lock each arena while sweeping it.
+      - The mutator allocates from whichever arena it can lock, so it only
+        waits if every arena is being swept.
+
+    KENAF_GC_HEAP_ARENAS sets the number of arenas.  If gc_tuning selects lazy
+    sweeping (by default, if KENAF_GC_LAZY_SWEEP is set), the GC thread does
+    not sweep.  Instead, the mutator sweeps each arena before it first
+    allocates from it.  Arenas that are still unswept when the next
+    collection starts are swept then.
+
+    After sweeping an arena, the pages of free chunks of at least the
+    gc_tuning release size, which have stayed free for the last release idle
+    sweeps, are returned to the system.  The defaults are taken from
+    KENAF_GC_RELEASE_SIZE and KENAF_GC_RELEASE_IDLE.  A release size of 0
+    disables this.  If KENAF_GC_HUGE_PAGES is set, heap segments are
+    aligned so they can be backed by transparent huge pages.
+
+    Objects of at least KENAF_GC_LARGE_SIZE bytes are allocated from the large
+    object space instead of the heap (see large_space.h), unless it is set to
+    0.  The GC thread sweeps large objects alongside retired nursery blocks.
 
     The mutator thread has a countdown of how many bytes its allowed to
     allocate from the heap before triggering a GC.  If this limit is exhausted,
-    a GC is triggered at the next safepoint.
+    a GC is triggered at the next safepoint.  The countdown is calculated at
+    the end of each collection from the gc_tuning parameters, and there is a
+    second countdown to the hard heap limit.
+
+    Small objects are allocated from the nursery instead (see nursery.h).
+    When the nursery is full, a minor collection happens on the mutator
+    thread at the next safepoint, unless a GC is in progress.  Objects which
+    survive a minor collection count against the countdown.  At the start of
+    the sweep phase, every young object is promoted.
+    KENAF_GC_NURSERY_SIZE sets the size of the nursery, or disables it if 0.
 */
 
+#include <atomic>
 #include "vmachine.h"
 
 namespace kf
@@ -71,6 +104,7 @@ namespace kf
 
 struct vmachine;
 struct collector;
+struct heap_state;
 
 struct collector_statistics
 {
@@ -78,12 +112,43 @@ struct collector_statistics
     uint64_t tick_stack_pause;
     uint64_t tick_sweep_pause;
     uint64_t tick_heap_pause;
+    uint64_t tick_minor_pause;
+    uint64_t tick_mark;
+    uint64_t tick_sweep;
+    size_t minor_count;
+    size_t promoted_bytes;
     size_t swept_count[ TYPE_COUNT ];
     size_t swept_bytes[ TYPE_COUNT ];
     size_t alive_count[ TYPE_COUNT ];
     size_t alive_bytes[ TYPE_COUNT ];
 };
 
+/*
+    Heap arenas.  The mutator allocates HEAP_ARENA_STRIDE bytes from each
+    arena in turn.
+*/
+
+const size_t HEAP_DEFAULT_ARENAS = 4;
+const size_t HEAP_ARENA_STRIDE = 256 * 1024;
+
+enum arena_state : uint8_t
+{
+    ARENA_SWEPT,
+    ARENA_UNSWEPT,
+    ARENA_SWEEPING,
+};
+
+struct heap_arena
+{
+    std::mutex mutex;
+    heap_state* heap;
+    std::atomic< uint8_t > state;
+};
+
+heap_arena* heap_arena_create( unsigned heap_flags );
+void heap_arena_destroy( heap_arena* arena );
+heap_arena* acquire_arena( vmachine* vm, size_t size, std::unique_lock< std::mutex >& lock );
+
 collector* collector_create();
 void collector_destroy( collector* c );
 
@@ -93,9 +158,40 @@ void stop_collector( vmachine* vm );
 void add_stack_pause( collector* c, uint64_t tick );
 void add_heap_pause( collector* c, uint64_t tick );
 
+const double GC_DEFAULT_GROWTH = 0.5;
+const size_t GC_DEFAULT_MIN_TRIGGER = 512 * 1024;
+const size_t GC_SOFT_LIMIT_MIN_TRIGGER = 64 * 1024;
+const size_t GC_DEFAULT_RELEASE_SIZE = 256 * 1024;
+const unsigned GC_DEFAULT_RELEASE_IDLE = 1;
+
+gc_tuning get_tuning( vmachine* vm );
+void set_tuning( vmachine* vm, const gc_tuning& tuning );
+gc_triggers get_triggers( collector* c );
+void get_statistics( vmachine* vm, gc_statistics* statistics );
+size_t get_type_statistics( collector* c, gc_type_statistics* types, size_t count );
+[[noreturn]] void heap_limit_exceeded( vmachine* vm, size_t size );
+
 void safepoint( vmachine* vm );
 void start_collection( vmachine* vm );
 void wait_for_collection( vmachine* vm );
+bool step_collection( vmachine* vm, uint64_t budget_ns );
+bool heap_snapshot( vmachine* vm, const char* path );
+
+/*
+    The mutator polls for safepoints on function return and on backward
+    jumps.  Outside a collection, only allocation makes a safepoint due.
+    During a collection, a safepoint is only due once the GC thread is
+    waiting for a handshake.
+*/
+
+inline bool safepoint_due( vmachine* vm )
+{
+    if ( vm->phase != GC_PHASE_NONE )
+    {
+        return vm->handshake_pending.load( std::memory_order_relaxed );
+    }
+    return vm->countdown == 0 || vm->nursery.countdown == 0;
+}
 
 }
 
@@ -14,6 +14,7 @@
 #include "../objects/array_object.h"
 #include "../objects/table_object.h"
 #include "../objects/cothread_object.h"
+#include "../objects/typed_array_object.h"
 
 namespace kf
 {
@@ -66,6 +67,18 @@ namespace kf
 
     def u64val is object end
 
+    def f64array is object
+        def self( n ) end
+    end
+
+    def i32array is object
+        def self( n ) end
+    end
+
+    def u8array is object
+        def self( n ) end
+    end
+
 */
 
 static result superof( void* cookie, frame* frame, const value* arguments, size_t argcount )
@@ -230,6 +243,27 @@ static result array_clear( void* cookie, frame* frame, const value* arguments, s
     return return_void( frame );
 }
 
+static result typed_array_self( vmachine* vm, frame* frame, type_code type, value length )
+{
+    typed_array_object* array = typed_array_new( vm, type, array_index( length ) );
+    return return_value( frame, box_object( array ) );
+}
+
+static result f64array_self( void* cookie, frame* frame, const value* arguments, size_t argcount )
+{
+    return typed_array_self( (vmachine*)cookie, frame, F64ARRAY_OBJECT, arguments[ 1 ] );
+}
+
+static result i32array_self( void* cookie, frame* frame, const value* arguments, size_t argcount )
+{
+    return typed_array_self( (vmachine*)cookie, frame, I32ARRAY_OBJECT, arguments[ 1 ] );
+}
+
+static result u8array_self( void* cookie, frame* frame, const value* arguments, size_t argcount )
+{
+    return typed_array_self( (vmachine*)cookie, frame, U8ARRAY_OBJECT, arguments[ 1 ] );
+}
+
 static result table_has( void* cookie, frame* frame, const value* arguments, size_t argcount )
 {
     value t = arguments[ 0 ];
@@ -273,6 +307,11 @@ static result table_clear( void* cookie, frame* frame, const value* arguments, s
 static result cothread_done( void* cookie, frame* frame, const value* arguments, size_t argcount )
 {
     value c = arguments[ 0 ];
+    if ( box_is_object_type( c, GENERATOR_OBJECT ) )
+    {
+        generator_object* generator = (generator_object*)unbox_object( c );
+        return return_value( frame, read( generator->function ) ? false_value : true_value );
+    }
     if ( ! box_is_object_type( c, COTHREAD_OBJECT ) ) raise_type_error( c, "a cothread" );
     cothread_object* cothread = (cothread_object*)unbox_object( c );
     return return_value( frame, cothread->stack_frames.empty() ? true_value : false_value );
@@ -365,6 +404,30 @@ void expose_corobjects( vmachine* vm )
     {
         lookup_seal( vm, proto_u64val );
     }
+
+    lookup_object* proto_f64array = vm->prototypes[ F64ARRAY_OBJECT ];
+    set_key( global, "f64array", box_object( proto_f64array ) );
+    if ( ! lookup_sealed( vm, proto_f64array ) )
+    {
+        set_key( box_object( proto_f64array ), "self", create_function( "f64array.self", f64array_self, vm, 2, FUNCTION_DIRECT ) );
+        lookup_seal( vm, proto_f64array );
+    }
+
+    lookup_object* proto_i32array = vm->prototypes[ I32ARRAY_OBJECT ];
+    set_key( global, "i32array", box_object( proto_i32array ) );
+    if ( ! lookup_sealed( vm, proto_i32array ) )
+    {
+        set_key( box_object( proto_i32array ), "self", create_function( "i32array.self", i32array_self, vm, 2, FUNCTION_DIRECT ) );
+        lookup_seal( vm, proto_i32array );
+    }
+
+    lookup_object* proto_u8array = vm->prototypes[ U8ARRAY_OBJECT ];
+    set_key( global, "u8array", box_object( proto_u8array ) );
+    if ( ! lookup_sealed( vm, proto_u8array ) )
+    {
+        set_key( box_object( proto_u8array ), "self", create_function( "u8array.self", u8array_self, vm, 2, FUNCTION_DIRECT ) );
+        lookup_seal( vm, proto_u8array );
+    }
 }
 
 }
@@ -12,17 +12,266 @@
 #define KF_EXECUTE_H
 
 /*
-    The actual interpreter loop.
+    The actual interpreter loop.  The default build dispatches using a switch
+    statement.  Defining COMPUTED_GOTO dispatches through a table of labels
+    instead.  Defining TAIL_CALL selects the interpreter in execute_tail.cpp,
+    where each instruction is a separate function which tail calls the next.
+
+    The instruction handlers themselves are written once, in execute_ops.h,
+    and are included by each interpreter.
 */
 
+#include <string.h>
+#include <algorithm>
+#include <exception>
+#include "vmachine.h"
+#include "call_stack.h"
+#include "objects/lookup_object.h"
+#include "objects/string_object.h"
+#include "objects/table_object.h"
+#include "objects/function_object.h"
+#include "../common/code.h"
+
 namespace kf
 {
 
-struct vmachine;
-struct xstate;
-
 void execute( vmachine* vm, xstate state );
 
+/*
+    State of the running interpreter which is not kept in the hot registers.
+*/
+
+struct xcontext
+{
+    vmachine* vm;
+    function_object* function;
+    op* ops;
+    ref_value* k;
+    key_selector* s;
+#ifdef KF_JIT
+    jit_code* jit;
+    std::exception_ptr exception;
+#endif
+    unsigned xp;
+    op* ip;
+    xstate state;
+    size_t index;
+    table_keyval keyval;
+};
+
+/*
+    Handler for each opcode.
+*/
+
+#define EXECUTE_OPS( X ) \
+    X( OP_MOV,          op_mov )        \
+    X( OP_SWP,          op_swp )        \
+    X( OP_LDV,          op_ldv )        \
+    X( OP_LDK,          op_ldk )        \
+    X( OP_NEG,          op_neg )        \
+    X( OP_POS,          op_pos )        \
+    X( OP_ADD,          op_add )        \
+    X( OP_ADDN,         op_addn )       \
+    X( OP_SUB,          op_sub )        \
+    X( OP_SUBN,         op_subn )       \
+    X( OP_MUL,          op_mul )        \
+    X( OP_MULN,         op_muln )       \
+    X( OP_DIV,          op_div )        \
+    X( OP_INTDIV,       op_intdiv )     \
+    X( OP_MOD,          op_mod )        \
+    X( OP_NOT,          op_not )        \
+    X( OP_JMP,          op_jmp )        \
+    X( OP_JT,           op_jt )         \
+    X( OP_JF,           op_jf )         \
+    X( OP_JEQ,          op_jeq )        \
+    X( OP_JEQN,         op_jeqn )       \
+    X( OP_JEQS,         op_jeqs )       \
+    X( OP_JLT,          op_jlt )        \
+    X( OP_JLTN,         op_jltn )       \
+    X( OP_JGTN,         op_jgtn )       \
+    X( OP_JLE,          op_jle )        \
+    X( OP_JLEN,         op_jlen )       \
+    X( OP_JGEN,         op_jgen )       \
+    X( OP_GET_GLOBAL,   op_get_global ) \
+    X( OP_GET_KEY,      op_get_key )    \
+    X( OP_SET_KEY,      op_set_key )    \
+    X( OP_GET_INDEX,    op_get_index )  \
+    X( OP_GET_INDEXI,   op_get_indexi ) \
+    X( OP_SET_INDEX,    op_set_index )  \
+    X( OP_SET_INDEXI,   op_set_indexi ) \
+    X( OP_NEW_ENV,      op_new_env )    \
+    X( OP_GET_VARENV,   op_get_varenv ) \
+    X( OP_SET_VARENV,   op_set_varenv ) \
+    X( OP_GET_OUTENV,   op_get_outenv ) \
+    X( OP_SET_OUTENV,   op_set_outenv ) \
+    X( OP_FUNCTION,     op_function )   \
+    X( OP_NEW_OBJECT,   op_new_object ) \
+    X( OP_NEW_ARRAY,    op_new_array )  \
+    X( OP_NEW_TABLE,    op_new_table )  \
+    X( OP_APPEND,       op_append )     \
+    X( OP_CALL,         op_call )       \
+    X( OP_CALLR,        op_call )       \
+    X( OP_MCALL,        op_mcall )      \
+    X( OP_MCALLR,       op_mcall )      \
+    X( OP_YCALL,        op_call )       \
+    X( OP_YIELD,        op_yield )      \
+    X( OP_RETURN,       op_return )     \
+    X( OP_VARARG,       op_vararg )     \
+    X( OP_UNPACK,       op_unpack )     \
+    X( OP_EXTEND,       op_extend )     \
+    X( OP_GENERATE,     op_generate )   \
+    X( OP_FOR_EACH,     op_for_each )   \
+    X( OP_FOR_STEP,     op_for_step )   \
+    X( OP_CONCAT,       op_concat )     \
+    X( OP_CONCATS,      op_concats )    \
+    X( OP_RCONCATS,     op_rconcats )   \
+    X( OP_BITNOT,       op_bitnot )     \
+    X( OP_LSHIFT,       op_lshift )     \
+    X( OP_RSHIFT,       op_rshift )     \
+    X( OP_ASHIFT,       op_ashift )     \
+    X( OP_BITAND,       op_bitand )     \
+    X( OP_BITXOR,       op_bitxor )     \
+    X( OP_BITOR,        op_bitor )      \
+    X( OP_LEN,          op_len )        \
+    X( OP_IS,           op_is )         \
+    X( OP_SUPER,        op_super )      \
+    X( OP_THROW,        op_throw )      \
+    X( OP_F_METHOD,     op_orphan )     \
+    X( OP_F_VARENV,     op_orphan )     \
+    X( OP_F_OUTENV,     op_orphan )     \
+    X( OP_JLT_NN,       op_jlt_nn )     \
+    X( OP_JLE_NN,       op_jle_nn )     \
+    X( OP_GET_ARRAY,    op_get_array )  \
+    X( OP_GET_TABLE,    op_get_table )  \
+    X( OP_GET_ARRAYI,   op_get_arrayi ) \
+    X( OP_SET_ARRAY,    op_set_array )  \
+    X( OP_SET_TABLE,    op_set_table )  \
+    X( OP_SET_ARRAYI,   op_set_arrayi ) \
+    X( OP_GET_TYPED,    op_get_typed )  \
+    X( OP_SET_TYPED,    op_set_typed )  \
+    X( OP_JLT_ANY,      op_jlt )        \
+    X( OP_JLE_ANY,      op_jle )        \
+    X( OP_GET_INDEX_ANY, op_get_index ) \
+    X( OP_GET_INDEXI_ANY, op_get_indexi ) \
+    X( OP_SET_INDEX_ANY, op_set_index ) \
+    X( OP_SET_INDEXI_ANY, op_set_indexi )
+
+/*
+    Helpers shared by the interpreter loops.
+*/
+
+inline bool value_test( value u )
+{
+    // All values test true except null, false, -0.0, and +0.0.
+    return u.v > 1 && u.v != box_number( +0.0 ).v && u.v != box_number( -0.0 ).v;
+}
+
+inline int string_compare( string_object* us, string_object* vs )
+{
+    if ( us == vs ) return 0;
+    size_t size = std::min( us->size, vs->size );
+    return memcmp( us->text, vs->text, size + 1 );
+}
+
+inline value concat_strings( vmachine* vm, string_object* us, string_object* vs )
+{
+    string_object* s = string_new( vm, nullptr, us->size + vs->size );
+    memcpy( s->text, us->text, us->size );
+    memcpy( s->text + us->size, vs->text, vs->size );
+    return box_string( s );
+}
+
+inline bool jump_test( op op, bool test )
+{
+    return ( test ? 1 : 0 ) == op.r;
+}
+
+inline void enter_function( xcontext* x )
+{
+    function_object* function = x->state.function;
+    program_object* program = read( function->program );
+    x->function = function;
+    x->ops = program->ops;
+    x->k = program->constants;
+    x->s = program->selectors;
+#ifdef KF_JIT
+    x->jit = program->jit;
+#endif
+    x->xp = x->state.xp;
+}
+
+[[noreturn]] inline void type_error( xcontext* x, op* ip, value u, const char* expected )
+{
+    x->ip = ip;
+    raise_type_error( u, expected );
+}
+
+#ifdef KF_JIT
+
+/*
+    Loops count towards the compile threshold, so that a long-running loop is
+    compiled even if its function is only called once.
+*/
+
+inline bool jit_loop( xcontext* x )
+{
+    if ( ! x->jit )
+    {
+        program_object* program = read( x->function->program );
+        if ( ! program->jit && program->jit_count++ == x->vm->jit_threshold )
+        {
+            program->jit = jit_compile( x->vm, program );
+        }
+        x->jit = program->jit;
+    }
+    return x->jit != nullptr;
+}
+
+[[noreturn]] inline void jit_rethrow( xcontext* x )
+{
+    std::exception_ptr exception = x->exception;
+    x->exception = nullptr;
+    std::rethrow_exception( exception );
+}
+
+#endif
+
+inline lookup_object* keyer_of( vmachine* vm, value u )
+{
+    if ( box_is_number( u ) )
+    {
+        return vm->prototypes[ NUMBER_OBJECT ];
+    }
+    else if ( box_is_string( u ) )
+    {
+        return vm->prototypes[ STRING_OBJECT ];
+    }
+    else if ( box_is_object( u ) )
+    {
+        type_code type = header( unbox_object( u ) )->type;
+        if ( type == LOOKUP_OBJECT )
+        {
+            return (lookup_object*)unbox_object( u );
+        }
+        else
+        {
+            return vm->prototypes[ type ];
+        }
+    }
+    else if ( box_is_bool( u ) )
+    {
+        return vm->prototypes[ BOOL_OBJECT ];
+    }
+    else if ( box_is_u64val( u ) )
+    {
+        return vm->prototypes[ U64VAL_OBJECT ];
+    }
+    else
+    {
+        return vm->prototypes[ NULL_OBJECT ];
+    }
+}
+
 }
 
 #endif
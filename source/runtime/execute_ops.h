@@ -0,0 +1,1378 @@
+//
+//  execute_ops.h
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+/*
+    Instruction handlers, shared by each of the interpreter loops.  This file
+    has no include guard.  It is included by each interpreter after defining:
+
+        IOP( name )     Begins the handler called name.
+        INEXT           Dispatches the instruction at ip.
+        IGOTO( name )   Continues with the handler called name.
+        IJUMP( j )      Adds j to ip, polling for a safepoint if j < 0.
+        ISWITCH         Continues with x->state, which is either a new
+                        function or a return to a suspended frame.  If
+                        x->state.function is null, the interpreter returns.
+        ISAVE           Stores ip in x->ip before anything which might throw.
+
+    Each handler can use the xcontext x, the register window r, the
+    instruction pointer ip (which points past the instruction), the constant
+    table k, and the decoded instruction op.
+*/
+
+IOP( op_mov )
+{
+    r[ op.r ] = r[ op.a ];
+    INEXT;
+}
+
+IOP( op_swp )
+{
+    value w = r[ op.r ];
+    r[ op.r ] = r[ op.a ];
+    r[ op.a ] = w;
+    INEXT;
+}
+
+IOP( op_ldv )
+{
+    r[ op.r ] = { op.c };
+    INEXT;
+}
+
+IOP( op_ldk )
+{
+    r[ op.r ] = read( k[ op.c ] );
+    INEXT;
+}
+
+IOP( op_neg )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( -unbox_number( u ) );
+    INEXT;
+}
+
+IOP( op_pos )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( +unbox_number( u ) );
+    INEXT;
+}
+
+IOP( op_add )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( unbox_number( u ) + unbox_number( v ) );
+    INEXT;
+}
+
+IOP( op_addn )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( unbox_number( u ) + unbox_number( read( k[ op.b ] ) ) );
+    INEXT;
+}
+
+IOP( op_sub )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( unbox_number( v ) - unbox_number( u ) );
+    INEXT;
+}
+
+IOP( op_subn )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( unbox_number( read( k[ op.b ] ) ) - unbox_number( u ) );
+    INEXT;
+}
+
+IOP( op_mul )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( unbox_number( u ) * unbox_number( v ) );
+    INEXT;
+}
+
+IOP( op_muln )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( unbox_number( u ) * unbox_number( read( k[ op.b ] ) ) );
+    INEXT;
+}
+
+IOP( op_div )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( unbox_number( u ) / unbox_number( v ) );
+    INEXT;
+}
+
+IOP( op_intdiv )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( ifloordiv( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_mod )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( ifloormod( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_not )
+{
+    value u = r[ op.a ];
+    r[ op.r ] = value_test( u ) ? false_value : true_value;
+    INEXT;
+}
+
+IOP( op_jmp )
+{
+    IJUMP( op.j );
+    INEXT;
+}
+
+IOP( op_jt )
+{
+    if ( value_test( r[ op.r ] ) )
+    {
+        IJUMP( op.j );
+    }
+    INEXT;
+}
+
+IOP( op_jf )
+{
+    if ( ! value_test( r[ op.r ] ) )
+    {
+        IJUMP( op.j );
+    }
+    INEXT;
+}
+
+IOP( op_jeq )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    bool test = false;
+    if ( box_is_number( u ) )
+    {
+        test = box_is_number( v ) && unbox_number( u ) == unbox_number( v );
+    }
+    else if ( u.v == v.v )
+    {
+        test = true;
+    }
+    else if ( box_is_string( u ) )
+    {
+        test = box_is_string( v ) && string_equal( unbox_string( u ), unbox_string( v ) );
+    }
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jeqn )
+{
+    value u = r[ op.a ];
+    bool test = box_is_number( u ) && unbox_number( u ) == unbox_number( read( k[ op.b ] ) );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jeqs )
+{
+    value u = r[ op.a ];
+    bool test = box_is_string( u ) && string_equal( unbox_string( u ), unbox_string( read( k[ op.b ] ) ) );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jlt )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    bool test = false;
+    if ( box_is_number( u ) )
+    {
+        if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+        test = unbox_number( u ) < unbox_number( v );
+        if ( op.opcode == OP_JLT ) ip[ -1 ].opcode = OP_JLT_NN;
+    }
+    else if ( box_is_string( u ) )
+    {
+        if ( ! box_is_string( v ) ) type_error( x, ip, v, "a string" );
+        test = string_compare( unbox_string( u ), unbox_string( v ) ) < 0;
+    }
+    else
+    {
+        type_error( x, ip, u, "a number or string" );
+    }
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jltn )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    bool test = unbox_number( u ) < unbox_number( read( k[ op.b ] ) );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jgtn )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    bool test = unbox_number( u ) > unbox_number( read( k[ op.b ] ) );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jle )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    bool test = false;
+    if ( box_is_number( u ) )
+    {
+        if ( ! box_is_number( v ) ) type_error( x, ip, u, "a number" );
+        test = unbox_number( u ) <= unbox_number( v );
+        if ( op.opcode == OP_JLE ) ip[ -1 ].opcode = OP_JLE_NN;
+    }
+    else if ( box_is_string( u ) )
+    {
+        if ( ! box_is_string( v ) ) type_error( x, ip, v, "a string" );
+        test = string_compare( unbox_string( u ), unbox_string( v ) ) <= 0;
+    }
+    else
+    {
+        type_error( x, ip, u, "a number or string" );
+    }
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jlen )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    bool test = unbox_number( u ) <= unbox_number( read( k[ op.b ] ) );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jgen )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    bool test = unbox_number( u ) >= unbox_number( read( k[ op.b ] ) );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_get_global )
+{
+    ISAVE;
+    key_selector* ks = x->s + op.c;
+    r[ op.r ] = lookup_getkey( x->vm, x->vm->c->global_object, read( ks->key ), &ks->sel );
+    INEXT;
+}
+
+IOP( op_get_key )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    key_selector* ks = x->s + op.b;
+    r[ op.r ] = lookup_getkey( x->vm, keyer_of( x->vm, u ), read( ks->key ), &ks->sel );
+    INEXT;
+}
+
+IOP( op_set_key )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    key_selector* ks = x->s + op.b;
+    if ( ! box_is_object_type( u, LOOKUP_OBJECT ) ) type_error( x, ip, u, "a lookup object" );
+    lookup_setkey( x->vm, (lookup_object*)unbox_object( u ), read( ks->key ), &ks->sel, r[ op.r ] );
+    INEXT;
+}
+
+IOP( op_get_index )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( box_is_object( u ) )
+    {
+        type_code type = header( unbox_object( u ) )->type;
+        if ( type == ARRAY_OBJECT )
+        {
+            array_object* array = (array_object*)unbox_object( u );
+            if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+            if ( op.opcode == OP_GET_INDEX ) ip[ -1 ].opcode = OP_GET_ARRAY;
+            r[ op.r ] = array_getindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ) );
+            INEXT;
+        }
+        else if ( type == TABLE_OBJECT )
+        {
+            table_object* table = (table_object*)unbox_object( u );
+            if ( op.opcode == OP_GET_INDEX ) ip[ -1 ].opcode = OP_GET_TABLE;
+            r[ op.r ] = table_getindex( x->vm, table, v );
+            INEXT;
+        }
+        else if ( is_typed_array_type( type ) )
+        {
+            typed_array_object* array = (typed_array_object*)unbox_object( u );
+            if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+            if ( op.opcode == OP_GET_INDEX ) ip[ -1 ].opcode = OP_GET_TYPED;
+            r[ op.r ] = typed_array_getindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ) );
+            INEXT;
+        }
+    }
+    else if ( box_is_string( u ) )
+    {
+        string_object* string = unbox_string( u );
+        r[ op.r ] = box_string( string_getindex( x->vm, string, (size_t)(intptr_t)unbox_number( v ) ) );
+        INEXT;
+    }
+    type_error( x, ip, u, "an indexable value" );
+}
+
+IOP( op_get_indexi )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    if ( box_is_object( u ) )
+    {
+        type_code type = header( unbox_object( u ) )->type;
+        if ( type == ARRAY_OBJECT )
+        {
+            array_object* array = (array_object*)unbox_object( u );
+            if ( op.opcode == OP_GET_INDEXI ) ip[ -1 ].opcode = OP_GET_ARRAYI;
+            r[ op.r ] = array_getindex( x->vm, array, op.b );
+            INEXT;
+        }
+        else if ( type == TABLE_OBJECT )
+        {
+            table_object* table = (table_object*)unbox_object( u );
+            r[ op.r ] = table_getindex( x->vm, table, box_number( op.b ) );
+            INEXT;
+        }
+        else if ( is_typed_array_type( type ) )
+        {
+            typed_array_object* array = (typed_array_object*)unbox_object( u );
+            r[ op.r ] = typed_array_getindex( x->vm, array, op.b );
+            INEXT;
+        }
+    }
+    else if ( box_is_string( u ) )
+    {
+        string_object* string = unbox_string( u );
+        r[ op.r ] = box_string( string_getindex( x->vm, string, op.b ) );
+        INEXT;
+    }
+    type_error( x, ip, u, "an indexable value" );
+}
+
+IOP( op_set_index )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( box_is_object( u ) )
+    {
+        type_code type = header( unbox_object( u ) )->type;
+        if ( type == ARRAY_OBJECT )
+        {
+            array_object* array = (array_object*)unbox_object( u );
+            if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+            if ( op.opcode == OP_SET_INDEX ) ip[ -1 ].opcode = OP_SET_ARRAY;
+            array_setindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ), r[ op.r ] );
+            INEXT;
+        }
+        else if ( type == TABLE_OBJECT )
+        {
+            table_object* table = (table_object*)unbox_object( u );
+            if ( op.opcode == OP_SET_INDEX ) ip[ -1 ].opcode = OP_SET_TABLE;
+            table_setindex( x->vm, table, v, r[ op.r ] );
+            INEXT;
+        }
+        else if ( is_typed_array_type( type ) )
+        {
+            typed_array_object* array = (typed_array_object*)unbox_object( u );
+            if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+            if ( op.opcode == OP_SET_INDEX ) ip[ -1 ].opcode = OP_SET_TYPED;
+            typed_array_setindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ), r[ op.r ] );
+            INEXT;
+        }
+    }
+    type_error( x, ip, u, "an indexable value" );
+}
+
+IOP( op_set_indexi )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    if ( box_is_object( u ) )
+    {
+        type_code type = header( unbox_object( u ) )->type;
+        if ( type == ARRAY_OBJECT )
+        {
+            array_object* array = (array_object*)unbox_object( u );
+            if ( op.opcode == OP_SET_INDEXI ) ip[ -1 ].opcode = OP_SET_ARRAYI;
+            array_setindex( x->vm, array, op.b, r[ op.r ] );
+            INEXT;
+        }
+        else if ( type == TABLE_OBJECT )
+        {
+            table_object* table = (table_object*)unbox_object( u );
+            table_setindex( x->vm, table, box_number( op.b ), r[ op.r ] );
+            INEXT;
+        }
+        else if ( is_typed_array_type( type ) )
+        {
+            typed_array_object* array = (typed_array_object*)unbox_object( u );
+            typed_array_setindex( x->vm, array, op.b, r[ op.r ] );
+            INEXT;
+        }
+    }
+    type_error( x, ip, u, "an indexable value" );
+}
+
+/*
+    Quickened instructions.  If a guard fails, the instruction is rewritten
+    to the _ANY variant of its generic instruction, which is never quickened
+    again.  A site which sees mixed types stops rewriting the program.
+*/
+
+IOP( op_jlt_nn )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) || ! box_is_number( v ) )
+    {
+        ip[ -1 ].opcode = OP_JLT_ANY;
+        IGOTO( op_jlt );
+    }
+    bool test = unbox_number( u ) < unbox_number( v );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_jle_nn )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) || ! box_is_number( v ) )
+    {
+        ip[ -1 ].opcode = OP_JLE_ANY;
+        IGOTO( op_jle );
+    }
+    bool test = unbox_number( u ) <= unbox_number( v );
+    struct op jop = *ip++;
+    if ( jump_test( op, test ) )
+    {
+        IJUMP( jop.j );
+    }
+    INEXT;
+}
+
+IOP( op_get_array )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_object_type( u, ARRAY_OBJECT ) || ! box_is_number( v ) )
+    {
+        ip[ -1 ].opcode = OP_GET_INDEX_ANY;
+        IGOTO( op_get_index );
+    }
+    ISAVE;
+    array_object* array = (array_object*)unbox_object( u );
+    r[ op.r ] = array_getindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ) );
+    INEXT;
+}
+
+IOP( op_get_table )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_object_type( u, TABLE_OBJECT ) )
+    {
+        ip[ -1 ].opcode = OP_GET_INDEX_ANY;
+        IGOTO( op_get_index );
+    }
+    ISAVE;
+    table_object* table = (table_object*)unbox_object( u );
+    r[ op.r ] = table_getindex( x->vm, table, r[ op.b ] );
+    INEXT;
+}
+
+IOP( op_get_arrayi )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_object_type( u, ARRAY_OBJECT ) )
+    {
+        ip[ -1 ].opcode = OP_GET_INDEXI_ANY;
+        IGOTO( op_get_indexi );
+    }
+    ISAVE;
+    array_object* array = (array_object*)unbox_object( u );
+    r[ op.r ] = array_getindex( x->vm, array, op.b );
+    INEXT;
+}
+
+IOP( op_set_array )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_object_type( u, ARRAY_OBJECT ) || ! box_is_number( v ) )
+    {
+        ip[ -1 ].opcode = OP_SET_INDEX_ANY;
+        IGOTO( op_set_index );
+    }
+    ISAVE;
+    array_object* array = (array_object*)unbox_object( u );
+    array_setindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ), r[ op.r ] );
+    INEXT;
+}
+
+IOP( op_set_table )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_object_type( u, TABLE_OBJECT ) )
+    {
+        ip[ -1 ].opcode = OP_SET_INDEX_ANY;
+        IGOTO( op_set_index );
+    }
+    ISAVE;
+    table_object* table = (table_object*)unbox_object( u );
+    table_setindex( x->vm, table, r[ op.b ], r[ op.r ] );
+    INEXT;
+}
+
+IOP( op_set_arrayi )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_object_type( u, ARRAY_OBJECT ) )
+    {
+        ip[ -1 ].opcode = OP_SET_INDEXI_ANY;
+        IGOTO( op_set_indexi );
+    }
+    ISAVE;
+    array_object* array = (array_object*)unbox_object( u );
+    array_setindex( x->vm, array, op.b, r[ op.r ] );
+    INEXT;
+}
+
+IOP( op_get_typed )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_typed_array( u ) || ! box_is_number( v ) )
+    {
+        ip[ -1 ].opcode = OP_GET_INDEX_ANY;
+        IGOTO( op_get_index );
+    }
+    ISAVE;
+    typed_array_object* array = (typed_array_object*)unbox_object( u );
+    r[ op.r ] = typed_array_getindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ) );
+    INEXT;
+}
+
+IOP( op_set_typed )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_typed_array( u ) || ! box_is_number( v ) )
+    {
+        ip[ -1 ].opcode = OP_SET_INDEX_ANY;
+        IGOTO( op_set_index );
+    }
+    ISAVE;
+    typed_array_object* array = (typed_array_object*)unbox_object( u );
+    typed_array_setindex( x->vm, array, (size_t)(intptr_t)unbox_number( v ), r[ op.r ] );
+    INEXT;
+}
+
+IOP( op_new_env )
+{
+    ISAVE;
+    r[ op.r ] = box_object( vslots_new( x->vm, op.c ) );
+    INEXT;
+}
+
+IOP( op_get_varenv )
+{
+    vslots_object* varenv = (vslots_object*)unbox_object( r[ op.a ] );
+    r[ op.r ] = read( varenv->slots[ op.b ] );
+    INEXT;
+}
+
+IOP( op_set_varenv )
+{
+    vslots_object* varenv = (vslots_object*)unbox_object( r[ op.a ] );
+    write( x->vm, varenv->slots[ op.b ], r[ op.r ] );
+    INEXT;
+}
+
+IOP( op_get_outenv )
+{
+    vslots_object* outenv = read( x->function->outenvs[ op.a ] );
+    r[ op.r ] = read( outenv->slots[ op.b ] );
+    INEXT;
+}
+
+IOP( op_set_outenv )
+{
+    vslots_object* outenv = read( x->function->outenvs[ op.a ] );
+    write( x->vm, outenv->slots[ op.b ], r[ op.r ] );
+    INEXT;
+}
+
+IOP( op_function )
+{
+    ISAVE;
+    program_object* program = read( read( x->function->program )->functions[ op.c ] );
+    function_object* closure = function_new( x->vm, program );
+    unsigned rp = op.r;
+    while ( true )
+    {
+        struct op fop = *ip;
+        if ( fop.opcode == OP_F_METHOD )
+        {
+            assert( fop.r == rp );
+            value omethod = r[ fop.a ];
+            if ( ! box_is_object_type( omethod, LOOKUP_OBJECT ) ) type_error( x, ip, omethod, "a lookup object" );
+            winit( closure->omethod, (lookup_object*)unbox_object( omethod ) );
+        }
+        else if ( fop.opcode == OP_F_VARENV )
+        {
+            assert( fop.r == rp );
+            winit( closure->outenvs[ fop.a ], (vslots_object*)unbox_object( r[ fop.b ] ) );
+        }
+        else if ( fop.opcode == OP_F_OUTENV )
+        {
+            assert( fop.r == rp );
+            winit( closure->outenvs[ fop.a ], read( x->function->outenvs[ fop.b ] ) );
+        }
+        else
+        {
+            break;
+        }
+        ++ip;
+    }
+    r[ rp ] = box_object( closure );
+    INEXT;
+}
+
+IOP( op_new_object )
+{
+    ISAVE;
+
+    // Get prototype.
+    vmachine* vm = x->vm;
+    value u = r[ op.a ];
+    lookup_object* prototype;
+    if ( box_is_object_type( u, LOOKUP_OBJECT ) )
+    {
+        prototype = (lookup_object*)unbox_object( u );
+    }
+    else if ( box_is_null( u ) )
+    {
+        prototype = vm->prototypes[ LOOKUP_OBJECT ];
+    }
+    else
+    {
+        type_error( x, ip, u, "a lookup object" );
+    }
+
+    // Set prototype on stack top.
+    r = resize_stack( vm, op.b + 1 );
+    r[ op.b ] = box_object( prototype );
+
+    // Set up stack frame for constructor call.
+    stack_frame* stack_frame = active_frame( vm );
+    stack_frame->ip = ip - x->ops;
+    stack_frame->resume = RESUME_CALL;
+    stack_frame->xr = op.b;
+    stack_frame->xb = op.b + 1;
+    stack_frame->rr = op.r;
+
+    // Call prototype with no arguments, and continue with constructor.
+    x->state = call_prototype( vm, prototype, op.b, op.b + 1 );
+    ISWITCH;
+}
+
+IOP( op_new_array )
+{
+    ISAVE;
+    r[ op.r ] = box_object( array_new( x->vm, op.c ) );
+    INEXT;
+}
+
+IOP( op_new_table )
+{
+    ISAVE;
+    r[ op.r ] = box_object( table_new( x->vm, op.c ) );
+    INEXT;
+}
+
+IOP( op_append )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    if ( ! box_is_object_type( u, ARRAY_OBJECT ) ) type_error( x, ip, u, "an array" );
+    array_object* array = (array_object*)unbox_object( u );
+    array_append( x->vm, array, r[ op.b ] );
+    INEXT;
+}
+
+IOP( op_call )
+{
+    ISAVE;
+    vmachine* vm = x->vm;
+
+    // First determine rp:xp for arguments.
+    unsigned rp = op.r;
+    if ( op.a != OP_STACK_MARK )
+    {
+        r = resize_stack( vm, x->xp = op.a );
+    }
+
+    // Store ip, xr:xb in current stack frame.
+    stack_frame* stack_frame = active_frame( vm );
+    stack_frame->ip = ip - x->ops;
+    stack_frame->resume = RESUME_CALL;
+    stack_frame->xr = op.r;
+    if ( op.opcode == OP_CALLR )
+    {
+        stack_frame->xb = op.r + 1;
+        stack_frame->rr = op.b;
+    }
+    else
+    {
+        stack_frame->xb = op.b;
+        stack_frame->rr = op.r;
+    }
+
+    if ( ! call_value( vm, r[ op.r ], rp, x->xp, op.opcode == OP_YCALL, &x->state ) )
+    {
+        type_error( x, ip, r[ op.r ], "a callable value" );
+    }
+
+    ISWITCH;
+}
+
+IOP( op_mcall )
+{
+    vmachine* vm = x->vm;
+
+    // Look up method on self using the call site's cache.
+    struct op sop = *ip++;
+    ISAVE;
+    method_site* site = read( x->function->program )->msites + sop.c;
+    lookup_object* keyer = keyer_of( vm, r[ op.r + 1 ] );
+#ifdef KF_SELECTOR_STATS
+    if ( site->way.cookie == read( keyer->layout )->cookie )
+    {
+        vm->selector_stats.mono_hits += 1;
+    }
+#endif
+    if ( site->way.cookie != read( keyer->layout )->cookie )
+    {
+        key_selector* ks = x->s + site->selector;
+        site->way = *lookup_getway( vm, keyer, read( ks->key ), &ks->sel );
+    }
+    value u = lookup_getway_value( keyer, &site->way );
+    r[ op.r ] = u;
+
+    // First determine rp:xp for arguments.
+    unsigned rp = op.r;
+    if ( op.a != OP_STACK_MARK )
+    {
+        r = resize_stack( vm, x->xp = op.a );
+    }
+
+    // Store ip, xr:xb in current stack frame.
+    stack_frame* stack_frame = active_frame( vm );
+    stack_frame->ip = ip - x->ops;
+    stack_frame->resume = RESUME_CALL;
+    stack_frame->xr = op.r;
+    if ( op.opcode == OP_MCALLR )
+    {
+        stack_frame->xb = op.r + 1;
+        stack_frame->rr = op.b;
+    }
+    else
+    {
+        stack_frame->xb = op.b;
+        stack_frame->rr = op.r;
+    }
+
+    // If the method is the same function as last time, skip dispatch.
+    object* callee = read( site->callee );
+    if ( box_is_object( u ) && unbox_object( u ) == callee )
+    {
+        if ( header( callee )->type == FUNCTION_OBJECT )
+            x->state = call_function( vm, (function_object*)callee, rp, x->xp );
+        else
+            x->state = call_native( vm, (native_function_object*)callee, rp, x->xp );
+    }
+    else
+    {
+        if ( ! call_value( vm, u, rp, x->xp, false, &x->state ) )
+        {
+            type_error( x, ip, r[ op.r ], "a callable value" );
+        }
+
+        // Remember functions which can be called without dispatch.
+        if ( box_is_object_type( u, FUNCTION_OBJECT ) )
+        {
+            function_object* callee_function = (function_object*)unbox_object( u );
+            if ( ( read( callee_function->program )->code_flags & CODE_GENERATOR ) == 0 )
+            {
+                write( vm, site->callee, (object*)callee_function );
+            }
+        }
+        else if ( box_is_object_type( u, NATIVE_FUNCTION_OBJECT ) )
+        {
+            write( vm, site->callee, unbox_object( u ) );
+        }
+    }
+
+    ISWITCH;
+}
+
+IOP( op_yield )
+{
+    ISAVE;
+    vmachine* vm = x->vm;
+
+    // First determine rp:xp for arguments.
+    unsigned rp = op.r;
+    if ( op.a != OP_STACK_MARK )
+    {
+        r = resize_stack( vm, x->xp = op.a );
+    }
+
+    // Store ip, xr:xb in current stack frame.
+    stack_frame* stack_frame = active_frame( vm );
+    stack_frame->ip = ip - x->ops;
+    stack_frame->resume = RESUME_YIELD;
+    stack_frame->xr = op.r;
+    stack_frame->xb = op.b;
+    stack_frame->rr = op.r;
+
+    // Yield.
+    x->state = call_yield( vm, rp, x->xp );
+
+    ISWITCH;
+}
+
+IOP( op_return )
+{
+    ISAVE;
+    vmachine* vm = x->vm;
+
+    // Determine rp:xp for arguments.
+    unsigned rp = op.r;
+    if ( op.a != OP_STACK_MARK )
+    {
+        r = resize_stack( vm, x->xp = op.a );
+    }
+
+    // Return.
+    x->state = call_return( vm, rp, x->xp );
+
+    ISWITCH;
+}
+
+IOP( op_vararg )
+{
+    ISAVE;
+    vmachine* vm = x->vm;
+
+    // Unpack varargs into r:b.
+    stack_frame* stack_frame = active_frame( vm );
+    unsigned rp = op.r;
+    unsigned xp = x->xp = op.b != OP_STACK_MARK ? op.b : rp + stack_frame->fp - stack_frame->bp;
+    r = resize_stack( vm, xp );
+    value* stack = entire_stack( vm );
+    size_t ap = stack_frame->bp;
+    size_t fp = stack_frame->fp;
+    while ( rp < xp )
+    {
+        r[ rp++ ] = ap < fp ? stack[ ap++ ] : null_value;
+    }
+    INEXT;
+}
+
+IOP( op_unpack )
+{
+    ISAVE;
+
+    // Unpack array elements from a into r:b.
+    value u = r[ op.a ];
+    if ( ! box_is_object_type( u, ARRAY_OBJECT ) ) type_error( x, ip, u, "an array" );
+    array_object* array = (array_object*)unbox_object( u );
+    unsigned rp = op.r;
+    unsigned xp = x->xp = op.b != OP_STACK_MARK ? op.b : rp + array->length;
+    r = resize_stack( x->vm, xp );
+    size_t i = 0;
+    while ( rp < xp )
+    {
+        r[ rp++ ] = i < array->length ? array_getindex( x->vm, array, i++ ) : null_value;
+    }
+    INEXT;
+}
+
+IOP( op_extend )
+{
+    ISAVE;
+
+    // Extend array in b with values in r:a.
+    value v = r[ op.b ];
+    if ( ! box_is_object_type( v, ARRAY_OBJECT ) ) type_error( x, ip, v, "an array" );
+    array_object* array = (array_object*)unbox_object( v );
+    unsigned rp = op.r;
+    if ( op.a != OP_STACK_MARK )
+    {
+        r = resize_stack( x->vm, x->xp = op.a );
+    }
+    assert( rp <= x->xp );
+    array_extend( x->vm, array, r + rp, x->xp - rp );
+    INEXT;
+}
+
+IOP( op_generate )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    r[ op.r + 0 ] = u;
+    if ( box_is_object( u ) )
+    {
+        type_code type = header( unbox_object( u ) )->type;
+        if ( type == ARRAY_OBJECT || is_typed_array_type( type ) )
+        {
+            r[ op.r + 1 ] = box_index( 0 );
+            INEXT;
+        }
+        else if ( type == TABLE_OBJECT )
+        {
+            uint64_t index = table_iterate( x->vm, (table_object*)unbox_object( u ) );
+            r[ op.r + 1 ] = box_index( index );
+            INEXT;
+        }
+        else if ( type == COTHREAD_OBJECT || type == GENERATOR_OBJECT )
+        {
+            INEXT;
+        }
+    }
+    else if ( box_is_string( u ) )
+    {
+        r[ op.r + 1 ] = box_index( 0 );
+        INEXT;
+    }
+    type_error( x, ip, u, "an iterable value" );
+}
+
+IOP( op_for_each )
+{
+    vmachine* vm = x->vm;
+    value g = r[ op.a + 0 ];
+    struct op jop = *ip++;
+    ISAVE;
+    unsigned rp = op.r;
+    if ( box_is_object( g ) )
+    {
+        type_code type = header( unbox_object( g ) )->type;
+        if ( type == ARRAY_OBJECT )
+        {
+            array_object* array = (array_object*)unbox_object( g );
+            size_t i = unbox_index( r[ op.a + 1 ] );
+            if ( i < array->length )
+            {
+                unsigned xp = x->xp = op.b != OP_STACK_MARK ? op.b : rp + 2;
+                r = resize_stack( vm, xp );
+                if ( rp < xp ) r[ rp++ ] = read( read( array->aslots )->slots[ i++ ] );
+                if ( rp < xp ) r[ rp++ ] = box_number( (double)i );
+                while ( rp < xp )
+                {
+                    r[ rp++ ] = null_value;
+                }
+                r[ op.a + 1 ] = box_index( i );
+            }
+            else
+            {
+                ip += jop.j;
+            }
+            INEXT;
+        }
+        else if ( is_typed_array_type( type ) )
+        {
+            typed_array_object* array = (typed_array_object*)unbox_object( g );
+            size_t i = unbox_index( r[ op.a + 1 ] );
+            if ( i < array->length )
+            {
+                unsigned xp = x->xp = op.b != OP_STACK_MARK ? op.b : rp + 2;
+                r = resize_stack( vm, xp );
+                if ( rp < xp ) r[ rp++ ] = typed_array_getindex( vm, array, i++ );
+                if ( rp < xp ) r[ rp++ ] = box_number( (double)i );
+                while ( rp < xp )
+                {
+                    r[ rp++ ] = null_value;
+                }
+                r[ op.a + 1 ] = box_index( i );
+            }
+            else
+            {
+                ip += jop.j;
+            }
+            INEXT;
+        }
+        else if ( type == TABLE_OBJECT )
+        {
+            table_object* table = (table_object*)unbox_object( g );
+            x->index = unbox_index( r[ op.a + 1 ] );
+            if ( table_next( vm, table, &x->index, &x->keyval ) )
+            {
+                unsigned xp = x->xp = op.b != OP_STACK_MARK ? op.b : rp + 2;
+                r = resize_stack( vm, xp );
+                if ( rp < xp ) r[ rp++ ] = x->keyval.k;
+                if ( rp < xp ) r[ rp++ ] = x->keyval.v;
+                while ( rp < xp )
+                {
+                    r[ rp++ ] = null_value;
+                }
+                r[ op.a + 1 ] = box_index( x->index );
+            }
+            else
+            {
+                ip += jop.j;
+            }
+            INEXT;
+        }
+        else if ( type == COTHREAD_OBJECT || type == GENERATOR_OBJECT )
+        {
+            // Resume generator with no arguments.
+            stack_frame* stack_frame = active_frame( vm );
+            stack_frame->ip = ip - x->ops;
+            stack_frame->resume = RESUME_FOR_EACH;
+            stack_frame->xr = op.r;
+            stack_frame->xb = op.b;
+            stack_frame->rr = op.r;
+
+            r[ rp ] = g;
+            x->state = type == COTHREAD_OBJECT
+                ? call_cothread( vm, (cothread_object*)unbox_object( g ), rp, rp + 1 )
+                : call_stackless( vm, (generator_object*)unbox_object( g ), rp, rp + 1 );
+            ISWITCH;
+        }
+    }
+    else if ( box_is_string( g ) )
+    {
+        string_object* string = unbox_string( g );
+        size_t i = unbox_index( r[ op.a + 1 ] );
+        if ( i < string->size )
+        {
+            unsigned xp = x->xp = op.b != OP_STACK_MARK ? op.b : rp + 2;
+            r = resize_stack( vm, xp );
+            if ( rp < xp ) r[ rp++ ] = box_string( string_getindex( vm, string, i++ ) );
+            while ( rp < xp )
+            {
+                r[ rp++ ] = null_value;
+                r[ op.a + 1 ] = box_index( i );
+            }
+        }
+        else
+        {
+            ip += jop.j;
+        }
+        INEXT;
+    }
+    type_error( x, ip, g, "an iterable value" );
+}
+
+IOP( op_for_step )
+{
+    value v0 = r[ op.a + 0 ];
+    value v1 = r[ op.a + 1 ];
+    value v2 = r[ op.a + 2 ];
+    if ( ! box_is_number( v0 ) ) type_error( x, ip, v0, "a number" );
+    if ( ! box_is_number( v1 ) ) type_error( x, ip, v1, "a number" );
+    if ( ! box_is_number( v2 ) ) type_error( x, ip, v2, "a number" );
+    double i = unbox_number( v0 );
+    double limit = unbox_number( v1 );
+    double step = unbox_number( v2 );
+    struct op jop = *ip++;
+    if ( step >= 0.0 ? i < limit : i > limit )
+    {
+        r[ op.r ] = box_number( i );
+        r[ op.a ] = box_number( i + step );
+    }
+    else
+    {
+        ip += jop.j;
+    }
+    INEXT;
+}
+
+IOP( op_concat )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_string( v ) ) type_error( x, ip, v, "a string" );
+    if ( ! box_is_string( u ) ) type_error( x, ip, u, "a string" );
+    r[ op.r ] = concat_strings( x->vm, unbox_string( u ), unbox_string( v ) );
+    INEXT;
+}
+
+IOP( op_concats )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    if ( ! box_is_string( u ) ) type_error( x, ip, u, "a string" );
+    r[ op.r ] = concat_strings( x->vm, unbox_string( u ), unbox_string( read( k[ op.b ] ) ) );
+    INEXT;
+}
+
+IOP( op_rconcats )
+{
+    ISAVE;
+    value v = r[ op.a ];
+    if ( ! box_is_string( v ) ) type_error( x, ip, v, "a string" );
+    r[ op.r ] = concat_strings( x->vm, unbox_string( read( k[ op.b ] ) ), unbox_string( v ) );
+    INEXT;
+}
+
+IOP( op_bitnot )
+{
+    value u = r[ op.a ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    r[ op.r ] = box_number( ibitnot( unbox_number( u ) ) );
+    INEXT;
+}
+
+IOP( op_lshift )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( ilshift( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_rshift )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( irshift( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_ashift )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( iashift( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_bitand )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( ibitand( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_bitxor )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( ibitxor( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_bitor )
+{
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    if ( ! box_is_number( u ) ) type_error( x, ip, u, "a number" );
+    if ( ! box_is_number( v ) ) type_error( x, ip, v, "a number" );
+    r[ op.r ] = box_number( ibitor( unbox_number( u ), unbox_number( v ) ) );
+    INEXT;
+}
+
+IOP( op_len )
+{
+    value u = r[ op.a ];
+    if ( box_is_object( u ) )
+    {
+        type_code type = header( unbox_object( u ) )->type;
+        if ( type == ARRAY_OBJECT )
+        {
+            r[ op.r ] = box_number( (double)( (array_object*)unbox_object( u ) )->length );
+            INEXT;
+        }
+        else if ( type == TABLE_OBJECT )
+        {
+            r[ op.r ] = box_number( (double)( (table_object*)unbox_object( u ) )->length );
+            INEXT;
+        }
+        else if ( is_typed_array_type( type ) )
+        {
+            r[ op.r ] = box_number( (double)( (typed_array_object*)unbox_object( u ) )->length );
+            INEXT;
+        }
+    }
+    else if ( box_is_string( u ) )
+    {
+        r[ op.r ] = box_number( (double)unbox_string( u )->size );
+        INEXT;
+    }
+    type_error( x, ip, u, "an indexable value" );
+}
+
+IOP( op_is )
+{
+    ISAVE;
+    value u = r[ op.a ];
+    value v = r[ op.b ];
+    bool test = false;
+    if ( box_is_number( v ) )
+    {
+        test = box_is_number( u ) && unbox_number( u ) == unbox_number( v );
+    }
+    else if ( u.v == v.v )
+    {
+        test = true;
+    }
+    else if ( box_is_string( v ) )
+    {
+        test = box_is_string( u ) && string_equal( unbox_string( u ), unbox_string( v ) );
+    }
+    else if ( box_is_object( v ) )
+    {
+        type_code type = header( unbox_object( v ) )->type;
+        if ( type == LOOKUP_OBJECT )
+        {
+            lookup_object* vo = (lookup_object*)unbox_object( v );
+            lookup_object* uo = keyer_of( x->vm, u );
+            while ( uo )
+            {
+                if ( uo == vo )
+                {
+                    test = true;
+                    break;
+                }
+                uo = lookup_prototype( x->vm, uo );
+            }
+        }
+    }
+    r[ op.r ] = test ? true_value : false_value;
+    INEXT;
+}
+
+IOP( op_super )
+{
+    ISAVE;
+    lookup_object* omethod = read( x->function->omethod );
+    r[ op.r ] = box_object( lookup_prototype( x->vm, omethod ) );
+    INEXT;
+}
+
+IOP( op_throw )
+{
+    ISAVE;
+    throw_value( r[ op.a ] );
+}
+
+IOP( op_orphan )
+{
+    assert( ! "orphan environment op" );
+    INEXT;
+}
@@ -0,0 +1,132 @@
+//
+//  execute_tail.cpp
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifdef TAIL_CALL
+
+#include "execute.h"
+#include "vmachine.h"
+#include "call_stack.h"
+#include "collector.h"
+#include "../common/code.h"
+#include "../common/imath.h"
+#include "objects/lookup_object.h"
+#include "objects/string_object.h"
+#include "objects/array_object.h"
+#include "objects/table_object.h"
+#include "objects/typed_array_object.h"
+#include "objects/cothread_object.h"
+#include "objects/function_object.h"
+
+/*
+    Tail-call threaded interpreter.
+
+    Each instruction is implemented by a separate handler function.  Handlers
+    finish by tail calling the handler for the next instruction, passing the
+    hot interpreter state (register window, instruction pointer, constants,
+    and the decoded instruction) in argument registers.  Each handler is a
+    small function, so the compiler allocates registers for it separately,
+    and every handler ends with its own indirect branch.
+
+    Handlers must not take the address of any local variable, or the
+    compiler cannot turn the final call into a jump.  Results which are
+    returned through pointers are stored in the xcontext instead.
+
+    Before calling anything which might throw, a handler stores its
+    instruction pointer in the xcontext so that the exception can be unwound
+    with the correct source location.
+
+    Without a guaranteed tail call, the handlers would recurse on the native
+    stack, so this interpreter requires a compiler which supports musttail.
+*/
+
+#if defined( __has_cpp_attribute )
+#if __has_cpp_attribute( clang::musttail )
+#define MUSTTAIL [[clang::musttail]]
+#elif __has_cpp_attribute( gnu::musttail )
+#define MUSTTAIL [[gnu::musttail]]
+#endif
+#endif
+
+#ifndef MUSTTAIL
+#error "TAIL_CALL requires a compiler which supports musttail"
+#endif
+
+namespace kf
+{
+
+typedef void (*handler)( xcontext* x, value* r, op* ip, ref_value* k, struct op op );
+extern const handler xhandlers[];
+
+#define IOP( name ) static void name( xcontext* x, value* r, op* ip, ref_value* k, struct op op )
+
+#define INEXT       do { struct op nop = *ip++; MUSTTAIL return xhandlers[ nop.opcode ]( x, r, ip, k, nop ); } while ( false )
+
+#define IGOTO( name ) do { MUSTTAIL return name( x, r, ip, k, op ); } while ( false )
+
+#define ISWITCH     do { if ( ! x->state.function ) return; enter_function( x ); r = x->state.r; ip = x->ops + x->state.ip; k = x->k; IENTER; INEXT; } while ( false )
+
+#ifndef KF_JIT
+
+// Backward jumps are safepoints, so that loops which allocate can collect.
+#define IJUMP( j )  do { ip += j; if ( j < 0 && safepoint_due( x->vm ) ) safepoint( x->vm ); } while ( false )
+#define IENTER
+
+#else
+
+// Compiled code is entered at function entry, at resume points, and at loop
+// headers.  It returns once execution reaches a function which has not been
+// compiled.
+#define IJUMP( j )  do { ip += j; if ( j < 0 ) { if ( safepoint_due( x->vm ) ) safepoint( x->vm ); if ( jit_loop( x ) ) { x->state = { x->function, r, (unsigned)( ip - x->ops ), x->xp }; IENTER; } } } while ( false )
+#define IENTER      do { if ( x->jit ) { jit_execute( x ); if ( x->exception ) jit_rethrow( x ); if ( ! x->state.function ) return; r = x->state.r; ip = x->ops + x->state.ip; k = x->k; } } while ( false )
+
+#endif
+
+#define ISAVE       x->ip = ip
+
+#include "execute_ops.h"
+
+const handler xhandlers[] =
+{
+#define X( opcode, name ) [ opcode ] = name,
+    EXECUTE_OPS( X )
+#undef X
+};
+
+void execute( vmachine* vm, xstate state )
+{
+    xcontext context;
+    xcontext* x = &context;
+    x->vm = vm;
+    x->state = state;
+    enter_function( x );
+
+    value* r = state.r;
+    op* ip = x->ops + state.ip;
+    ref_value* k = x->k;
+    x->ip = ip;
+
+    try
+    {
+        IENTER;
+        x->ip = ip;
+        struct op op = *ip++;
+        xhandlers[ op.opcode ]( x, r, ip, k, op );
+    }
+    catch ( ... )
+    {
+        unwind( vm, x->ip - x->ops );
+        throw;
+    }
+}
+
+}
+
+#endif
+
@@ -15,11 +15,14 @@
 #include <stdio.h>
 #include <new>
 #include <functional>
+#include <algorithm>
 
 #ifdef _WIN32
 #include <windows.h>
 #else
 #include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
 #endif
 
 #ifdef _MSC_VER
@@ -55,14 +58,24 @@ static inline uint32_t ctz( uint32_t x )
 
 /*
     Allocate and free virtual memory from the system.
+
+    Free pages can be released back to the system without freeing the address
+    space.  Released pages read as zero, or keep their old contents, when they
+    are next touched.
+
+    With huge pages, segments are aligned to the huge page size so that the
+    system can back them with transparent huge pages.  Windows only supports
+    huge pages with special privileges, so the flag is ignored there, and the
+    resident size of a segment is its whole size.
 */
 
 const size_t HEAP_INITIAL_SIZE = 1024 * 1024;
 const size_t HEAP_VM_GRANULARITY = 1024 * 1024;
+const size_t HEAP_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
 
 #ifdef _WIN32
 
-void* heap_vmalloc( size_t size )
+void* heap_vmalloc( size_t size, bool huge_pages )
 {
     void* p = VirtualAlloc( NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
     if ( p == NULL )
@@ -77,15 +90,50 @@ void heap_vmfree( void* p, size_t size )
     VirtualFree( p, 0, MEM_RELEASE );
 }
 
+void heap_vmrelease( void* p, size_t size )
+{
+    VirtualAlloc( p, size, MEM_RESET, PAGE_READWRITE );
+}
+
+size_t heap_vmresident( void* p, size_t size )
+{
+    return size;
+}
+
+size_t heap_vmpage_size()
+{
+    return 4096;
+}
+
 #else
 
-void* heap_vmalloc( size_t size )
+size_t heap_vmpage_size()
 {
-    void* p = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    static const size_t page_size = sysconf( _SC_PAGESIZE );
+    return page_size;
+}
+
+void* heap_vmalloc( size_t size, bool huge_pages )
+{
+    // Over-allocate so the segment can be aligned to a huge page.
+    size_t align = huge_pages ? HEAP_HUGE_PAGE_SIZE : 0;
+    char* p = (char*)mmap( nullptr, size + align, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
     if ( p == MAP_FAILED )
     {
         throw std::bad_alloc();
     }
+
+    if ( huge_pages )
+    {
+        char* q = (char*)( ( (uintptr_t)p + align - 1 ) & ~( align - 1 ) );
+        if ( q > p ) munmap( p, q - p );
+        if ( q < p + align ) munmap( q + size, p + align - q );
+        p = q;
+#ifdef MADV_HUGEPAGE
+        madvise( p, size, MADV_HUGEPAGE );
+#endif
+    }
+
     return p;
 }
 
@@ -94,6 +142,32 @@ void heap_vmfree( void* p, size_t size )
     munmap( p, size );
 }
 
+void heap_vmrelease( void* p, size_t size )
+{
+    madvise( p, size, MADV_DONTNEED );
+}
+
+size_t heap_vmresident( void* p, size_t size )
+{
+    size_t page_size = heap_vmpage_size();
+    std::vector< unsigned char > pages( ( size + page_size - 1 ) / page_size );
+#ifdef __APPLE__
+    if ( mincore( p, size, (char*)pages.data() ) != 0 )
+#else
+    if ( mincore( p, size, pages.data() ) != 0 )
+#endif
+    {
+        return size;
+    }
+
+    size_t resident = 0;
+    for ( unsigned char page : pages )
+    {
+        resident += page & 1;
+    }
+    return resident * page_size;
+}
+
 #endif
 
 /*
@@ -144,13 +218,28 @@ void heap_vmfree( void* p, size_t size )
     allocated.
 
     Chunks are 8-byte aligned with a maximum size of just under 4GiB.
+
+    Chunks which are part of a slab (see below) have the S bit set:
+
+        --> u16 offset to slab / u16 size of chunk / S / U / 1
+            u32 word
 */
 
 const size_t HEAP_CHUNK_ALIGNMENT = 8;
 const size_t HEAP_MIN_BINNED_SIZE = 8 + sizeof( void* ) * 3;
 
+/*
+    The word in the header of a free chunk tracks whether its pages have been
+    released to the system.  HEAP_WORD_IDLE counts the number of times a
+    chunk has been seen, unchanged, by heap_release.  Splitting or merging a
+    chunk resets its word to HEAP_WORD_FREE.
+*/
+
 const uint32_t HEAP_WORD_INTERNAL = 0xDEFDEF;
 const uint32_t HEAP_WORD_FREE = 0xFEEFEE;
+const uint32_t HEAP_WORD_IDLE = 0x1D1E00;
+const uint32_t HEAP_WORD_RELEASED = 0x5EEDED;
+const uint32_t HEAP_MAX_IDLE = 0xFF;
 
 struct heap_chunk_header
 {
@@ -162,6 +251,8 @@ struct heap_chunk_header
     size_t size() const;
     bool p() const;
     bool u() const;
+    bool s() const;
+    size_t slab_offset() const;
     void set_p();
     void clear_p();
 };
@@ -176,7 +267,7 @@ inline heap_chunk_header::heap_chunk_header( bool p, bool u, size_t size, uint32
 
 inline size_t heap_chunk_header::size() const
 {
-    return p_u_size & ~3;
+    return p_u_size & ( s() ? 0xFFF8 : ~(uint32_t)7 );
 }
 
 inline bool heap_chunk_header::p() const
@@ -189,6 +280,17 @@ inline bool heap_chunk_header::u() const
     return p_u_size & 2;
 }
 
+inline bool heap_chunk_header::s() const
+{
+    return p_u_size & 4;
+}
+
+inline size_t heap_chunk_header::slab_offset() const
+{
+    assert( s() );
+    return ( p_u_size >> 16 ) * 8;
+}
+
 inline void heap_chunk_header::set_p()
 {
     p_u_size |= 1;
@@ -722,6 +824,58 @@ void heap_largebin::debug_print( size_t index, int level, uint32_t prefix, heap_
     }
 }
 
+/*
+    Small chunks are allocated from slabs.  A slab is an allocated chunk which
+    is divided into cells of the same size:
+
+        --> u32 size of slab    / S / U / P
+            u32 word
+          & heap_slab
+        --- cell                / S / U / 1
+            ...
+        --- cell                / S / U / 1
+        --- next chunk          / U / 1
+
+    Each cell has a chunk header which records the offset back to the start of
+    the slab.  Free cells are linked into the slab's free list, and cells that
+    have never been allocated are covered by a single free cell at the end of
+    the slab.  This means that the heap walker can step through a slab one
+    cell at a time.
+
+    Slabs with free cells are linked into a list for their size class.  When
+    the last cell in a slab is freed, the slab is released, unless it is the
+    only slab for its size class.
+*/
+
+const size_t HEAP_SLAB_SIZE = 16 * 1024;
+const size_t HEAP_MIN_CELL_SIZE = 16;
+
+struct heap_slab
+{
+    heap_chunk_header header;
+    heap_slab* next;
+    heap_slab* prev;
+    heap_chunk* free_list;
+    char* bump;
+    char* limit;
+    uint32_t cell_size;
+    uint32_t cell_count;
+};
+
+inline heap_slab* heap_cell_slab( heap_chunk* cell )
+{
+    return (heap_slab*)( (char*)cell - cell->header.slab_offset() );
+}
+
+inline void heap_cell_set( heap_slab* slab, heap_chunk* cell, size_t size, bool u )
+{
+    size_t offset = (char*)cell - (char*)slab;
+    assert( offset % 8 == 0 && offset / 8 <= 0xFFFF );
+    assert( size <= 0xFFF8 );
+    cell->header.p_u_size = (uint32_t)( offset / 8 ) << 16 | (uint32_t)size | 4 | ( u ? 2 : 0 ) | 1;
+    cell->header.word = u ? 0 : HEAP_WORD_FREE;
+}
+
 /*
     Main heap data structure, at the start of the initial segment.  Note that
     smallbin_anchors are the sentinel nodes in doubly-linked lists of chunks.
@@ -730,7 +884,7 @@ void heap_largebin::debug_print( size_t index, int level, uint32_t prefix, heap_
 
 struct heap_state
 {
-    explicit heap_state( size_t segment_size );
+    heap_state( size_t segment_size, unsigned flags );
     ~heap_state();
 
     heap_chunk_header header;
@@ -738,14 +892,22 @@ struct heap_state
     uint32_t largebin_map;
     uint32_t victim_size;
     uint32_t segment_size;
+    uint32_t flags;
     heap_segment* segments;
     heap_chunk* victim;
     heap_chunk* smallbin_anchors[ HEAP_SMALLBIN_COUNT * 2 ];
     heap_largebin largebins[ HEAP_LARGEBIN_COUNT ];
+    heap_slab* slabs[ HEAP_SMALLBIN_COUNT ];
 
     void* malloc( size_t size );
     void free( void* p );
 
+    void* malloc_chunk( size_t size );
+    void* malloc_cell( size_t size );
+    void free_cell( heap_chunk* cell );
+    heap_slab* alloc_slab( size_t index, size_t cell_size );
+    void free_slab( size_t index, heap_slab* slab );
+
     heap_chunk* smallbin_anchor( size_t i );
     void insert_chunk( size_t size, heap_chunk* chunk );
     void remove_chunk( size_t size, heap_chunk* chunk );
@@ -758,19 +920,25 @@ struct heap_state
 
     void* sweep( void* p, bool free_chunk );
 
+    size_t release( size_t min_size, unsigned idle_count );
+    size_t release_chunk( heap_chunk* chunk, size_t page_size, unsigned idle_count );
+
+    void statistics( heap_info* info );
     void debug_print();
 };
 
-heap_state::heap_state( size_t segment_size )
+heap_state::heap_state( size_t segment_size, unsigned flags )
     :   header{ true, true, sizeof( heap_state ), 0 }
     ,   smallbin_map( 0 )
     ,   largebin_map( 0 )
     ,   victim_size( 0 )
     ,   segment_size( segment_size )
+    ,   flags( flags )
     ,   segments( nullptr )
     ,   victim( nullptr )
     ,   smallbin_anchors{}
     ,   largebins{}
+    ,   slabs{}
 {
     // Initialize anchors.
     for ( size_t i = 0; i < HEAP_SMALLBIN_COUNT; ++i )
@@ -827,6 +995,18 @@ void* heap_state::malloc( size_t size )
         throw std::bad_alloc();
     }
 
+    // Small chunks are allocated from slabs.
+    if ( size < HEAP_LARGE_SIZE )
+    {
+        return malloc_cell( size );
+    }
+
+    return malloc_chunk( size );
+}
+
+void* heap_state::malloc_chunk( size_t size )
+{
+    assert( size % HEAP_CHUNK_ALIGNMENT == 0 );
     heap_chunk* chunk = nullptr;
     size_t chunk_size = 0;
 
@@ -1013,6 +1193,14 @@ void heap_state::free( void* p )
     // We don't have much context, but assert that the chunk is allocated.
     heap_chunk* chunk = heap_chunk_head( p );
     assert( chunk->header.u() );
+
+    // Cells are returned to their slab.
+    if ( chunk->header.s() && chunk->header.slab_offset() )
+    {
+        free_cell( chunk );
+        return;
+    }
+
     size_t size = chunk->header.size();
 
     // Attempt to merge with previous chunk.
@@ -1080,6 +1268,132 @@ void heap_state::free( void* p )
     }
 }
 
+void* heap_state::malloc_cell( size_t size )
+{
+    size = std::max( size, HEAP_MIN_CELL_SIZE );
+    size_t index = heap_smallbin_index( size );
+
+    heap_slab* slab = slabs[ index ];
+    if ( ! slab )
+    {
+        slab = alloc_slab( index, size );
+    }
+
+    heap_chunk* cell = slab->free_list;
+    if ( cell )
+    {
+        // Reuse a free cell.
+        slab->free_list = cell->next;
+    }
+    else
+    {
+        // Allocate from the unused space at the end of the slab.
+        assert( slab->bump + size <= slab->limit );
+        cell = (heap_chunk*)slab->bump;
+        slab->bump += size;
+        if ( slab->bump < slab->limit )
+        {
+            heap_cell_set( slab, (heap_chunk*)slab->bump, slab->limit - slab->bump, false );
+        }
+    }
+
+    heap_cell_set( slab, cell, size, true );
+    slab->cell_count += 1;
+
+    // Unlink full slabs.
+    if ( ! slab->free_list && slab->bump + size > slab->limit )
+    {
+        slabs[ index ] = slab->next;
+        if ( slab->next )
+        {
+            slab->next->prev = nullptr;
+        }
+        slab->next = nullptr;
+        slab->prev = nullptr;
+    }
+
+    return heap_chunk_data( cell );
+}
+
+void heap_state::free_cell( heap_chunk* cell )
+{
+    heap_slab* slab = heap_cell_slab( cell );
+    size_t size = cell->header.size();
+    assert( size == slab->cell_size );
+    size_t index = heap_smallbin_index( size );
+
+    // Link full slab back into list for this size class.
+    bool was_full = ! slab->free_list && slab->bump + size > slab->limit;
+    if ( was_full )
+    {
+        slab->prev = nullptr;
+        slab->next = slabs[ index ];
+        if ( slab->next )
+        {
+            slab->next->prev = slab;
+        }
+        slabs[ index ] = slab;
+    }
+
+    // Add cell to free list.
+    heap_cell_set( slab, cell, size, false );
+    cell->next = slab->free_list;
+    slab->free_list = cell;
+
+    // Release empty slabs, keeping at least one.
+    slab->cell_count -= 1;
+    if ( slab->cell_count == 0 && ( slab->prev || slab->next ) )
+    {
+        free_slab( index, slab );
+    }
+}
+
+heap_slab* heap_state::alloc_slab( size_t index, size_t cell_size )
+{
+    // Slab is an allocated chunk.  Its real size might be slightly larger.
+    heap_slab* slab = (heap_slab*)heap_chunk_head( malloc_chunk( HEAP_SLAB_SIZE ) );
+    size_t slab_size = slab->header.size();
+    assert( slab_size <= 0xFFF8 );
+    slab->header.p_u_size |= 4;
+    slab->header.word = HEAP_WORD_INTERNAL;
+
+    slab->next = nullptr;
+    slab->prev = nullptr;
+    slab->free_list = nullptr;
+    slab->bump = (char*)( slab + 1 );
+    slab->limit = (char*)slab + slab_size;
+    slab->cell_size = cell_size;
+    slab->cell_count = 0;
+
+    // Cover unused space with a single free cell.
+    heap_cell_set( slab, (heap_chunk*)slab->bump, slab->limit - slab->bump, false );
+
+    slabs[ index ] = slab;
+    return slab;
+}
+
+void heap_state::free_slab( size_t index, heap_slab* slab )
+{
+    // Unlink from list.
+    if ( slab->prev )
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        assert( slabs[ index ] == slab );
+        slabs[ index ] = slab->next;
+    }
+    if ( slab->next )
+    {
+        slab->next->prev = slab->prev;
+    }
+
+    // Free as an ordinary chunk.
+    slab->header.p_u_size &= ~(uint32_t)4;
+    free( heap_chunk_data( (heap_chunk*)slab ) );
+}
+
 heap_chunk* heap_state::smallbin_anchor( size_t i )
 {
     assert( i < HEAP_SMALLBIN_COUNT );
@@ -1180,11 +1494,13 @@ heap_chunk* heap_state::remove_large_chunk( size_t index, heap_chunk* chunk )
 heap_chunk* heap_state::alloc_segment( size_t size )
 {
     // Add space for segment header, and align to VM allocation granularity.
+    bool huge_pages = flags & HEAP_HUGE_PAGES;
+    size_t granularity = huge_pages ? HEAP_HUGE_PAGE_SIZE : HEAP_VM_GRANULARITY;
     size += sizeof( heap_segment );
-    size = ( size + ( HEAP_VM_GRANULARITY - 1 ) ) & ~( HEAP_VM_GRANULARITY - 1 );
+    size = ( size + ( granularity - 1 ) ) & ~( granularity - 1 );
 
     // Make VM allocation.
-    void* vmalloc = heap_vmalloc( size );
+    void* vmalloc = heap_vmalloc( size, huge_pages );
 
     // Add segment.
     heap_chunk* segment_chunk = (heap_chunk*)( (char*)vmalloc + size - sizeof( heap_segment ) );
@@ -1351,6 +1667,13 @@ void* heap_state::sweep( void* p, bool free_chunk )
             c = (heap_chunk*)s->base;
         }
 
+        // Step into slabs, visiting each cell.
+        if ( c->header.s() && ! c->header.slab_offset() )
+        {
+            c = (heap_chunk*)( (heap_slab*)c + 1 );
+            continue;
+        }
+
         // Check for allocated chunk.
         if ( c->header.u() )
         {
@@ -1372,6 +1695,114 @@ void* heap_state::sweep( void* p, bool free_chunk )
     return q;
 }
 
+size_t heap_state::release( size_t min_size, unsigned idle_count )
+{
+    // Release whole huge pages, to avoid splitting them.
+    size_t page_size = flags & HEAP_HUGE_PAGES ? HEAP_HUGE_PAGE_SIZE : heap_vmpage_size();
+    min_size = std::max( { min_size, page_size, HEAP_LARGE_SIZE } );
+    size_t released = 0;
+
+    if ( victim && victim_size >= min_size )
+    {
+        released += release_chunk( victim, page_size, idle_count );
+    }
+
+    // Walk the trees of large bins which can hold chunks this size.  Each
+    // level of a tree selects using one bit of the size.
+    for ( size_t index = heap_largebin_index( min_size ); index < HEAP_LARGEBIN_COUNT; ++index )
+    {
+        if ( ! ( largebin_map & 1u << index ) )
+        {
+            continue;
+        }
+
+        heap_chunk* stack[ sizeof( uint32_t ) * CHAR_BIT + 1 ];
+        size_t stack_count = 0;
+        stack[ stack_count++ ] = largebins[ index ].root;
+        while ( stack_count )
+        {
+            heap_chunk* node = stack[ --stack_count ];
+            heap_chunk* chunk = node;
+            do
+            {
+                if ( chunk->header.size() >= min_size )
+                {
+                    released += release_chunk( chunk, page_size, idle_count );
+                }
+                chunk = chunk->next;
+            }
+            while ( chunk != node );
+
+            for ( heap_chunk* child : node->child )
+            {
+                if ( child )
+                {
+                    assert( stack_count < sizeof( stack ) / sizeof( stack[ 0 ] ) );
+                    stack[ stack_count++ ] = child;
+                }
+            }
+        }
+    }
+
+    return released;
+}
+
+size_t heap_state::release_chunk( heap_chunk* chunk, size_t page_size, unsigned idle_count )
+{
+    uint32_t word = chunk->header.word;
+    if ( word == HEAP_WORD_RELEASED )
+    {
+        return 0;
+    }
+
+    // Wait until the chunk has been free for long enough.
+    unsigned idle = ( word & ~HEAP_MAX_IDLE ) == HEAP_WORD_IDLE ? word & HEAP_MAX_IDLE : 0;
+    if ( idle < std::min( idle_count, HEAP_MAX_IDLE ) )
+    {
+        chunk->header.word = HEAP_WORD_IDLE | ( idle + 1 );
+        return 0;
+    }
+
+    // Release pages between the chunk's links and its footer.
+    chunk->header.word = HEAP_WORD_RELEASED;
+    uintptr_t lower = ( (uintptr_t)( chunk + 1 ) + page_size - 1 ) & ~( page_size - 1 );
+    uintptr_t upper = ( (uintptr_t)chunk + chunk->header.size() - sizeof( heap_chunk_footer ) ) & ~( page_size - 1 );
+    if ( lower >= upper )
+    {
+        return 0;
+    }
+
+    heap_vmrelease( (void*)lower, upper - lower );
+    return upper - lower;
+}
+
+void heap_state::statistics( heap_info* info )
+{
+    for ( heap_segment* s = segments; s; s = s->next )
+    {
+        info->segment_count += 1;
+        info->segment_bytes += heap_segment_size( s );
+        info->resident_bytes += heap_vmresident( s->base, heap_segment_size( s ) );
+
+        // Slabs count as allocated, including their free cells.
+        heap_chunk* c = (heap_chunk*)s->base;
+        while ( c != (heap_chunk*)s )
+        {
+            size_t size = c->header.size();
+            if ( c->header.u() )
+            {
+                info->allocated_bytes += size;
+            }
+            else
+            {
+                info->free_bytes += size;
+                info->largest_free = std::max( info->largest_free, size );
+            }
+            c = heap_chunk_next( c, size );
+        }
+    }
+}
+
 void heap_state::debug_print()
 {
     printf( "HEAP %p:\n", this );
@@ -1443,9 +1874,11 @@ void heap_state::debug_print()
     Heap interface.
 */
 
-heap_state* heap_create()
+heap_state* heap_create( unsigned flags )
 {
-    return new ( heap_vmalloc( HEAP_INITIAL_SIZE ) ) heap_state( HEAP_INITIAL_SIZE );
+    bool huge_pages = flags & HEAP_HUGE_PAGES;
+    size_t size = huge_pages ? HEAP_HUGE_PAGE_SIZE : HEAP_INITIAL_SIZE;
+    return new ( heap_vmalloc( size, huge_pages ) ) heap_state( size, flags );
 }
 
 void heap_destroy( heap_state* heap )
@@ -1477,6 +1910,16 @@ void* heap_sweep( heap_state* heap, void* p, bool free_chunk )
     return heap->sweep( p, free_chunk );
 }
 
+size_t heap_release( heap_state* heap, size_t min_size, unsigned idle_count )
+{
+    return heap->release( min_size, idle_count );
+}
+
+void heap_statistics( heap_state* heap, heap_info* info )
+{
+    heap->statistics( info );
+}
+
 void debug_print( heap_state* heap )
 {
     heap->debug_print();
@@ -1720,6 +2163,13 @@ int main( int argc, char* argv[] )
                 ok = false;
             assert( ok );
         }
+
+        printf( "-------- RELEASE\n" );
+
+        heap_release( state, 0, rand() % 2 );
+        debug_print( state );
+        bool ok = check_bins( state );
+        assert( ok );
     }
 
     for ( const alloc& a : allocs )
@@ -20,6 +20,9 @@
 
     Based on Doug Lea's dlmalloc.  http://gee.cs.oswego.edu/dl/html/malloc.html
 
+    Small blocks are allocated from slabs of blocks of the same size, without
+    coalescing.  The heap walker visits each block in a slab.
+
     The allocator is not synchronized internally.  Access from multiple threads
     must be synchronized by the user.
 */
@@ -31,7 +34,13 @@ namespace kf
 
 struct heap_state;
 
-heap_state* heap_create();
+enum heap_flags
+{
+    HEAP_NONE       = 0,
+    HEAP_HUGE_PAGES = 1 << 0,   // Align segments so they can use huge pages.
+};
+
+heap_state* heap_create( unsigned flags = HEAP_NONE );
 void heap_destroy( heap_state* heap );
 
 /*
@@ -49,6 +58,30 @@ void heap_free( heap_state* heap, void* p );
 
 void* heap_sweep( heap_state* heap, void* p, bool free_chunk );
 
+/*
+    Releasing memory.  Returns the pages of free chunks of at least min_size
+    bytes to the system, once heap_release has seen them free and unchanged
+    idle_count times before.  Returns the number of bytes released.
+*/
+
+size_t heap_release( heap_state* heap, size_t min_size, unsigned idle_count );
+
+/*
+    Statistics.  Walks the heap, adding to the totals in info.
+*/
+
+struct heap_info
+{
+    size_t segment_count;
+    size_t segment_bytes;
+    size_t resident_bytes;
+    size_t allocated_bytes;
+    size_t free_bytes;
+    size_t largest_free;
+};
+
+void heap_statistics( heap_state* heap, heap_info* info );
+
 /*
     Debugging.
 */
@@ -0,0 +1,74 @@
+//
+//  heap_snapshot.h
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifndef KF_HEAP_SNAPSHOT_H
+#define KF_HEAP_SNAPSHOT_H
+
+/*
+    Heap snapshot file format.  Snapshots are written by write_heap_snapshot
+    and read by the kenaf-heap tool.  All integers are little-endian.
+
+        header      char magic[ 8 ]         "KFHEAP\0\0"
+                    uint32_t version        SNAPSHOT_VERSION
+                    uint32_t type_count
+
+        types       uint8_t type            type code, one per type
+                    uint8_t name_length
+                    char name[ name_length ]
+
+    Followed by a sequence of records, each starting with a uint8_t tag:
+
+        root        uint8_t tag             SNAPSHOT_ROOT
+                    uint8_t kind            snapshot_root_kind
+                    uint64_t id
+
+        object      uint8_t tag             SNAPSHOT_OBJECT
+                    uint64_t id             address of object
+                    uint8_t type
+                    uint32_t size           size of heap allocation
+                    uint8_t label_length
+                    char label[ label_length ]
+                    uint32_t ref_count
+                    uint64_t refs[ ref_count ]
+
+        end         uint8_t tag             SNAPSHOT_END
+
+    Each reference is the id of another object in the snapshot.  Labels are
+    the text of strings and the names of functions and scripts, truncated.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace kf
+{
+
+const char SNAPSHOT_MAGIC[ 8 ] = { 'K', 'F', 'H', 'E', 'A', 'P', 0, 0 };
+const uint32_t SNAPSHOT_VERSION = 1;
+const size_t SNAPSHOT_LABEL_LENGTH = 64;
+
+enum snapshot_tag : uint8_t
+{
+    SNAPSHOT_END,
+    SNAPSHOT_ROOT,
+    SNAPSHOT_OBJECT,
+};
+
+enum snapshot_root_kind : uint8_t
+{
+    SNAPSHOT_ROOT_HANDLE,       // Value retained by native code.
+    SNAPSHOT_ROOT_GLOBAL,       // Global object of a context.
+    SNAPSHOT_ROOT_COTHREAD,     // Running or suspended cothread of a context.
+    SNAPSHOT_ROOT_KEY,          // Internal key.
+};
+
+}
+
+#endif
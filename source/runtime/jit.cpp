@@ -0,0 +1,832 @@
+//
+//  jit.cpp
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "jit.h"
+
+#if defined( KF_JIT ) && defined( __x86_64__ ) && ! defined( _WIN32 )
+
+#include <stdlib.h>
+#include <vector>
+#include <sys/mman.h>
+#include "execute.h"
+#include "call_stack.h"
+#include "collector.h"
+#include "../common/code.h"
+#include "../common/imath.h"
+#include "objects/lookup_object.h"
+#include "objects/string_object.h"
+#include "objects/array_object.h"
+#include "objects/table_object.h"
+#include "objects/typed_array_object.h"
+#include "objects/cothread_object.h"
+#include "objects/function_object.h"
+
+namespace kf
+{
+
+/*
+    Handlers called from compiled code.  Each returns the address of the
+    next instruction to execute, or null if compiled code should return to
+    the interpreter.  Handlers which call or return switch frames, leaving
+    the new register window in x->state.r.
+*/
+
+typedef op* (*jit_helper)( xcontext* x, value* r, op* ip, ref_value* k, struct op op );
+
+#define IOP( name ) static op* name( xcontext* x, value* r, op* ip, ref_value* k, struct op op )
+#define INEXT       return ip
+#define IGOTO( name ) return name( x, r, ip, k, op )
+#define IJUMP( j )  do { ip += j; if ( j < 0 && safepoint_due( x->vm ) ) safepoint( x->vm ); } while ( false )
+#define ISWITCH     do { if ( ! x->state.function ) return nullptr; enter_function( x ); return x->jit ? x->ops + x->state.ip : nullptr; } while ( false )
+#define ISAVE       x->ip = ip
+
+#include "execute_ops.h"
+
+template < jit_helper handler > static op* jit_call( xcontext* x, value* r, op* ip, ref_value* k, struct op op )
+{
+    try
+    {
+        x->state.r = r;
+        return handler( x, r, ip, k, op );
+    }
+    catch ( ... )
+    {
+        x->exception = std::current_exception();
+        return nullptr;
+    }
+}
+
+static const jit_helper jit_helpers[] =
+{
+#define X( opcode, name ) [ opcode ] = jit_call< name >,
+    EXECUTE_OPS( X )
+#undef X
+};
+
+static op* jit_requicken( xcontext* x, value* r, op* ip, ref_value* k, struct op op )
+{
+    // Indexing instructions are rewritten as they execute, so call the
+    // handler for the current opcode.
+    op.opcode = ip[ -1 ].opcode;
+    return jit_helpers[ op.opcode ]( x, r, ip, k, op );
+}
+
+static bool jit_poll( xcontext* x, op* ip )
+{
+    try
+    {
+        safepoint( x->vm );
+        return true;
+    }
+    catch ( ... )
+    {
+        x->ip = ip;
+        x->exception = std::current_exception();
+        return false;
+    }
+}
+
+void jit_execute( xcontext* x )
+{
+    x->jit->enter( x, x->state.r, x->jit->entries[ x->state.ip ] );
+}
+
+/*
+    Code is emitted into a byte buffer, then copied into executable memory
+    once all jumps have been resolved.
+
+    Register usage:
+        rbx         base of register window.
+        r12         xcontext.
+        r13         BOX_NUMBER, for number guards.
+        rax, rcx, rdx, xmm0-3  scratch.
+
+    The prologue saves these callee-saved registers and jumps to the entry
+    for an instruction.  Every instruction has an entry.  After a handler
+    returns the address of the next instruction, code reloads rbx, as calls
+    and returns switch frames.  It continues directly if the address is one
+    of the instruction's usual successors, or looks up the entry in the
+    compiled code of the current function.  Calls between compiled functions
+    stay in the same native frame.
+
+    Jumps backwards poll for a safepoint in the same way as safepoint_due,
+    and call the safepoint if one is due.
+*/
+
+enum jit_reg { RAX = 0, RCX = 1, RDX = 2 };
+
+enum
+{
+    JCC_B   = 0x82,
+    JCC_AE  = 0x83,
+    JCC_E   = 0x84,
+    JCC_NE  = 0x85,
+    JCC_BE  = 0x86,
+    JCC_A   = 0x87,
+    JCC_P   = 0x8A,
+};
+
+enum jit_label
+{
+    LABEL_OP,       // Start of instruction.
+    LABEL_SLOW,     // Handler call for instruction, when a guard fails.
+    LABEL_POLL,     // Safepoint call for instruction.
+};
+
+struct jit_fixup
+{
+    size_t offset;
+    jit_label label;
+    unsigned index;
+};
+
+struct jit_builder
+{
+    program_object* program;
+    jit_code* code;
+    std::vector< uint8_t > bytes;
+    std::vector< size_t > op_offsets;
+    std::vector< size_t > poll_offsets;
+    std::vector< size_t > resume_offsets;
+    std::vector< bool > slow;
+    std::vector< jit_fixup > fixups;
+    size_t epilogue;
+    size_t dispatch;
+};
+
+static void emit( jit_builder* b, std::initializer_list< uint8_t > bytes )
+{
+    b->bytes.insert( b->bytes.end(), bytes.begin(), bytes.end() );
+}
+
+static void emit_u32( jit_builder* b, uint32_t u )
+{
+    for ( unsigned i = 0; i < 4; ++i )
+        b->bytes.push_back( (uint8_t)( u >> i * 8 ) );
+}
+
+static void emit_u64( jit_builder* b, uint64_t u )
+{
+    for ( unsigned i = 0; i < 8; ++i )
+        b->bytes.push_back( (uint8_t)( u >> i * 8 ) );
+}
+
+static void emit_rel32( jit_builder* b, size_t target )
+{
+    emit_u32( b, (uint32_t)(int32_t)( target - ( b->bytes.size() + 4 ) ) );
+}
+
+static void emit_load( jit_builder* b, jit_reg reg, unsigned r )
+{
+    // mov reg, [rbx + r * 8]
+    emit( b, { 0x48, 0x8B, (uint8_t)( 0x83 | reg << 3 ) } );
+    emit_u32( b, r * sizeof( value ) );
+}
+
+static void emit_store( jit_builder* b, unsigned r, jit_reg reg )
+{
+    // mov [rbx + r * 8], reg
+    emit( b, { 0x48, 0x89, (uint8_t)( 0x83 | reg << 3 ) } );
+    emit_u32( b, r * sizeof( value ) );
+}
+
+static void emit_imm( jit_builder* b, jit_reg reg, uint64_t u )
+{
+    // mov reg, imm64
+    emit( b, { 0x48, (uint8_t)( 0xB8 | reg ) } );
+    emit_u64( b, u );
+}
+
+static void emit_jcc( jit_builder* b, uint8_t cc, jit_label label, unsigned index )
+{
+    // jcc rel32
+    emit( b, { 0x0F, cc } );
+    b->fixups.push_back( { b->bytes.size(), label, index } );
+    emit_u32( b, 0 );
+    if ( label == LABEL_SLOW ) b->slow[ index ] = true;
+}
+
+static void emit_jmp( jit_builder* b, jit_label label, unsigned index )
+{
+    // jmp rel32
+    emit( b, { 0xE9 } );
+    b->fixups.push_back( { b->bytes.size(), label, index } );
+    emit_u32( b, 0 );
+}
+
+static void emit_poll( jit_builder* b, vmachine* vm, unsigned index )
+{
+    // mov rax, &phase; cmp dword [rax], GC_PHASE_NONE; jne collecting
+    static_assert( sizeof( vm->phase ) == 4 && GC_PHASE_NONE == 0 );
+    emit_imm( b, RAX, (uint64_t)&vm->phase );
+    emit( b, { 0x83, 0x38, 0x00 } );
+    emit( b, { 0x75, 0x00 } );
+    size_t collecting = b->bytes.size();
+
+    // mov rax, &countdown; cmp dword [rax], 0; je poll
+    static_assert( sizeof( vm->countdown ) == 4 );
+    emit_imm( b, RAX, (uint64_t)&vm->countdown );
+    emit( b, { 0x83, 0x38, 0x00 } );
+    emit_jcc( b, JCC_E, LABEL_POLL, index );
+
+    // mov rax, &nursery.countdown; cmp qword [rax], 0; je poll
+    static_assert( sizeof( vm->nursery.countdown ) == 8 );
+    emit_imm( b, RAX, (uint64_t)&vm->nursery.countdown );
+    emit( b, { 0x48, 0x83, 0x38, 0x00 } );
+    emit_jcc( b, JCC_E, LABEL_POLL, index );
+
+    // jmp done
+    emit( b, { 0xEB, 0x00 } );
+    size_t done = b->bytes.size();
+
+    // collecting: mov rax, &handshake_pending; cmp byte [rax], 0; jne poll
+    static_assert( sizeof( vm->handshake_pending ) == 1 );
+    b->bytes[ collecting - 1 ] = (uint8_t)( b->bytes.size() - collecting );
+    emit_imm( b, RAX, (uint64_t)&vm->handshake_pending );
+    emit( b, { 0x80, 0x38, 0x00 } );
+    emit_jcc( b, JCC_NE, LABEL_POLL, index );
+
+    // done: the safepoint call continues after the poll.
+    b->bytes[ done - 1 ] = (uint8_t)( b->bytes.size() - done );
+    b->poll_offsets[ index ] = 1;
+    b->resume_offsets[ index ] = b->bytes.size();
+}
+
+static void emit_guard_number( jit_builder* b, jit_reg reg, unsigned index )
+{
+    // cmp reg, r13; jb slow
+    emit( b, { 0x4C, 0x39, (uint8_t)( 0xE8 | reg ) } );
+    emit_jcc( b, JCC_B, LABEL_SLOW, index );
+}
+
+static void emit_unbox( jit_builder* b, unsigned xmm, jit_reg reg )
+{
+    // not reg; movq xmm, reg
+    emit( b, { 0x48, 0xF7, (uint8_t)( 0xD0 | reg ) } );
+    emit( b, { 0x66, 0x48, 0x0F, 0x6E, (uint8_t)( 0xC0 | xmm << 3 | reg ) } );
+}
+
+static void emit_box( jit_builder* b, unsigned xmm )
+{
+    // movq rax, xmm; not rax
+    emit( b, { 0x66, 0x48, 0x0F, 0x7E, (uint8_t)( 0xC0 | xmm << 3 ) } );
+    emit( b, { 0x48, 0xF7, 0xD0 } );
+}
+
+static void emit_sse( jit_builder* b, uint8_t opcode, unsigned xmm_a, unsigned xmm_b )
+{
+    // addsd/subsd/mulsd/divsd xmm_a, xmm_b
+    emit( b, { 0xF2, 0x0F, opcode, (uint8_t)( 0xC0 | xmm_a << 3 | xmm_b ) } );
+}
+
+static void emit_ucomisd( jit_builder* b, unsigned xmm_a, unsigned xmm_b )
+{
+    // ucomisd xmm_a, xmm_b
+    emit( b, { 0x66, 0x0F, 0x2E, (uint8_t)( 0xC0 | xmm_a << 3 | xmm_b ) } );
+}
+
+static void emit_number_operand( jit_builder* b, unsigned xmm, jit_reg reg, unsigned r, bool constant, unsigned index )
+{
+    if ( ! constant )
+    {
+        emit_load( b, reg, r );
+        emit_guard_number( b, reg, index );
+    }
+    else
+    {
+        emit_imm( b, reg, read( b->program->constants[ r ] ).v );
+    }
+    emit_unbox( b, xmm, reg );
+}
+
+static void emit_slots( jit_builder* b, size_t offset )
+{
+    // mov rax, [rax + offset]
+    emit( b, { 0x48, 0x8B, 0x80 } );
+    emit_u32( b, (uint32_t)offset );
+}
+
+static bool is_dual( opcode opcode )
+{
+    switch ( opcode )
+    {
+    case OP_JEQ:
+    case OP_JEQN:
+    case OP_JEQS:
+    case OP_JLT:
+    case OP_JLTN:
+    case OP_JGTN:
+    case OP_JLE:
+    case OP_JLEN:
+    case OP_JGEN:
+    case OP_JLT_NN:
+    case OP_JLE_NN:
+    case OP_JLT_ANY:
+    case OP_JLE_ANY:
+    case OP_FOR_EACH:
+    case OP_FOR_STEP:
+    case OP_MCALL:
+    case OP_MCALLR:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static bool is_quickened( opcode opcode )
+{
+    switch ( opcode )
+    {
+    case OP_GET_INDEX:
+    case OP_GET_INDEXI:
+    case OP_SET_INDEX:
+    case OP_SET_INDEXI:
+    case OP_GET_ARRAY:
+    case OP_GET_TABLE:
+    case OP_GET_ARRAYI:
+    case OP_SET_ARRAY:
+    case OP_SET_TABLE:
+    case OP_SET_ARRAYI:
+    case OP_GET_TYPED:
+    case OP_SET_TYPED:
+        return true;
+
+    default:
+        return false;
+    }
+}
+
+static unsigned jump_target( program_object* program, unsigned index )
+{
+    op op = program->ops[ index ];
+    switch ( op.opcode )
+    {
+    case OP_JMP:
+    case OP_JT:
+    case OP_JF:
+        return index + 1 + op.j;
+
+    case OP_MCALL:
+    case OP_MCALLR:
+        return program->op_count;
+
+    default:
+        return is_dual( (opcode)op.opcode ) ? index + 2 + program->ops[ index + 1 ].j : program->op_count;
+    }
+}
+
+static void emit_continue( jit_builder* b, unsigned index )
+{
+    // mov rcx, &ops[ index ]; cmp rax, rcx; je index
+    if ( index >= b->program->op_count ) return;
+    emit_imm( b, RCX, (uint64_t)( b->program->ops + index ) );
+    emit( b, { 0x48, 0x39, 0xC8 } );
+    emit_jcc( b, JCC_E, LABEL_OP, index );
+}
+
+static void emit_handler( jit_builder* b, unsigned index )
+{
+    program_object* program = b->program;
+    op op = program->ops[ index ];
+    jit_helper helper = is_quickened( (opcode)op.opcode ) ? jit_requicken : jit_helpers[ op.opcode ];
+    uint32_t op_bits;
+    static_assert( sizeof( op ) == sizeof( op_bits ) );
+    memcpy( &op_bits, &op, sizeof( op_bits ) );
+
+    // rax = helper( x, r, ip, k, op )
+    emit( b, { 0x4C, 0x89, 0xE7 } ); // mov rdi, r12
+    emit( b, { 0x48, 0x89, 0xDE } ); // mov rsi, rbx
+    emit_imm( b, RDX, (uint64_t)( program->ops + index + 1 ) );
+    emit_imm( b, RCX, (uint64_t)program->constants );
+    emit( b, { 0x41, 0xB8 } ); // mov r8d, op
+    emit_u32( b, op_bits );
+    emit_imm( b, RAX, (uint64_t)helper );
+    emit( b, { 0xFF, 0xD0 } ); // call rax
+
+    // test rax, rax; jz epilogue
+    emit( b, { 0x48, 0x85, 0xC0 } );
+    emit( b, { 0x0F, JCC_E } );
+    emit_rel32( b, b->epilogue );
+
+    // mov rbx, [r12 + state.r]
+    emit( b, { 0x49, 0x8B, 0x9C, 0x24 } );
+    emit_u32( b, offsetof( xcontext, state ) + offsetof( xstate, r ) );
+
+    // Continue at the next instruction or jump target, or look up the entry.
+    // Recursive calls continue at the start of this function.
+    emit_continue( b, index + ( is_dual( (opcode)op.opcode ) ? 2 : 1 ) );
+    emit_continue( b, jump_target( program, index ) );
+    if ( op.opcode == OP_CALL || op.opcode == OP_CALLR )
+    {
+        emit_continue( b, 0 );
+    }
+    emit( b, { 0xE9 } );
+    emit_rel32( b, b->dispatch );
+}
+
+static bool emit_op( jit_builder* b, vmachine* vm, unsigned index )
+{
+    program_object* program = b->program;
+    op op = program->ops[ index ];
+    switch ( op.opcode )
+    {
+    case OP_MOV:
+    {
+        emit_load( b, RAX, op.a );
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    case OP_SWP:
+    {
+        emit_load( b, RAX, op.r );
+        emit_load( b, RCX, op.a );
+        emit_store( b, op.r, RCX );
+        emit_store( b, op.a, RAX );
+        return true;
+    }
+
+    case OP_LDV:
+    {
+        emit_imm( b, RAX, op.c );
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    case OP_LDK:
+    {
+        // Numbers are immediate.  Objects are loaded from the constant table.
+        value u = read( program->constants[ op.c ] );
+        if ( box_is_number( u ) )
+        {
+            emit_imm( b, RAX, u.v );
+        }
+        else
+        {
+            emit_imm( b, RAX, (uint64_t)( program->constants + op.c ) );
+            emit( b, { 0x48, 0x8B, 0x00 } ); // mov rax, [rax]
+        }
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    case OP_NEG:
+    {
+        // Negating the double flips the sign bit, which is also the top bit
+        // of the inverted encoding.
+        emit_load( b, RAX, op.a );
+        emit_guard_number( b, RAX, index );
+        emit( b, { 0x48, 0x0F, 0xBA, 0xF8, 0x3F } ); // btc rax, 63
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    case OP_ADD:
+    case OP_ADDN:
+    case OP_MUL:
+    case OP_MULN:
+    case OP_DIV:
+    {
+        bool constant = op.opcode == OP_ADDN || op.opcode == OP_MULN;
+        uint8_t sse = 0x58;
+        if ( op.opcode == OP_MUL || op.opcode == OP_MULN ) sse = 0x59;
+        if ( op.opcode == OP_DIV ) sse = 0x5E;
+        emit_number_operand( b, 0, RAX, op.a, false, index );
+        emit_number_operand( b, 1, RCX, op.b, constant, index );
+        emit_sse( b, sse, 0, 1 );
+        emit_box( b, 0 );
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    case OP_SUB:
+    case OP_SUBN:
+    {
+        // r = b - a
+        bool constant = op.opcode == OP_SUBN;
+        emit_number_operand( b, 0, RAX, op.a, false, index );
+        emit_number_operand( b, 1, RCX, op.b, constant, index );
+        emit_sse( b, 0x5C, 1, 0 );
+        emit_box( b, 1 );
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    case OP_JMP:
+    {
+        if ( op.j < 0 ) emit_poll( b, vm, index );
+        emit_jmp( b, LABEL_OP, index + 1 + op.j );
+        return true;
+    }
+
+    case OP_JT:
+    case OP_JF:
+    {
+        // Values test false if they are null, false, +0.0, or -0.0.
+        unsigned target = index + 1 + op.j;
+        if ( op.j < 0 ) emit_poll( b, vm, index );
+        emit_load( b, RAX, op.r );
+        emit_imm( b, RDX, box_number( -0.0 ).v );
+        emit( b, { 0x48, 0x83, 0xF8, 0x01 } ); // cmp rax, 1
+        if ( op.opcode == OP_JT )
+        {
+            emit( b, { 0x76, 0x0F } ); // jbe +15
+            emit( b, { 0x48, 0x83, 0xF8, 0xFF } ); // cmp rax, -1
+            emit( b, { 0x74, 0x09 } ); // je +9
+            emit( b, { 0x48, 0x39, 0xD0 } ); // cmp rax, rdx
+            emit_jcc( b, JCC_NE, LABEL_OP, target );
+        }
+        else
+        {
+            emit_jcc( b, JCC_BE, LABEL_OP, target );
+            emit( b, { 0x48, 0x83, 0xF8, 0xFF } ); // cmp rax, -1
+            emit_jcc( b, JCC_E, LABEL_OP, target );
+            emit( b, { 0x48, 0x39, 0xD0 } ); // cmp rax, rdx
+            emit_jcc( b, JCC_E, LABEL_OP, target );
+        }
+        return true;
+    }
+
+    case OP_JEQN:
+    case OP_JLT:
+    case OP_JLT_NN:
+    case OP_JLTN:
+    case OP_JGTN:
+    case OP_JLE:
+    case OP_JLE_NN:
+    case OP_JLEN:
+    case OP_JGEN:
+    case OP_JLT_ANY:
+    case OP_JLE_ANY:
+    {
+        struct op jop = program->ops[ index + 1 ];
+        unsigned target = index + 2 + jop.j;
+        if ( jop.j < 0 ) emit_poll( b, vm, index );
+
+        bool constant = op.opcode == OP_JEQN || op.opcode == OP_JLTN || op.opcode == OP_JGTN || op.opcode == OP_JLEN || op.opcode == OP_JGEN;
+        emit_number_operand( b, 0, RAX, op.a, false, index );
+        emit_number_operand( b, 1, RCX, op.b, constant, index );
+
+        if ( op.opcode == OP_JEQN )
+        {
+            emit_ucomisd( b, 0, 1 );
+            if ( op.r )
+            {
+                emit( b, { 0x7A, 0x06 } ); // jp +6
+                emit_jcc( b, JCC_E, LABEL_OP, target );
+            }
+            else
+            {
+                emit_jcc( b, JCC_P, LABEL_OP, target );
+                emit_jcc( b, JCC_NE, LABEL_OP, target );
+            }
+            return true;
+        }
+
+        // Unordered comparisons clear neither CF nor ZF, so compare such
+        // that the true condition is A or AE.
+        bool swap = op.opcode != OP_JGTN && op.opcode != OP_JGEN;
+        bool equal = op.opcode == OP_JLE || op.opcode == OP_JLE_NN || op.opcode == OP_JLE_ANY || op.opcode == OP_JLEN || op.opcode == OP_JGEN;
+        emit_ucomisd( b, swap ? 1 : 0, swap ? 0 : 1 );
+        uint8_t cc = equal ? JCC_AE : JCC_A;
+        if ( ! op.r ) cc = equal ? JCC_B : JCC_BE;
+        emit_jcc( b, cc, LABEL_OP, target );
+        return true;
+    }
+
+    case OP_FOR_STEP:
+    {
+        struct op jop = program->ops[ index + 1 ];
+        unsigned target = index + 2 + jop.j;
+
+        emit_number_operand( b, 0, RAX, op.a + 0, false, index );
+        emit_number_operand( b, 1, RCX, op.a + 1, false, index );
+        emit_number_operand( b, 2, RDX, op.a + 2, false, index );
+
+        // if step >= 0.0 then i < limit else i > limit
+        emit( b, { 0x66, 0x0F, 0x57, 0xDB } ); // xorpd xmm3, xmm3
+        emit_ucomisd( b, 2, 3 );
+        emit( b, { 0x72, 0x0C } ); // jb +12
+        emit_ucomisd( b, 1, 0 );
+        emit_jcc( b, JCC_BE, LABEL_OP, target );
+        emit( b, { 0xEB, 0x0A } ); // jmp +10
+        emit_ucomisd( b, 0, 1 );
+        emit_jcc( b, JCC_BE, LABEL_OP, target );
+
+        // r = i; a = i + step
+        emit_load( b, RAX, op.a );
+        emit_store( b, op.r, RAX );
+        emit_sse( b, 0x58, 0, 2 );
+        emit_box( b, 0 );
+        emit_store( b, op.a, RAX );
+        return true;
+    }
+
+    case OP_GET_VARENV:
+    {
+        // r = varenv->slots[ b ]
+        emit_load( b, RAX, op.a );
+        emit_slots( b, offsetof( vslots_object, slots ) + op.b * sizeof( ref_value ) );
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    case OP_GET_OUTENV:
+    {
+        // r = x->function->outenvs[ a ]->slots[ b ]
+        emit( b, { 0x49, 0x8B, 0x84, 0x24 } ); // mov rax, [r12 + offset]
+        emit_u32( b, offsetof( xcontext, function ) );
+        emit_slots( b, offsetof( function_object, outenvs ) + op.a * sizeof( ref< vslots_object > ) );
+        emit_slots( b, offsetof( vslots_object, slots ) + op.b * sizeof( ref_value ) );
+        emit_store( b, op.r, RAX );
+        return true;
+    }
+
+    default:
+        return false;
+    }
+}
+
+jit_code* jit_compile( vmachine* vm, program_object* program )
+{
+    unsigned op_count = program->op_count;
+    jit_code* code = (jit_code*)malloc( sizeof( jit_code ) + sizeof( const void* ) * op_count );
+    if ( ! code )
+    {
+        return nullptr;
+    }
+
+    jit_builder b;
+    b.program = program;
+    b.code = code;
+    b.op_offsets.assign( op_count, 0 );
+    b.poll_offsets.assign( op_count, 0 );
+    b.resume_offsets.assign( op_count, 0 );
+    b.slow.assign( op_count, false );
+
+    // Prologue.
+    emit( &b, { 0x53 } ); // push rbx
+    emit( &b, { 0x41, 0x54 } ); // push r12
+    emit( &b, { 0x41, 0x55 } ); // push r13
+    emit( &b, { 0x49, 0x89, 0xFC } ); // mov r12, rdi
+    emit( &b, { 0x48, 0x89, 0xF3 } ); // mov rbx, rsi
+    emit( &b, { 0x49, 0xBD } ); // mov r13, BOX_NUMBER
+    emit_u64( &b, BOX_NUMBER );
+    emit( &b, { 0xFF, 0xE2 } ); // jmp rdx
+
+    // Epilogue.
+    b.epilogue = b.bytes.size();
+    emit( &b, { 0x41, 0x5D } ); // pop r13
+    emit( &b, { 0x41, 0x5C } ); // pop r12
+    emit( &b, { 0x5B } ); // pop rbx
+    emit( &b, { 0xC3 } ); // ret
+
+    // Dispatch to the entry for the instruction at rax, in the current
+    // function, which might not be this one.
+    b.dispatch = b.bytes.size();
+    emit( &b, { 0x49, 0x2B, 0x84, 0x24 } ); // sub rax, [r12 + ops]
+    emit_u32( &b, offsetof( xcontext, ops ) );
+    emit( &b, { 0x49, 0x8B, 0x8C, 0x24 } ); // mov rcx, [r12 + jit]
+    emit_u32( &b, offsetof( xcontext, jit ) );
+    emit( &b, { 0xFF, 0xA4, 0x41 } ); // jmp [rcx + rax * 2 + entries]
+    emit_u32( &b, offsetof( jit_code, entries ) );
+
+    // Translate each instruction, calling its handler if it is not inline.
+    std::vector< bool > entry( op_count, false );
+    for ( unsigned index = 0; index < op_count; ++index )
+    {
+        b.op_offsets[ index ] = b.bytes.size();
+        entry[ index ] = true;
+        bool dual = is_dual( (opcode)program->ops[ index ].opcode );
+        if ( ! emit_op( &b, vm, index ) )
+        {
+            emit_handler( &b, index );
+        }
+        if ( dual )
+        {
+            index += 1;
+        }
+    }
+
+    // The jump which follows FOR_EACH is executed on its own when a
+    // generator ends the loop, so it needs an entry.
+    for ( unsigned index = 0; index < op_count; ++index )
+    {
+        if ( is_dual( (opcode)program->ops[ index ].opcode ) )
+        {
+            index += 1;
+            if ( program->ops[ index ].opcode == OP_JMP )
+            {
+                b.op_offsets[ index ] = b.bytes.size();
+                entry[ index ] = true;
+                emit_op( &b, vm, index );
+            }
+        }
+    }
+
+    // Handler calls for failed guards, and safepoint calls.
+    std::vector< size_t > slow_offsets( op_count, 0 );
+    for ( unsigned index = 0; index < op_count; ++index )
+    {
+        if ( b.slow[ index ] )
+        {
+            slow_offsets[ index ] = b.bytes.size();
+            emit_handler( &b, index );
+        }
+
+        if ( b.poll_offsets[ index ] )
+        {
+            b.poll_offsets[ index ] = b.bytes.size();
+            emit( &b, { 0x4C, 0x89, 0xE7 } ); // mov rdi, r12
+            emit( &b, { 0x48, 0xBE } ); // mov rsi, ip
+            emit_u64( &b, (uint64_t)( program->ops + index + 1 ) );
+            emit_imm( &b, RAX, (uint64_t)jit_poll );
+            emit( &b, { 0xFF, 0xD0 } ); // call rax
+            emit( &b, { 0x84, 0xC0 } ); // test al, al
+            emit( &b, { 0x0F, JCC_E } ); // jz epilogue
+            emit_rel32( &b, b.epilogue );
+            emit( &b, { 0xE9 } ); // jmp resume
+            emit_rel32( &b, b.resume_offsets[ index ] );
+        }
+    }
+
+    // Resolve jumps.
+    for ( const jit_fixup& fixup : b.fixups )
+    {
+        size_t target = 0;
+        switch ( fixup.label )
+        {
+        case LABEL_OP:      target = b.op_offsets.at( fixup.index );    break;
+        case LABEL_SLOW:    target = slow_offsets.at( fixup.index );    break;
+        case LABEL_POLL:    target = b.poll_offsets.at( fixup.index );  break;
+        }
+        int32_t rel = (int32_t)( target - ( fixup.offset + 4 ) );
+        memcpy( b.bytes.data() + fixup.offset, &rel, sizeof( rel ) );
+    }
+
+    // Copy to executable memory.
+    size_t size = ( b.bytes.size() + 4095 ) & ~(size_t)4095;
+    void* memory = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( memory == MAP_FAILED )
+    {
+        free( code );
+        return nullptr;
+    }
+    memcpy( memory, b.bytes.data(), b.bytes.size() );
+    if ( mprotect( memory, size, PROT_READ | PROT_EXEC ) != 0 )
+    {
+        munmap( memory, size );
+        free( code );
+        return nullptr;
+    }
+
+    code->enter = (jit_function)memory;
+    code->memory = memory;
+    code->size = size;
+    for ( unsigned index = 0; index < op_count; ++index )
+    {
+        code->entries[ index ] = entry[ index ] ? (const uint8_t*)memory + b.op_offsets[ index ] : nullptr;
+    }
+    return code;
+}
+
+void jit_free( jit_code* code )
+{
+    if ( code )
+    {
+        munmap( code->memory, code->size );
+        free( code );
+    }
+}
+
+}
+
+#else
+
+namespace kf
+{
+
+jit_code* jit_compile( vmachine* vm, program_object* program )
+{
+    return nullptr;
+}
+
+void jit_free( jit_code* code )
+{
+}
+
+void jit_execute( xcontext* x )
+{
+}
+
+}
+
+#endif
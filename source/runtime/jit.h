@@ -0,0 +1,66 @@
+//
+//  jit.h
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifndef KF_JIT_H
+#define KF_JIT_H
+
+/*
+    Optional baseline compiler, enabled by building with KF_JIT.
+
+    Once a program has been called, or has looped, enough times, its bytecode
+    is translated to x86-64 machine code one instruction at a time.  Simple
+    instructions (moves, constants, arithmetic, numeric comparisons and
+    loops, and environment reads) are compiled inline behind type guards.
+    Every other instruction, and every failed guard, calls the interpreter's
+    own handler for that instruction from execute_ops.h.
+
+    The interpreter enters compiled code at function entry, at the points
+    where calls return, and at loop headers.  Calls and returns between
+    compiled functions jump between their code without leaving the native
+    frame.  When execution reaches a function which has not been compiled,
+    compiled code returns and the interpreter continues from the state in
+    the xcontext.  Stack frames are always kept on the cothread stack, so
+    returning early loses nothing.
+
+    Compiled code has no unwind information, so handlers called from it catch
+    exceptions and store them in the xcontext, and the interpreter rethrows
+    them.
+*/
+
+#include "vmachine.h"
+
+namespace kf
+{
+
+struct program_object;
+struct xcontext;
+
+typedef void (*jit_function)( xcontext* x, value* r, const void* entry );
+
+struct jit_code
+{
+    jit_function enter;
+    void* memory;
+    size_t size;
+    const void* entries[];
+};
+
+const unsigned JIT_DEFAULT_THRESHOLD = 64;
+
+jit_code* jit_compile( vmachine* vm, program_object* program );
+void jit_free( jit_code* code );
+
+// Runs compiled code for x->state, which must have compiled code.
+void jit_execute( xcontext* x );
+
+}
+
+#endif
+
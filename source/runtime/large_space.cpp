@@ -0,0 +1,222 @@
+//
+//  large_space.cpp
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "large_space.h"
+#include <assert.h>
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace kf
+{
+
+/*
+    Map and unmap memory for large objects.
+*/
+
+#ifdef _WIN32
+
+static size_t mapping_page_size()
+{
+    return 64 * 1024;
+}
+
+static char* mapping_alloc( size_t size )
+{
+    void* p = VirtualAlloc( NULL, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE );
+    if ( p == NULL )
+    {
+        throw std::bad_alloc();
+    }
+    return (char*)p;
+}
+
+static char* mapping_grow( char* p, size_t old_size, size_t new_size )
+{
+    return nullptr;
+}
+
+static void mapping_free( char* p, size_t size )
+{
+    VirtualFree( p, 0, MEM_RELEASE );
+}
+
+#else
+
+static size_t mapping_page_size()
+{
+    static const size_t page_size = sysconf( _SC_PAGESIZE );
+    return page_size;
+}
+
+static char* mapping_alloc( size_t size )
+{
+    void* p = mmap( nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if ( p == MAP_FAILED )
+    {
+        throw std::bad_alloc();
+    }
+    return (char*)p;
+}
+
+static char* mapping_grow( char* p, size_t old_size, size_t new_size )
+{
+#ifdef MREMAP_MAYMOVE
+    void* q = mremap( p, old_size, new_size, MREMAP_MAYMOVE );
+    if ( q != MAP_FAILED )
+    {
+        return (char*)q;
+    }
+#endif
+    return nullptr;
+}
+
+static void mapping_free( char* p, size_t size )
+{
+    munmap( p, size );
+}
+
+#endif
+
+static size_t mapping_size( size_t size )
+{
+    size_t page_size = mapping_page_size();
+    return ( sizeof( large_block ) + size + page_size - 1 ) & ~( page_size - 1 );
+}
+
+static void set_chunk_size( large_block* block )
+{
+    // Chunk header matches heap.cpp, with the allocated bits set.
+    block->chunk[ 0 ] = (uint32_t)( block->mapping - offsetof( large_block, chunk ) ) | 3;
+}
+
+large_space::large_space( size_t threshold )
+    :   threshold( threshold ? threshold : SIZE_MAX )
+    ,   blocks( nullptr )
+    ,   count( 0 )
+    ,   mapped( 0 )
+{
+}
+
+large_space::~large_space()
+{
+    while ( blocks )
+    {
+        large_block* block = blocks;
+        blocks = block->next;
+        mapping_free( (char*)block, block->mapping );
+    }
+}
+
+void* large_malloc( large_space* s, size_t size )
+{
+    if ( size > LARGE_MAX_MAPPING - sizeof( large_block ) )
+    {
+        throw std::bad_alloc();
+    }
+
+    size_t mapping = mapping_size( size );
+    large_block* block = (large_block*)mapping_alloc( mapping );
+    block->next = nullptr;
+    block->prev = nullptr;
+    block->mapping = mapping;
+    set_chunk_size( block );
+    return large_block_object( block );
+}
+
+void large_link( large_space* s, void* p )
+{
+    large_block* block = large_block_head( p );
+    std::lock_guard lock( s->mutex );
+    block->next = s->blocks;
+    if ( block->next )
+    {
+        block->next->prev = block;
+    }
+    s->blocks = block;
+    s->count += 1;
+    s->mapped += block->mapping;
+}
+
+void* large_resize( large_space* s, void* p, size_t size )
+{
+    if ( size > LARGE_MAX_MAPPING - sizeof( large_block ) )
+    {
+        return nullptr;
+    }
+
+    // Resize in place if the new size fits in the mapping.
+    large_block* block = large_block_head( p );
+    size_t mapping = mapping_size( size );
+    if ( mapping <= block->mapping )
+    {
+        return p;
+    }
+
+    // Remap, holding the lock as the block's neighbours must be relinked.
+    std::lock_guard lock( s->mutex );
+    size_t old_mapping = block->mapping;
+    block = (large_block*)mapping_grow( (char*)block, old_mapping, mapping );
+    if ( ! block )
+    {
+        return nullptr;
+    }
+
+    block->mapping = mapping;
+    set_chunk_size( block );
+    if ( block->prev )
+    {
+        block->prev->next = block;
+    }
+    else
+    {
+        s->blocks = block;
+    }
+    if ( block->next )
+    {
+        block->next->prev = block;
+    }
+    s->mapped += mapping - old_mapping;
+    return large_block_object( block );
+}
+
+void large_free( large_space* s, void* p )
+{
+    large_block* block = large_block_head( p );
+
+    {
+        std::lock_guard lock( s->mutex );
+        if ( block->prev )
+        {
+            block->prev->next = block->next;
+        }
+        else
+        {
+            assert( s->blocks == block );
+            s->blocks = block->next;
+        }
+        if ( block->next )
+        {
+            block->next->prev = block->prev;
+        }
+        s->count -= 1;
+        s->mapped -= block->mapping;
+    }
+
+    mapping_free( (char*)block, block->mapping );
+}
+
+}
+
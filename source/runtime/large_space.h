@@ -0,0 +1,87 @@
+//
+//  large_space.h
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifndef KF_LARGE_SPACE_H
+#define KF_LARGE_SPACE_H
+
+/*
+    The large object space holds objects too big to share heap segments.
+
+    Each large object has its own mapping from the system.  The mapping starts
+    with a block header, which links the object into a list, followed by the
+    same chunk header as a heap allocation, so that heap_malloc_size() works on
+    large objects too.  The allocation is rounded up to whole pages, and any
+    space left over at the end of the last page belongs to the object.
+
+    Mappings are zeroed by the system, so large objects are never cleared.
+    The collector sweeps the list, and unmaps dead objects immediately.  The
+    sweeper reads object headers, so a new object is only linked into the
+    list once its header has been initialized.
+
+    A large object can be resized.  Where the system supports it, the mapping
+    is grown by remapping its pages rather than by copying them, though the
+    object might move to a new address.  Otherwise, resizing only succeeds if
+    the new size fits in the existing mapping.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <mutex>
+
+namespace kf
+{
+
+const size_t LARGE_DEFAULT_SIZE = 128 * 1024;
+const size_t LARGE_MAX_MAPPING = (size_t)4 * 1024 * 1024 * 1024;
+
+struct large_block
+{
+    large_block* next;
+    large_block* prev;
+    size_t mapping;
+    uint32_t chunk[ 2 ]; // Chunk header, overlapping the object header.
+};
+
+struct large_space
+{
+    explicit large_space( size_t threshold );
+    ~large_space();
+
+    // Objects of at least this size are allocated here.
+    size_t threshold;
+
+    // List of large objects.  Locked, as the GC thread sweeps concurrently.
+    std::mutex mutex;
+    large_block* blocks;
+    size_t count;
+    size_t mapped;
+};
+
+void* large_malloc( large_space* s, size_t size );
+void large_link( large_space* s, void* p );
+void* large_resize( large_space* s, void* p, size_t size );
+void large_free( large_space* s, void* p );
+large_block* large_block_head( void* p );
+void* large_block_object( large_block* block );
+
+inline large_block* large_block_head( void* p )
+{
+    return (large_block*)( (char*)p - sizeof( large_block ) );
+}
+
+inline void* large_block_object( large_block* block )
+{
+    return block + 1;
+}
+
+}
+
+#endif
+
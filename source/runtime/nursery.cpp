@@ -0,0 +1,151 @@
+//
+//  nursery.cpp
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "nursery.h"
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace kf
+{
+
+/*
+    Reserve and commit virtual memory for the nursery region.
+*/
+
+#ifdef _WIN32
+
+static char* region_reserve( size_t size )
+{
+    void* p = VirtualAlloc( NULL, size, MEM_RESERVE, PAGE_NOACCESS );
+    if ( p == NULL )
+    {
+        throw std::bad_alloc();
+    }
+    return (char*)p;
+}
+
+static void region_commit( char* p, size_t size )
+{
+    if ( VirtualAlloc( p, size, MEM_COMMIT, PAGE_READWRITE ) == NULL )
+    {
+        throw std::bad_alloc();
+    }
+}
+
+static void region_release( char* p, size_t size )
+{
+    VirtualFree( p, 0, MEM_RELEASE );
+}
+
+#else
+
+static char* region_reserve( size_t size )
+{
+    void* p = mmap( nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+    if ( p == MAP_FAILED )
+    {
+        throw std::bad_alloc();
+    }
+    return (char*)p;
+}
+
+static void region_commit( char* p, size_t size )
+{
+    if ( mprotect( p, size, PROT_READ | PROT_WRITE ) != 0 )
+    {
+        throw std::bad_alloc();
+    }
+}
+
+static void region_release( char* p, size_t size )
+{
+    munmap( p, size );
+}
+
+#endif
+
+nursery_space::nursery_space( size_t size )
+    :   base( nullptr )
+    ,   reserve( 0 )
+    ,   top( nullptr )
+    ,   limit( nullptr )
+    ,   block( 0 )
+    ,   size( size )
+    ,   countdown( size ? size : SIZE_MAX )
+    ,   next_block( 0 )
+{
+    // A nursery of size zero disables minor collections.
+    if ( size )
+    {
+        base = region_reserve( NURSERY_RESERVE_SIZE );
+        reserve = NURSERY_RESERVE_SIZE;
+        block_state.resize( reserve / NURSERY_BLOCK_SIZE, NURSERY_BLOCK_FREE );
+        block_top.resize( reserve / NURSERY_BLOCK_SIZE, 0 );
+    }
+}
+
+nursery_space::~nursery_space()
+{
+    if ( base )
+    {
+        region_release( base, reserve );
+    }
+}
+
+void* nursery_refill( nursery_space* n, size_t chunk_size )
+{
+    if ( ! n->base || chunk_size > NURSERY_MAX_CHUNK_SIZE )
+    {
+        return nullptr;
+    }
+
+    // Find an empty block, preferring one that has been used before.
+    nursery_close_block( n );
+    uint32_t block;
+    if ( ! n->free_blocks.empty() )
+    {
+        block = n->free_blocks.back();
+        n->free_blocks.pop_back();
+    }
+    else if ( n->next_block < n->block_state.size() )
+    {
+        block = n->next_block++;
+        region_commit( nursery_block_begin( n, block ), NURSERY_BLOCK_SIZE );
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    n->block_state[ block ] = NURSERY_BLOCK_YOUNG;
+    n->young_blocks.push_back( block );
+    n->block = block;
+    n->top = nursery_block_begin( n, block );
+    n->limit = n->top + NURSERY_BLOCK_SIZE;
+    return nursery_malloc( n, chunk_size - sizeof( uint64_t ) );
+}
+
+void nursery_close_block( nursery_space* n )
+{
+    if ( n->top )
+    {
+        n->block_top[ n->block ] = n->top - nursery_block_begin( n, n->block );
+        n->top = nullptr;
+        n->limit = nullptr;
+    }
+}
+
+}
+
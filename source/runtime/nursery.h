@@ -0,0 +1,139 @@
+//
+//  nursery.h
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifndef KF_NURSERY_H
+#define KF_NURSERY_H
+
+/*
+    The nursery is the young generation.
+
+    Nursery memory is a single reserved region, divided into blocks.  Small
+    objects are allocated by bumping a pointer through the current block.
+    Each object has the same chunk header as a heap allocation, so that
+    heap_malloc_size() works on nursery objects too.
+
+    A minor collection marks young objects that are reachable from roots or
+    from the remembered set.  Objects are not moved.  Blocks with no
+    survivors are reused.  Blocks with survivors are retired, becoming part
+    of the old generation, and are swept by the main collector.
+
+    The remembered set holds old slots written with young references, and old
+    objects which can hold young references without a write barrier: objects
+    allocated from the heap, and cothreads which have been resumed.  A full
+    collection promotes every young object, so it discards the remembered set.
+
+    Objects too large for a block, or allocated once the region is exhausted,
+    are allocated from the heap.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "atomic_load_store.h"
+
+namespace kf
+{
+
+struct object;
+
+const size_t NURSERY_BLOCK_SIZE = 64 * 1024;
+const size_t NURSERY_RESERVE_SIZE = (size_t)1024 * 1024 * 1024;
+const size_t NURSERY_MAX_CHUNK_SIZE = 4 * 1024;
+const size_t NURSERY_DEFAULT_SIZE = 2 * 1024 * 1024;
+const size_t NURSERY_REMEMBERED_LIMIT = 64 * 1024;
+
+enum nursery_block_state : uint8_t
+{
+    NURSERY_BLOCK_FREE,
+    NURSERY_BLOCK_YOUNG,
+    NURSERY_BLOCK_RETIRED,
+};
+
+struct nursery_space
+{
+    explicit nursery_space( size_t size );
+    ~nursery_space();
+
+    // Reserved region.
+    char* base;
+    size_t reserve;
+
+    // Bump allocation in current block.
+    char* top;
+    char* limit;
+    uint32_t block;
+
+    // Bytes left to allocate before a minor collection.
+    size_t size;
+    size_t countdown;
+
+    // Blocks.
+    std::vector< uint8_t > block_state;
+    std::vector< uint32_t > block_top;
+    std::vector< uint32_t > free_blocks;
+    std::vector< uint32_t > young_blocks;
+    std::vector< uint32_t > old_blocks;
+    uint32_t next_block;
+
+    // Remembered set.
+    std::vector< atomic_u64* > remembered_values;
+    std::vector< atomic_p< object >* > remembered_refs;
+    std::vector< object* > remembered_objects;
+};
+
+void* nursery_malloc( nursery_space* n, size_t size );
+void* nursery_refill( nursery_space* n, size_t chunk_size );
+void nursery_close_block( nursery_space* n );
+bool nursery_young( const nursery_space* n, const void* p );
+char* nursery_block_begin( const nursery_space* n, uint32_t block );
+char* nursery_block_end( const nursery_space* n, uint32_t block );
+
+/*
+    Allocate by bumping a pointer.  Returns nullptr if the object should be
+    allocated from the heap instead.
+*/
+
+inline void* nursery_malloc( nursery_space* n, size_t size )
+{
+    size_t chunk_size = ( size + sizeof( uint64_t ) + 7 ) & ~(size_t)7;
+    if ( chunk_size > (size_t)( n->limit - n->top ) )
+    {
+        return nursery_refill( n, chunk_size );
+    }
+
+    // Chunk header matches heap.cpp, with the allocated bits set.
+    char* chunk = n->top;
+    n->top = chunk + chunk_size;
+    n->countdown -= std::min( n->countdown, chunk_size );
+    *(uint32_t*)chunk = (uint32_t)chunk_size | 3;
+    return chunk + sizeof( uint64_t );
+}
+
+inline bool nursery_young( const nursery_space* n, const void* p )
+{
+    uintptr_t offset = (uintptr_t)p - (uintptr_t)n->base;
+    return offset < n->reserve && n->block_state[ offset / NURSERY_BLOCK_SIZE ] == NURSERY_BLOCK_YOUNG;
+}
+
+inline char* nursery_block_begin( const nursery_space* n, uint32_t block )
+{
+    return n->base + (size_t)block * NURSERY_BLOCK_SIZE;
+}
+
+inline char* nursery_block_end( const nursery_space* n, uint32_t block )
+{
+    return nursery_block_begin( n, block ) + n->block_top[ block ];
+}
+
+}
+
+#endif
+
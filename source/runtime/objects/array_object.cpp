@@ -23,6 +23,33 @@ array_object* array_new( vmachine* vm, size_t capacity )
     return array;
 }
 
+static vslots_object* array_expand( vmachine* vm, array_object* array, size_t count )
+{
+    // Large slots can be grown without copying.
+    vslots_object* aslots = read( array->aslots );
+    if ( aslots )
+    {
+        vslots_object* expand = (vslots_object*)object_resize( vm, aslots, count * sizeof( ref_value ) );
+        if ( expand )
+        {
+            if ( expand != aslots )
+            {
+                write( vm, array->aslots, expand );
+            }
+            return expand;
+        }
+    }
+
+    vslots_object* expand = vslots_new( vm, count );
+    for ( size_t i = 0; i < array->length; ++i )
+    {
+        winit( expand->slots[ i ], read( aslots->slots[ i ] ) );
+    }
+
+    write( vm, array->aslots, expand );
+    return expand;
+}
+
 void array_resize( vmachine* vm, array_object* array, size_t length )
 {
     vslots_object* aslots = read( array->aslots );
@@ -41,13 +68,7 @@ void array_resize( vmachine* vm, array_object* array, size_t length )
         size_t aslots_count = aslots ? object_size( vm, aslots ) / sizeof( ref_value ) : 0;
         if ( length > aslots_count )
         {
-            vslots_object* expand = vslots_new( vm, length );
-            for ( size_t i = 0; i < array_length; ++i )
-            {
-                winit( expand->slots[ i ], read( aslots->slots[ i ] ) );
-            }
-
-            write( vm, array->aslots, expand );
+            array_expand( vm, array, length );
         }
     }
 
@@ -78,21 +99,13 @@ void array_extend( vmachine* vm, array_object* array, const value* values, size_
     if ( array_length + vcount > aslots_count )
     {
         size_t expand_acount = array_expand_length( aslots_count, aslots_count + vcount );
-        vslots_object* expand = vslots_new( vm, expand_acount );
-
-        for ( size_t i = 0; i < array_length; ++i )
-        {
-            winit( expand->slots[ i ], read( aslots->slots[ i ] ) );
-        }
-
-        write( vm, array->aslots, expand );
-        aslots = expand;
+        aslots = array_expand( vm, array, expand_acount );
     }
 
-    // Uninitialized slots should be null, so no need for full write barrier.
+    // Slots past the end are null, but aslots might be older than values.
     for ( size_t i = 0; i < vcount; ++i )
     {
-        winit( aslots->slots[ array_length + i ], values[ i ] );
+        write( vm, aslots->slots[ array_length + i ], values[ i ] );
     }
 
     array->length = array_length + vcount;
@@ -109,36 +122,20 @@ value array_insert( vmachine* vm, array_object* array, size_t index, value value
         raise_error( ERROR_INDEX, "array index out of range" );
     }
 
-    if ( array_length + 1 <= aslots_count )
-    {
-        size_t i = array_length;
-        while ( i-- > index )
-        {
-            write( vm, aslots->slots[ i + 1 ], read( aslots->slots[ i ] ) );
-        }
-
-        write( vm, aslots->slots[ index ], value );
-    }
-    else
+    if ( array_length + 1 > aslots_count )
     {
         size_t expand_acount = array_expand_length( aslots_count, aslots_count + 1 );
-        vslots_object* expand = vslots_new( vm, expand_acount );
-
-        for ( size_t i = 0; i < index; ++i )
-        {
-            winit( expand->slots[ i ], read( aslots->slots[ i ] ) );
-        }
-
-        winit( expand->slots[ index ], value );
-
-        for ( size_t i = index; i < array_length; ++i )
-        {
-            winit( expand->slots[ i + 1 ], read( aslots->slots[ i ] ) );
-        }
+        aslots = array_expand( vm, array, expand_acount );
+    }
 
-        write( vm, array->aslots, expand );
+    size_t i = array_length;
+    while ( i-- > index )
+    {
+        write( vm, aslots->slots[ i + 1 ], read( aslots->slots[ i ] ) );
     }
 
+    write( vm, aslots->slots[ index ], value );
+
     array->length += 1;
     return value;
 }
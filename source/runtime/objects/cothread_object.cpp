@@ -10,21 +10,301 @@
 
 #include "cothread_object.h"
 #include "../call_stack.h"
+#include "function_object.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+#if defined( __linux__ ) && ! defined( MADV_GUARD_INSTALL )
+#define MADV_GUARD_INSTALL 102
+#endif
 
 namespace kf
 {
 
-cothread_object::cothread_object()
+/*
+    Cothread stacks are carved from slabs of virtual memory, each of which
+    holds many stacks.  Mapping each stack separately would run into the
+    limit on the number of mappings in a process long before memory ran out.
+    Pages are committed as each stack grows, and decommitted when it is
+    released, so its slot in the slab is as good as new.
+
+    Each stack is followed by a guard which is never committed.  On Windows
+    the guard is reserved memory, and on Linux it is installed with
+    MADV_GUARD_INSTALL, which does not split the slab's mapping.  Either way
+    an overrun faults rather than writing into the next stack.  Where guards
+    are not supported the gap is merely unused, and overflow is caught only
+    by the limit check in cothread_commit_stack.
+*/
+
+const size_t STACK_RESERVE_BYTES = COTHREAD_STACK_LIMIT * sizeof( value );
+const size_t STACK_GUARD_BYTES = 64 * 1024;
+const size_t STACK_SLOT_BYTES = STACK_RESERVE_BYTES + STACK_GUARD_BYTES;
+const size_t SLAB_BYTES = STACK_SLOT_BYTES * COTHREAD_SLAB_STACKS;
+
+#ifdef _WIN32
+
+static void* slab_reserve()
+{
+    return VirtualAlloc( NULL, SLAB_BYTES, MEM_RESERVE, PAGE_NOACCESS );
+}
+
+static bool stack_commit( value* stack, unsigned lower, unsigned upper )
+{
+    return VirtualAlloc( stack + lower, ( upper - lower ) * sizeof( value ), MEM_COMMIT, PAGE_READWRITE ) != NULL;
+}
+
+static void stack_decommit( value* stack, unsigned commit )
+{
+    if ( commit )
+    {
+        VirtualFree( stack, commit * sizeof( value ), MEM_DECOMMIT );
+    }
+}
+
+static void slab_release( void* slab )
+{
+    VirtualFree( slab, 0, MEM_RELEASE );
+}
+
+#else
+
+static void* slab_reserve()
+{
+    // Changing the protection of part of a mapping splits it, so the whole
+    // slab is mapped read-write and pages are only committed when touched.
+    void* p = mmap( nullptr, SLAB_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0 );
+    if ( p == MAP_FAILED )
+    {
+        return nullptr;
+    }
+
+#ifdef MADV_GUARD_INSTALL
+    // Older kernels reject the advice, leaving the guards as plain gaps.
+    for ( size_t i = 0; i < COTHREAD_SLAB_STACKS; ++i )
+    {
+        if ( madvise( (char*)p + i * STACK_SLOT_BYTES + STACK_RESERVE_BYTES, STACK_GUARD_BYTES, MADV_GUARD_INSTALL ) != 0 )
+        {
+            break;
+        }
+    }
+#endif
+
+    return p;
+}
+
+static bool stack_commit( value* stack, unsigned lower, unsigned upper )
+{
+    // The system commits pages lazily on first touch, so this can't fail.
+    // Running out of memory faults or wakes the OOM killer instead.
+    return true;
+}
+
+static void stack_decommit( value* stack, unsigned commit )
+{
+    if ( commit )
+    {
+        madvise( stack, commit * sizeof( value ), MADV_DONTNEED );
+    }
+}
+
+static void slab_release( void* slab )
+{
+    munmap( slab, SLAB_BYTES );
+}
+
+#endif
+
+static value* stack_reserve( cothread_pool* pool )
+{
+    // Pool must be locked.
+    if ( pool->free_stacks.empty() )
+    {
+        void* slab = slab_reserve();
+        if ( ! slab )
+        {
+            return nullptr;
+        }
+
+        pool->slabs.push_back( slab );
+        for ( size_t i = COTHREAD_SLAB_STACKS; i-- > 0; )
+        {
+            pool->free_stacks.push_back( (value*)( (char*)slab + i * STACK_SLOT_BYTES ) );
+        }
+    }
+
+    value* stack = pool->free_stacks.back();
+    pool->free_stacks.pop_back();
+    return stack;
+}
+
+static void stack_release( cothread_pool* pool, value* stack, unsigned commit )
+{
+    // Pool must be locked.
+    stack_decommit( stack, commit );
+    pool->free_stacks.push_back( stack );
+}
+
+cothread_object::cothread_object( cothread_stack&& s )
+    :   stack( s.stack )
+    ,   stack_size( 0 )
+    ,   stack_commit( s.stack_commit )
+    ,   stack_frames( std::move( s.stack_frames ) )
+    ,   xp( 0 )
+    ,   external_size( 0 )
 {
 }
 
 cothread_object::~cothread_object()
 {
+    // Stacks are recycled before cothread objects are destroyed.
+    assert( ! stack );
 }
 
 cothread_object* cothread_new( vmachine* vm )
 {
-    return new ( object_new( vm, COTHREAD_OBJECT, sizeof( cothread_object ) ) ) cothread_object();
+    cothread_pool* pool = vm->pool;
+    cothread_stack s = {};
+
+    // Reuse a pooled stack if there is one.
+    {
+        std::lock_guard lock( pool->mutex );
+        if ( ! pool->stacks.empty() )
+        {
+            s = std::move( pool->stacks.back() );
+            pool->stacks.pop_back();
+            pool->statistics.hits += 1;
+        }
+        else
+        {
+            s.stack = stack_reserve( pool );
+            pool->statistics.misses += 1;
+        }
+    }
+
+    if ( ! s.stack )
+    {
+        raise_error( ERROR_MEMORY, "out of memory reserving cothread stack" );
+    }
+
+    return new ( object_new( vm, COTHREAD_OBJECT, sizeof( cothread_object ) ) ) cothread_object( std::move( s ) );
+}
+
+void cothread_commit_stack( cothread_object* cothread, unsigned size )
+{
+    // Anything past the limit would run into the guard after the stack.
+    if ( size > COTHREAD_STACK_LIMIT )
+    {
+        raise_error( ERROR_STACK, "stack overflow" );
+    }
+
+    // Commit in large steps.  Newly committed memory is zero, i.e. null.
+    unsigned commit = ( size + ( COTHREAD_STACK_GRANULARITY - 1 ) ) & ~( COTHREAD_STACK_GRANULARITY - 1 );
+    if ( ! stack_commit( cothread->stack, cothread->stack_commit, commit ) )
+    {
+        raise_error( ERROR_MEMORY, "out of memory committing cothread stack" );
+    }
+    cothread->stack_commit = commit;
+}
+
+void cothread_charge_stack( vmachine* vm, cothread_object* cothread )
+{
+    // Charge for the pages of the stack which have been used, and for the
+    // frame vector, which has usually grown along with the stack.
+    size_t stack_pages = ( cothread->stack_size + ( COTHREAD_STACK_PAGE - 1 ) ) & ~( COTHREAD_STACK_PAGE - 1 );
+    size_t size = stack_pages * sizeof( value ) + cothread->stack_frames.capacity() * sizeof( stack_frame );
+    if ( size > cothread->external_size )
+    {
+        external_alloc( vm, cothread, size - cothread->external_size );
+        cothread->external_size = size;
+    }
+}
+
+void cothread_recycle_stack( vmachine* vm, cothread_object* cothread )
+{
+    // Called on completion by the mutator, or by the sweeper.
+    if ( ! cothread->stack )
+    {
+        return;
+    }
+
+    // Detach stack from cothread.  Committed memory above stack_size is
+    // always null, so clearing the used part makes the stack as good as new.
+    cothread_pool* pool = vm->pool;
+    cothread_stack s = { cothread->stack, cothread->stack_commit, std::move( cothread->stack_frames ) };
+    bool cleared = pool->limit.load( std::memory_order_relaxed ) != 0;
+    if ( cleared )
+    {
+        memset( s.stack, 0, cothread->stack_size * sizeof( value ) );
+        s.stack_frames.clear();
+    }
+    cothread->stack = nullptr;
+    cothread->stack_size = 0;
+    cothread->stack_commit = 0;
+    cothread->xp = 0;
+    external_free( vm, cothread->external_size );
+    cothread->external_size = 0;
+
+    std::lock_guard lock( pool->mutex );
+    if ( cleared && pool->stacks.size() < pool->limit.load( std::memory_order_relaxed ) )
+    {
+        pool->stacks.push_back( std::move( s ) );
+        pool->statistics.recycled += 1;
+    }
+    else
+    {
+        pool->statistics.released += 1;
+        stack_release( pool, s.stack, s.stack_commit );
+    }
+}
+
+void cothread_pool_set_limit( cothread_pool* pool, size_t limit )
+{
+    // Release pooled stacks beyond the new limit.
+    std::lock_guard lock( pool->mutex );
+    pool->limit.store( limit, std::memory_order_relaxed );
+    while ( pool->stacks.size() > limit )
+    {
+        cothread_stack& s = pool->stacks.back();
+        stack_release( pool, s.stack, s.stack_commit );
+        pool->stacks.pop_back();
+        pool->statistics.released += 1;
+    }
+}
+
+cothread_pool::cothread_pool()
+    :   limit( COTHREAD_POOL_DEFAULT_LIMIT )
+    ,   statistics{}
+{
+}
+
+cothread_pool::~cothread_pool()
+{
+    for ( void* slab : slabs )
+    {
+        slab_release( slab );
+    }
+}
+
+cothread_pool* cothread_pool_create()
+{
+    return new cothread_pool();
+}
+
+void cothread_pool_destroy( cothread_pool* pool )
+{
+    delete pool;
+}
+
+generator_object* generator_new( vmachine* vm, function_object* function, unsigned size )
+{
+    generator_object* generator = new ( object_new( vm, GENERATOR_OBJECT, sizeof( generator_object ) + size * sizeof( ref_value ) ) ) generator_object();
+    winit( generator->function, function );
+    generator->size = size;
+    return generator;
 }
 
 }
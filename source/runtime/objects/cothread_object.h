@@ -15,35 +15,120 @@
     A cothread is basically a single call stack - a 'fiber' or 'green thread'.
     A cothread can be suspended in the middle of a call stack, and then resumed
     later.  Each instance of a generator is a new cothread.
+
+    Generators which never use 'yield for' can only ever suspend their own
+    frame.  These are stackless generators, which save their registers in a
+    generator object when they yield.  When resumed, the saved registers are
+    copied onto the stack of the resuming cothread, above the caller's frame.
+
+    The value stack is a range of virtual memory reserved when the cothread
+    is created.  Pages are committed as the stack grows, so the stack never
+    moves and pointers into it remain valid.  Stacks are carved from larger
+    slabs of reserved memory, so that programs with many live cothreads do
+    not need a mapping for each one.  If memory cannot be reserved,
+    ERROR_MEMORY is raised.  On Windows, so is a failure to commit.  POSIX
+    systems commit pages when they are first touched, so running out of
+    memory there is left to the system.
+
+    Reserving a stack and allocating a frame vector for every new cothread is
+    expensive.  When a cothread completes, or is swept, its stack and frame
+    vector are returned to a per-runtime pool, up to a limit, and reused by
+    the next cothread created.  The sweeper runs on the GC thread, so the pool
+    is locked.
+
+    The pages of the stack which have been used, and the frame vector, are
+    charged as external memory, so that they count towards GC pacing.  The
+    charge is returned when the stack is detached from the cothread.
 */
 
 #include <vector>
+#include <mutex>
+#include <atomic>
 #include "../vmachine.h"
 
 namespace kf
 {
 
 struct stack_frame;
+struct function_object;
 
 /*
     Structures.
 */
 
+struct cothread_stack
+{
+    value* stack;
+    unsigned stack_commit;
+    std::vector< stack_frame > stack_frames;
+};
+
 struct cothread_object : public object
 {
-    cothread_object();
+    explicit cothread_object( cothread_stack&& s );
     ~cothread_object();
 
-    std::vector< value > stack;
+    value* stack;
+    unsigned stack_size;
+    unsigned stack_commit;
     std::vector< stack_frame > stack_frames;
     unsigned xp;
+    size_t external_size;
+};
+
+struct generator_object : public object
+{
+    ref< function_object > function;
+    unsigned ip;        // resume instruction pointer
+    unsigned fp;        // frame pointer, above varargs
+    unsigned size;      // count of saved registers
+    uint8_t xr;         // lower index of yield results
+    uint8_t xb;         // upper index of yield results
+    bool running;       // currently executing on a cothread
+    ref_value slots[];
 };
 
+struct cothread_pool_statistics
+{
+    uint64_t hits;          // cothread reused a pooled stack.
+    uint64_t misses;        // cothread reserved a new stack.
+    uint64_t recycled;      // stack returned to the pool.
+    uint64_t released;      // stack released as the pool was full.
+};
+
+struct cothread_pool
+{
+    cothread_pool();
+    ~cothread_pool();
+
+    std::mutex mutex;
+    std::vector< cothread_stack > stacks;
+    std::vector< void* > slabs;
+    std::vector< value* > free_stacks;
+    std::atomic< size_t > limit;
+    cothread_pool_statistics statistics;
+};
+
+const unsigned COTHREAD_STACK_LIMIT = 1024 * 1024;
+const unsigned COTHREAD_STACK_GRANULARITY = 64 * 1024 / sizeof( value );
+const unsigned COTHREAD_STACK_PAGE = 4096 / sizeof( value );
+const size_t COTHREAD_POOL_DEFAULT_LIMIT = 64;
+const size_t COTHREAD_SLAB_STACKS = 64;
+
 /*
     Functions.
 */
 
 cothread_object* cothread_new( vmachine* vm );
+void cothread_commit_stack( cothread_object* cothread, unsigned size );
+void cothread_charge_stack( vmachine* vm, cothread_object* cothread );
+void cothread_recycle_stack( vmachine* vm, cothread_object* cothread );
+
+cothread_pool* cothread_pool_create();
+void cothread_pool_set_limit( cothread_pool* pool, size_t limit );
+void cothread_pool_destroy( cothread_pool* pool );
+
+generator_object* generator_new( vmachine* vm, function_object* function, unsigned size );
 
 }
 
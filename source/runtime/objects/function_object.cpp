@@ -73,13 +73,27 @@ program_object* program_new( vmachine* vm, const void* data, size_t size )
         // Get name.
         const char* name = debug_heap + df->function_name;
 
-        // Calculate size of program required.
+        // Count method call sites.
+        const op* ops = cf->ops();
+        size_t msite_count = 0;
+        for ( size_t i = 0; i < cf->op_count; ++i )
+        {
+            if ( ops[ i ].opcode == OP_MCALL || ops[ i ].opcode == OP_MCALLR )
+            {
+                msite_count += 1;
+                i += 1;
+            }
+        }
+
+        // Calculate size of program required.  Constants and the tables
+        // that follow the ops are 8-byte aligned.
         size_t op_count = ( cf->op_count + 1 ) & ~(size_t)1;
         size_t size = sizeof( program_object );
         size += sizeof( op ) * op_count;
         size += sizeof( ref_value ) * cf->constant_count;
         size += sizeof( key_selector ) * cf->selector_count;
         size += sizeof( ref< program_object > ) * cf->function_count;
+        size += sizeof( method_site ) * msite_count;
         size += sizeof( uint32_t ) * cf->op_count;
         size += strlen( name );
 
@@ -92,17 +106,32 @@ program_object* program_new( vmachine* vm, const void* data, size_t size )
         program->constant_count = cf->constant_count;
         program->selector_count = cf->selector_count;
         program->function_count = cf->function_count;
+        program->msite_count = msite_count;
         program->outenv_count = cf->outenv_count;
         program->param_count = cf->param_count;
         program->stack_size = cf->stack_size;
         program->code_flags = cf->code_flags;
 
-        program->constants = (ref_value*)( program->ops + program->op_count );
+        program->constants = (ref_value*)( program->ops + op_count );
         program->selectors = (key_selector*)( program->constants + program->constant_count );
         program->functions = (ref< program_object >*)( program->selectors + program->selector_count );
+        program->msites = (method_site*)( program->functions + program->function_count );
 
         memcpy( program->ops, cf->ops(), sizeof( op ) * program->op_count );
 
+        // Method call sites are indexed by the op following the call.
+        size_t msite_index = 0;
+        for ( size_t i = 0; i < program->op_count; ++i )
+        {
+            if ( program->ops[ i ].opcode == OP_MCALL || program->ops[ i ].opcode == OP_MCALLR )
+            {
+                op* sop = program->ops + i + 1;
+                program->msites[ msite_index ].selector = sop->c;
+                sop->c = msite_index++;
+                i += 1;
+            }
+        }
+
         const code_constant* constants = cf->constants();
         for ( size_t i = 0; i < program->constant_count; ++i )
         {
@@ -125,7 +154,7 @@ program_object* program_new( vmachine* vm, const void* data, size_t size )
             winit( ksel->key, string_key( vm, heap + s.text, s.size ) );
         }
 
-        uint32_t* slocs = (uint32_t*)( program->functions + program->function_count );
+        uint32_t* slocs = (uint32_t*)( program->msites + program->msite_count );
         memcpy( slocs, df->slocs(), sizeof( uint32_t ) * program->op_count );
 
         char* name_text = (char*)( slocs + program->op_count );
@@ -153,7 +182,7 @@ program_object* program_new( vmachine* vm, const void* data, size_t size )
 
 std::string_view program_name( vmachine* vm, program_object* program )
 {
-    const char* text = (const char*)( (uint32_t*)( program->functions + program->function_count ) + program->op_count );
+    const char* text = (const char*)( (uint32_t*)( program->msites + program->msite_count ) + program->op_count );
     return std::string_view( text, program->name_size );
 }
 
@@ -161,7 +190,7 @@ source_location program_source_location( vmachine* vm, program_object* program,
 {
     // Get sloc.
     ip = std::min( ip, program->op_count - 1u );
-    uint32_t sloc = ( (const uint32_t*)( program->functions + program->function_count ) )[ ip ];
+    uint32_t sloc = ( (const uint32_t*)( program->msites + program->msite_count ) )[ ip ];
 
     // Search script for newline.
     script_object* script = read( program->script );
@@ -18,6 +18,7 @@
 #include <string_view>
 #include "../vmachine.h"
 #include "lookup_object.h"
+#include "../jit.h"
 #include "../../common/code.h"
 
 namespace kf
@@ -33,6 +34,19 @@ struct source_location
     unsigned column;
 };
 
+/*
+    Method call sites.  Each MCALL instruction has a cache which remembers the
+    slot containing the method for the last receiver layout, and the last
+    function called.  If the method is unchanged the call skips dispatch.
+*/
+
+struct method_site
+{
+    selector_way way;
+    ref< object > callee;
+    uint32_t selector;
+};
+
 /*
     Objects.
 */
@@ -49,17 +63,23 @@ struct program_object : public object
     ref_value* constants;
     key_selector* selectors;
     ref< program_object >* functions;
+    method_site* msites;
+#ifdef KF_JIT
+    jit_code* jit;
+    uint32_t jit_count;
+#endif
     ref< script_object > script;
     uint32_t name_size;
     uint16_t op_count;
     uint16_t constant_count;
     uint16_t selector_count;
     uint16_t function_count;
+    uint16_t msite_count;
     uint8_t outenv_count;
     uint8_t param_count;
     uint8_t stack_size;
     uint8_t code_flags;
-    op ops[];
+    alignas( 8 ) op ops[];
 };
 
 struct function_object : public object
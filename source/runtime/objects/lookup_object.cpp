@@ -117,6 +117,12 @@ bool lookup_sealed( vmachine* vm, lookup_object* object )
     return ( header( object )->flags & FLAG_SEALED ) != 0;
 }
 
+static inline size_t megamorphic_index( uint32_t cookie, string_object* key )
+{
+    uintptr_t hash = (uintptr_t)cookie * UINT32_C( 0x9E3779B1 ) ^ (uintptr_t)key >> 4;
+    return ( hash ^ hash >> 16 ) & ( MEGAMORPHIC_CACHE_SIZE - 1 );
+}
+
 static layout_object* next_layout( vmachine* vm, layout_object* layout, string_object* key )
 {
     // Check if we can follow the next layout chain.
@@ -187,21 +193,84 @@ void lookup_addkeyslot( vmachine* vm, lookup_object* object, size_t index, std::
     assert( layout->sindex == index );
 }
 
-bool lookup_getsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel )
+static const selector_way* probe_selector( vmachine* vm, selector* sel, string_object* key, uint32_t cookie, bool setsel )
+{
+    // Check ways of selector.
+    for ( size_t i = 1; i < SELECTOR_WAYS; ++i )
+    {
+        const selector_way* way = sel->ways + i;
+        if ( way->cookie == cookie && ( ! setsel || way->sindex != ~(uint32_t)0 ) )
+        {
+            vm->selector_stats.poly_hits += 1;
+            return way;
+        }
+    }
+
+    // Check megamorphic cache.
+    if ( sel->megamorphic )
+    {
+        const megamorphic_entry* entry = vm->megamorphic_cache + megamorphic_index( cookie, key );
+        if ( entry->way.cookie == cookie && entry->key == key && ( ! setsel || entry->way.sindex != ~(uint32_t)0 ) )
+        {
+            vm->selector_stats.mega_hits += 1;
+            return &entry->way;
+        }
+    }
+
+    vm->selector_stats.misses += 1;
+    return nullptr;
+}
+
+static const selector_way* update_selector( vmachine* vm, selector* sel, string_object* key, uint32_t cookie, uint32_t sindex, ref_value* slot )
+{
+    // Replace a way that already caches this layout.  Otherwise fill ways
+    // in order.  Once all are in use, the selector is megamorphic.
+    selector_way* way = nullptr;
+    for ( size_t i = 0; i < sel->next_way; ++i )
+    {
+        if ( sel->ways[ i ].cookie == cookie )
+        {
+            way = sel->ways + i;
+            break;
+        }
+    }
+
+    if ( ! way && sel->next_way < SELECTOR_WAYS )
+    {
+        way = sel->ways + sel->next_way++;
+    }
+    else if ( ! way )
+    {
+        sel->megamorphic = true;
+        megamorphic_entry* entry = vm->megamorphic_cache + megamorphic_index( cookie, key );
+        entry->key = key;
+        way = &entry->way;
+    }
+
+    way->cookie = cookie;
+    way->sindex = sindex;
+    way->slot = slot;
+    return way;
+}
+
+const selector_way* lookup_getsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel )
 {
     assert( header( key )->flags & FLAG_KEY );
     layout_object* lookup_layout = read( object->layout );
 
+    // Check remaining cache entries.
+    if ( const selector_way* way = probe_selector( vm, sel, key, lookup_layout->cookie, false ) )
+    {
+        return way;
+    }
+
     // Search layout list for key.
     layout_object* layout = lookup_layout;
     while ( string_object* layout_key = read( layout->key ) )
     {
         if ( layout_key == key )
         {
-            sel->cookie = lookup_layout->cookie;
-            sel->sindex = layout->sindex;
-            sel->slot = nullptr;
-            return true;
+            return update_selector( vm, sel, key, lookup_layout->cookie, layout->sindex, nullptr );
         }
         layout = (layout_object*)read( layout->parent );
     }
@@ -220,33 +289,34 @@ bool lookup_getsel( vmachine* vm, lookup_object* object, string_object* key, sel
         {
             if ( layout_key == key )
             {
-                sel->cookie = lookup_layout->cookie;
-                sel->sindex = ~(uint32_t)0;
-                sel->slot = &read( object->oslots )->slots[ layout->sindex ];
-                return true;
+                ref_value* slot = &read( object->oslots )->slots[ layout->sindex ];
+                return update_selector( vm, sel, key, lookup_layout->cookie, ~(uint32_t)0, slot );
             }
             layout = (layout_object*)read( layout->parent );
         }
     }
 
-    return false;
+    return nullptr;
 }
 
-void lookup_setsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel )
+const selector_way* lookup_setsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel )
 {
     assert( header( key )->flags & FLAG_KEY );
     layout_object* lookup_layout = read( object->layout );
 
+    // Check remaining cache entries.
+    if ( const selector_way* way = probe_selector( vm, sel, key, lookup_layout->cookie, true ) )
+    {
+        return way;
+    }
+
     // Search layout list for key.
     layout_object* layout = lookup_layout;
     while ( string_object* layout_key = read( layout->key ) )
     {
         if ( layout_key == key )
         {
-            sel->cookie = layout->cookie;
-            sel->sindex = layout->sindex;
-            sel->slot = nullptr;
-            return;
+            return update_selector( vm, sel, key, lookup_layout->cookie, layout->sindex, nullptr );
         }
         layout = (layout_object*)read( layout->parent );
     }
@@ -261,10 +331,7 @@ void lookup_setsel( vmachine* vm, lookup_object* object, string_object* key, sel
     layout = update_layout( vm, object, lookup_layout, key );
 
     // Created slot.
-    sel->cookie = layout->cookie;
-    sel->sindex = layout->sindex;
-    sel->slot = nullptr;
-    return;
+    return update_selector( vm, sel, key, layout->cookie, layout->sindex, nullptr );
 }
 
 bool lookup_haskey( vmachine* vm, lookup_object* object, string_object* key )
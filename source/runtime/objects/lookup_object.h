@@ -38,7 +38,10 @@
 
     Lookups are performed using a selector.  A selector caches the result of
     lookup so that subsequent lookups with the same selector on the same
-    layout can reuse the result.
+    layout can reuse the result.  Selectors are polymorphic - each selector
+    can cache results for several layouts.  The first way is checked inline,
+    the remaining ways and the vm's megamorphic cache are checked before
+    falling back to searching the layout chain.
 */
 
 #include <functional>
@@ -93,6 +96,8 @@ void lookup_addkeyslot( vmachine* vm, lookup_object* object, size_t index, std::
 value lookup_getkeyslot( vmachine* vm, lookup_object* object, size_t index );
 void lookup_setkeyslot( vmachine* vm, lookup_object* object, size_t index, value value );
 
+const selector_way* lookup_getway( vmachine* vm, lookup_object* object, string_object* key, selector* sel );
+value lookup_getway_value( lookup_object* object, const selector_way* way );
 value lookup_getkey( vmachine* vm, lookup_object* object, string_object* key, selector* sel );
 void lookup_setkey( vmachine* vm, lookup_object* object, string_object* key, selector* sel, value value );
 bool lookup_haskey( vmachine* vm, lookup_object* object, string_object* key );
@@ -126,36 +131,61 @@ inline void lookup_setkeyslot( vmachine* vm, lookup_object* object, size_t index
     }
 }
 
-inline value lookup_getkey( vmachine* vm, lookup_object* object, string_object* key, selector* sel )
+inline const selector_way* lookup_getway( vmachine* vm, lookup_object* object, string_object* key, selector* sel )
 {
     layout_object* layout = read( object->layout );
-    extern bool lookup_getsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel );
-    if ( sel->cookie == layout->cookie || lookup_getsel( vm, object, key, sel ) )
+    const selector_way* way = sel->ways;
+#ifdef KF_SELECTOR_STATS
+    if ( way->cookie == layout->cookie )
     {
-        if ( sel->sindex != ~(uint32_t)0 )
-        {
-            return read( read( object->oslots )->slots[ sel->sindex ] );
-        }
-        else
+        vm->selector_stats.mono_hits += 1;
+    }
+#endif
+    if ( way->cookie != layout->cookie )
+    {
+        extern const selector_way* lookup_getsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel );
+        way = lookup_getsel( vm, object, key, sel );
+        if ( ! way )
         {
-            return read( *sel->slot );
+            raise_error( ERROR_KEY, "key '%s' not found", key->text );
         }
     }
+    return way;
+}
+
+inline value lookup_getway_value( lookup_object* object, const selector_way* way )
+{
+    if ( way->sindex != ~(uint32_t)0 )
+    {
+        return read( read( object->oslots )->slots[ way->sindex ] );
+    }
     else
     {
-        raise_error( ERROR_KEY, "key '%s' not found", key->text );
+        return read( *way->slot );
     }
 }
 
+inline value lookup_getkey( vmachine* vm, lookup_object* object, string_object* key, selector* sel )
+{
+    return lookup_getway_value( object, lookup_getway( vm, object, key, sel ) );
+}
+
 inline void lookup_setkey( vmachine* vm, lookup_object* object, string_object* key, selector* sel, value value )
 {
     layout_object* layout = read( object->layout );
-    if ( sel->cookie != layout->cookie || sel->sindex == ~(uint32_t)0 )
+    const selector_way* way = sel->ways;
+#ifdef KF_SELECTOR_STATS
+    if ( way->cookie == layout->cookie && way->sindex != ~(uint32_t)0 )
+    {
+        vm->selector_stats.mono_hits += 1;
+    }
+#endif
+    if ( way->cookie != layout->cookie || way->sindex == ~(uint32_t)0 )
     {
-        extern void lookup_setsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel );
-        lookup_setsel( vm, object, key, sel );
+        extern const selector_way* lookup_setsel( vmachine* vm, lookup_object* object, string_object* key, selector* sel );
+        way = lookup_setsel( vm, object, key, sel );
     }
-    write( vm, read( object->oslots )->slots[ sel->sindex ], value );
+    write( vm, read( object->oslots )->slots[ way->sindex ], value );
 }
 
 }
@@ -52,9 +52,10 @@ string_object* string_key( vmachine* vm, const char* text, size_t size )
     }
 
     string_object* string = string_new( vm, text, size );
+    string->hash = hash;
     hashkey = { hash, string->size, string->text };
 
-    header( string )->flags |= FLAG_KEY;
+    header( string )->flags |= FLAG_KEY | FLAG_HASHED;
     vm->keys.insert_or_assign( hashkey, string );
     return string;
 }
@@ -14,6 +14,11 @@
 /*
     This is a UTF-8 string.  Strings store their length explicitly, and are
     also null-terminated.  This makes our lives easier.
+
+    A string's hash is calculated the first time it is needed, and cached in
+    the object.  Strings are immutable once they escape, so the hash never
+    goes stale.  Key strings are unique, so two different keys never compare
+    equal, and strings with different cached hashes are not equal either.
 */
 
 #include <stddef.h>
@@ -32,6 +37,7 @@ namespace kf
 struct string_object : public object
 {
     size_t size;
+    size_t hash;    // Valid if FLAG_HASHED is set.
     char text[];
 };
 
@@ -41,6 +47,7 @@ struct string_object : public object
 
 string_object* string_new( vmachine* vm, const char* text, size_t size );
 size_t string_hash( vmachine* vm, string_object* string );
+bool string_equal( string_object* a, string_object* b );
 string_object* string_key( vmachine* vm, string_object* string );
 string_object* string_key( vmachine* vm, const char* text, size_t size );
 string_object* string_getindex( vmachine* vm, string_object* string, size_t index );
@@ -51,7 +58,33 @@ string_object* string_getindex( vmachine* vm, string_object* string, size_t inde
 
 inline size_t string_hash( vmachine* vm, string_object* string )
 {
-    return std::hash< std::string_view >()( std::string_view( string->text, string->size ) );
+    object_header* h = header( string );
+    if ( ! ( h->flags & FLAG_HASHED ) )
+    {
+        string->hash = std::hash< std::string_view >()( std::string_view( string->text, string->size ) );
+        h->flags |= FLAG_HASHED;
+    }
+    return string->hash;
+}
+
+inline bool string_equal( string_object* a, string_object* b )
+{
+    if ( a == b )
+    {
+        return true;
+    }
+
+    uint8_t flags = header( a )->flags & header( b )->flags;
+    if ( flags & FLAG_KEY )
+    {
+        return false;
+    }
+    if ( ( flags & FLAG_HASHED ) && a->hash != b->hash )
+    {
+        return false;
+    }
+
+    return a->size == b->size && memcmp( a->text, b->text, a->size ) == 0;
 }
 
 inline string_object* string_key( vmachine* vm, string_object* string )
@@ -11,7 +11,15 @@
 #include "table_object.h"
 #include "string_object.h"
 #include <limits.h>
-#include <functional>
+#include <string.h>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define KF_TABLE_SSE2
+#include <emmintrin.h>
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#define KF_TABLE_NEON
+#include <arm_neon.h>
+#endif
 
 #ifdef _MSC_VER
 #include <intrin.h>
@@ -22,23 +30,38 @@ namespace kf
 
 #ifdef _MSC_VER
 
-static inline size_t clz( unsigned __int64 x )
+static inline unsigned clz( uint64_t x )
 {
     unsigned long result;
     return _BitScanReverse64( &result, x ) ? 63 - result : 64;
 }
 
-static inline size_t clz( unsigned long x )
+static inline unsigned ctz( uint64_t x )
 {
     unsigned long result;
-    return _BitScanReverse( &result, x ) ? 31 - result : 32;
+    return _BitScanForward64( &result, x ) ? result : 64;
+}
+
+static inline unsigned popcount( uint64_t x )
+{
+    return (unsigned)__popcnt64( x );
 }
 
 #else
 
-static inline size_t clz( size_t x )
+static inline unsigned clz( uint64_t x )
+{
+    return __builtin_clzll( x );
+}
+
+static inline unsigned ctz( uint64_t x )
+{
+    return __builtin_ctzll( x );
+}
+
+static inline unsigned popcount( uint64_t x )
 {
-    return __builtin_clz( x );
+    return __builtin_popcountll( x );
 }
 
 #endif
@@ -50,11 +73,85 @@ static inline size_t clz( size_t x )
 static inline size_t ceilpow2( size_t x )
 {
     if ( x > 1 )
-        return 1 << ( sizeof( size_t ) * CHAR_BIT - clz( x - 1 ) );
+        return (size_t)1 << ( 64 - clz( x - 1 ) );
     else
         return 1;
 }
 
+/*
+    Compare a group of control bytes at once.  Each match method returns a
+    mask with one bit set for each matching slot.  The slot index of the
+    lowest set bit is ctz( mask ) >> GROUP_SHIFT.
+*/
+
+#if defined( KF_TABLE_SSE2 )
+
+const unsigned GROUP_SHIFT = 0;
+
+struct control_group
+{
+    explicit control_group( const uint8_t* p ) : c( _mm_loadu_si128( (const __m128i*)p ) ) {}
+    uint64_t match( uint8_t h ) const   { return (unsigned)_mm_movemask_epi8( _mm_cmpeq_epi8( c, _mm_set1_epi8( (char)h ) ) ); }
+    uint64_t match_empty() const        { return match( KVSLOT_EMPTY ); }
+    uint64_t match_full() const         { return (unsigned)_mm_movemask_epi8( c ); }
+    uint64_t match_free() const         { return match_full() ^ 0xFFFF; }
+    __m128i c;
+};
+
+#elif defined( KF_TABLE_NEON )
+
+const unsigned GROUP_SHIFT = 2;
+
+struct control_group
+{
+    explicit control_group( const uint8_t* p ) : c( vld1q_u8( p ) ) {}
+    uint64_t match( uint8_t h ) const   { return mask( vceqq_u8( c, vdupq_n_u8( h ) ) ); }
+    uint64_t match_empty() const        { return mask( vceqzq_u8( c ) ); }
+    uint64_t match_full() const         { return mask( vcltzq_s8( vreinterpretq_s8_u8( c ) ) ); }
+    uint64_t match_free() const         { return match_full() ^ 0x8888888888888888; }
+    uint8x16_t c;
+
+    // Narrow each byte of the comparison to a nibble, keeping one bit.
+    static uint64_t mask( uint8x16_t m )
+    {
+        uint8x8_t n = vshrn_n_u16( vreinterpretq_u16_u8( m ), 4 );
+        return vget_lane_u64( vreinterpret_u64_u8( n ), 0 ) & 0x8888888888888888;
+    }
+};
+
+#else
+
+const unsigned GROUP_SHIFT = 0;
+
+struct control_group
+{
+    explicit control_group( const uint8_t* p ) { memcpy( c, p, KVSLOTS_GROUP ); }
+    uint64_t match( uint8_t h ) const
+    {
+        uint64_t mask = 0;
+        for ( size_t i = 0; i < KVSLOTS_GROUP; ++i )
+            mask |= (uint64_t)( c[ i ] == h ) << i;
+        return mask;
+    }
+    uint64_t match_empty() const        { return match( KVSLOT_EMPTY ); }
+    uint64_t match_full() const
+    {
+        uint64_t mask = 0;
+        for ( size_t i = 0; i < KVSLOTS_GROUP; ++i )
+            mask |= (uint64_t)( c[ i ] >> 7 ) << i;
+        return mask;
+    }
+    uint64_t match_free() const         { return match_full() ^ 0xFFFF; }
+    uint8_t c[ KVSLOTS_GROUP ];
+};
+
+#endif
+
+static inline size_t mask_index( uint64_t mask )
+{
+    return ctz( mask ) >> GROUP_SHIFT;
+}
+
 /*
     When used as keys, -0.0 becomes 0.0.
 */
@@ -72,46 +169,322 @@ static inline value key_value( value value )
 
 }
 
-static inline size_t key_hash( value key )
+/*
+    The bits of small integers, and of object pointers, differ only in a few
+    places, so they are mixed using the MurmurHash3 finalizer.  Strings are
+    hashed by content.  The low seven bits of the hash go in the control byte,
+    and the rest select the first group to probe.
+*/
+
+static inline uint64_t mix_hash( uint64_t x )
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCD;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53;
+    x ^= x >> 33;
+    return x;
+}
+
+static inline size_t key_hash( vmachine* vm, value key )
 {
     if ( ! box_is_string( key ) )
     {
-        return std::hash< uint64_t >()( key.v );
+        return (size_t)mix_hash( key.v );
     }
     else
     {
-        string_object* string = unbox_string( key );
-        return std::hash< std::string_view >()( std::string_view( string->text, string->size ) );
+        return string_hash( vm, unbox_string( key ) );
     }
 }
 
+static inline uint8_t key_control( size_t hash )
+{
+    return KVSLOT_FULL | ( hash & 0x7F );
+}
+
+static bool key_equal_string( value a, value b )
+{
+    return box_is_string( a ) && box_is_string( b ) && string_equal( unbox_string( a ), unbox_string( b ) );
+}
+
 static inline bool key_equal( value a, value b )
 {
-    if ( a.v == b.v )
+    return a.v == b.v || key_equal_string( a, b );
+}
+
+/*
+    Key/value slot list.
+*/
+
+static inline size_t kvslots_growth( size_t count )
+{
+    // Tables are at most 7/8ths full.
+    return count - count / 8;
+}
+
+static inline size_t kvslots_count( size_t length )
+{
+    // Smallest count with room for length keys.
+    return ceilpow2( std::max< size_t >( length + length / 7, KVSLOTS_GROUP ) );
+}
+
+kvslots_object* kvslots_new( vmachine* vm, size_t count )
+{
+    assert( count >= KVSLOTS_GROUP && ( count & ( count - 1 ) ) == 0 );
+    size_t size = sizeof( kvslots_object ) + count * sizeof( kvslot ) + count;
+    kvslots_object* kvslots = new ( object_new( vm, KVSLOTS_OBJECT, size ) ) kvslots_object();
+    kvslots->count = count;
+    kvslots->growth_left = kvslots_growth( count );
+    return kvslots;
+}
+
+static kvslot* kvslots_lookup( kvslots_object* kvslots, value key, size_t hash )
+{
+    const uint8_t* control = kvslots_control( kvslots );
+    uint8_t h = key_control( hash );
+    size_t group_mask = kvslots->count / KVSLOTS_GROUP - 1;
+    size_t group = ( hash >> 7 ) & group_mask;
+    for ( size_t probe = 1; ; ++probe )
     {
-        return true;
+        size_t base = group * KVSLOTS_GROUP;
+        control_group g( control + base );
+        for ( uint64_t mask = g.match( h ); mask; mask &= mask - 1 )
+        {
+            kvslot* slot = kvslots->slots + base + mask_index( mask );
+            if ( key_equal( read( slot->k ), key ) )
+            {
+                return slot;
+            }
+        }
+
+        // A key is never placed beyond a group with an empty slot.
+        if ( g.match_empty() )
+        {
+            return nullptr;
+        }
+
+        group = ( group + probe ) & group_mask;
+    }
+}
+
+static kvslot* kvslots_insert( kvslots_object* kvslots, size_t hash )
+{
+    uint8_t* control = kvslots_control( kvslots );
+    size_t group_mask = kvslots->count / KVSLOTS_GROUP - 1;
+    size_t group = ( hash >> 7 ) & group_mask;
+    for ( size_t probe = 1; ; ++probe )
+    {
+        size_t base = group * KVSLOTS_GROUP;
+        uint64_t mask = control_group( control + base ).match_free();
+        if ( mask )
+        {
+            size_t index = base + mask_index( mask );
+            if ( control[ index ] == KVSLOT_EMPTY )
+            {
+                assert( kvslots->growth_left );
+                kvslots->growth_left -= 1;
+            }
+            control[ index ] = key_control( hash );
+            return kvslots->slots + index;
+        }
+
+        group = ( group + probe ) & group_mask;
+    }
+}
+
+static size_t kvslots_next( kvslots_object* kvslots, size_t i )
+{
+    const uint8_t* control = kvslots_control( kvslots );
+    size_t count = kvslots->count;
+    while ( i < count )
+    {
+        size_t base = i & ~( KVSLOTS_GROUP - 1 );
+        uint64_t mask = control_group( control + base ).match_full() >> ( ( i - base ) << GROUP_SHIFT );
+        if ( mask )
+        {
+            return i + mask_index( mask );
+        }
+        i = base + KVSLOTS_GROUP;
     }
+    return count;
+}
 
-    if ( box_is_string( a ) && box_is_string( b ) )
+static size_t kvslots_length( kvslots_object* kvslots )
+{
+    const uint8_t* control = kvslots_control( kvslots );
+    size_t length = 0;
+    for ( size_t base = 0; base < kvslots->count; base += KVSLOTS_GROUP )
     {
-        string_object* sa = unbox_string( a );
-        string_object* sb = unbox_string( b );
-        return sa->size == sb->size && memcmp( sa->text, sb->text, sa->size ) == 0;
+        length += popcount( control_group( control + base ).match_full() );
     }
+    return length;
+}
+
+/*
+    Array part.  Integer keys are counted in slices, where slice 0 holds key
+    0, and slice b holds keys from 2^(b-1) up to 2^b.
+*/
+
+const unsigned ARRAY_SLICES = 32;
+const size_t ARRAY_MAX = (size_t)1 << ( ARRAY_SLICES - 1 );
 
+static inline bool array_key( value key, size_t* out_index )
+{
+    if ( box_is_number( key ) )
+    {
+        double n = unbox_number( key );
+        if ( n >= 0 && n < (double)ARRAY_MAX )
+        {
+            size_t index = (size_t)n;
+            if ( (double)index == n )
+            {
+                *out_index = index;
+                return true;
+            }
+        }
+    }
     return false;
 }
 
+static inline unsigned array_slice( size_t index )
+{
+    return index ? 64 - clz( index ) : 0;
+}
+
+static size_t array_count( table_object* table, value key, size_t* out_array_length )
+{
+    // Count integer keys in each slice, including the key being inserted.
+    size_t slices[ ARRAY_SLICES ] = {};
+    size_t candidates = 0;
+    size_t index;
+
+    vslots_object* aslots = read( table->aslots );
+    for ( size_t i = 0; i < table->acount; ++i )
+    {
+        if ( read( aslots->slots[ i ] ).v != TABLE_ABSENT.v )
+        {
+            slices[ array_slice( i ) ] += 1;
+            candidates += 1;
+        }
+    }
+
+    kvslots_object* kvslots = read( table->kvslots );
+    if ( kvslots )
+    {
+        const uint8_t* control = kvslots_control( kvslots );
+        for ( size_t i = 0; i < kvslots->count; ++i )
+        {
+            if ( ( control[ i ] & KVSLOT_FULL ) && array_key( read( kvslots->slots[ i ].k ), &index ) )
+            {
+                slices[ array_slice( index ) ] += 1;
+                candidates += 1;
+            }
+        }
+    }
+
+    if ( array_key( key, &index ) )
+    {
+        slices[ array_slice( index ) ] += 1;
+        candidates += 1;
+    }
+
+    // Find the largest power of two where more than half the keys below it
+    // are present.
+    size_t acount = 0;
+    size_t array_length = 0;
+    size_t below = 0;
+    for ( unsigned b = 0; b < ARRAY_SLICES; ++b )
+    {
+        size_t size = (size_t)1 << b;
+        if ( candidates <= size / 2 )
+        {
+            break;
+        }
+
+        below += slices[ b ];
+        if ( below > size / 2 )
+        {
+            acount = size;
+            array_length = below;
+        }
+    }
+
+    *out_array_length = array_length;
+    return acount;
+}
+
 /*
-    Key/value slot list.
+    Hash part lookup, and incremental rehashing.  While migrating, the old
+    kvslots' growth_left counts the keys left in it.
 */
 
-kvslots_object* kvslots_new( vmachine* vm, size_t count )
+static kvslot* table_lookup( table_object* table, value key, size_t hash, kvslots_object** out_kvslots )
 {
-    kvslots_object* kvslots = new ( object_new( vm, KVSLOTS_OBJECT, sizeof( kvslots_object ) + ( count + 1 ) * sizeof( kvslot ) ) ) kvslots_object();
-    kvslots->count = count;
-    kvslots->slots[ count ].next = (kvslot*)-1;
-    return kvslots;
+    kvslots_object* kvslots = read( table->kvslots );
+    kvslot* slot = kvslots_lookup( kvslots, key, hash );
+    if ( slot )
+    {
+        *out_kvslots = kvslots;
+        return slot;
+    }
+
+    // Check slots in the old kvslots which haven't migrated yet.
+    kvslots_object* old_kvslots = read( table->old_kvslots );
+    if ( old_kvslots )
+    {
+        slot = kvslots_lookup( old_kvslots, key, hash );
+        if ( slot && (size_t)( slot - old_kvslots->slots ) >= table->migrate )
+        {
+            *out_kvslots = old_kvslots;
+            return slot;
+        }
+    }
+
+    return nullptr;
+}
+
+static void table_migrate( vmachine* vm, table_object* table, size_t slots )
+{
+    kvslots_object* old_kvslots = read( table->old_kvslots );
+    kvslots_object* kvslots = read( table->kvslots );
+    size_t i = table->migrate;
+    size_t end = slots < old_kvslots->count - i ? i + slots : old_kvslots->count;
+    for ( i = kvslots_next( old_kvslots, i ); i < end; i = kvslots_next( old_kvslots, i + 1 ) )
+    {
+        const kvslot* kval = old_kvslots->slots + i;
+        value k = read( kval->k );
+        kvslot* slot = kvslots_insert( kvslots, key_hash( vm, k ) );
+        write( vm, slot->k, k );
+        write( vm, slot->v, read( kval->v ) );
+        old_kvslots->growth_left -= 1;
+    }
+
+    table->migrate = end;
+    if ( end == old_kvslots->count )
+    {
+        write( vm, table->old_kvslots, (kvslots_object*)nullptr );
+        table->migrate = 0;
+    }
+}
+
+static void table_rehash_incremental( vmachine* vm, table_object* table )
+{
+    // Size the new kvslots as table_rehash does, but leave the keys where
+    // they are, and leave the array part alone.
+    kvslots_object* kvslots = read( table->kvslots );
+    size_t length = kvslots_length( kvslots ) + 1;
+    size_t count = kvslots_count( length );
+    if ( count <= kvslots->count )
+    {
+        count = kvslots_count( length * 2 );
+    }
+
+    kvslots_object* new_kvslots = kvslots_new( vm, count );
+    kvslots->growth_left = length - 1;
+    write( vm, table->old_kvslots, kvslots );
+    write( vm, table->kvslots, new_kvslots );
+    table->migrate = 0;
 }
 
 /*
@@ -123,14 +496,12 @@ table_object* table_new( vmachine* vm, size_t capacity )
     table_object* table = new ( object_new( vm, TABLE_OBJECT, sizeof( table_object ) ) ) table_object();
     if ( capacity != 0 )
     {
-        capacity += capacity / 4;
-        capacity = ceilpow2( std::max< size_t >( capacity, 16 ) ) - 1;
-        winit( table->kvslots, kvslots_new( vm, capacity ) );
+        winit( table->kvslots, kvslots_new( vm, kvslots_count( capacity ) ) );
     }
     return table;
 }
 
-value table_getindex( vmachine* vm, table_object* table, value key )
+value table_getindex_internal( vmachine* vm, table_object* table, value key )
 {
     value v;
     if ( table_tryindex( vm, table, key, &v ) )
@@ -145,224 +516,284 @@ value table_getindex( vmachine* vm, table_object* table, value key )
 
 bool table_tryindex( vmachine* vm, table_object* table, value key, value* out_value )
 {
-    kvslots_object* kvslots = read( table->kvslots );
-    if ( kvslots->count )
+    size_t index;
+    if ( table_array_index( table, key, &index ) )
     {
-        key = key_value( key );
-        kvslot* slot = kvslots->slots + key_hash( key ) % kvslots->count;
-        if ( slot->next ) do
+        value v = read( read( table->aslots )->slots[ index ] );
+        if ( v.v == TABLE_ABSENT.v )
         {
-            if ( key_equal( read( slot->k ), key ) )
-            {
-                if ( out_value )
-                {
-                    *out_value = read( slot->v );
-                }
-                return true;
-            }
-            slot = slot->next;
+            return false;
+        }
+
+        if ( out_value )
+        {
+            *out_value = v;
         }
-        while ( slot != (kvslot*)-1 );
+        return true;
     }
-    return false;
-}
 
-static kvslot* table_insert( vmachine* vm, kvslots_object* kvslots, size_t kvcount, value key, kvslot* main_slot )
-{
-    // Insert in main slot if it's empty.
-    if ( ! main_slot->next )
+    kvslots_object* kvslots = read( table->kvslots );
+    if ( ! kvslots || ! table->length )
+    {
+        return false;
+    }
+
+    if ( read( table->old_kvslots ) )
     {
-        main_slot->next = (kvslot*)-1;
-        return main_slot;
+        table_migrate( vm, table, KVSLOTS_MIGRATE );
     }
 
-    // Identify cuckoo.
-    size_t cuckoo_hash = key_hash( read( main_slot->k ) );
-    kvslot* cuckoo_main_slot = kvslots->slots + cuckoo_hash % kvcount;
-    assert( cuckoo_main_slot->next );
+    key = key_value( key );
+    kvslot* slot = table_lookup( table, key, key_hash( vm, key ), &kvslots );
+    if ( ! slot )
+    {
+        return false;
+    }
 
-    // Find nearby free slot.
-    kvslot* free_slot = nullptr;
-    for ( kvslot* slot = cuckoo_main_slot + 1; slot < kvslots->slots + kvcount; ++slot )
+    if ( out_value )
     {
-        if ( ! slot->next )
-        {
-            free_slot = slot;
-            break;
-        }
+        *out_value = read( slot->v );
     }
+    return true;
+}
 
-    if ( ! free_slot ) for ( kvslot* slot = cuckoo_main_slot - 1; slot >= kvslots->slots; --slot )
+static void table_rehash( vmachine* vm, table_object* table, value key )
+{
+    // Resize the array part.
+    size_t array_length;
+    size_t acount = array_count( table, key, &array_length );
+    vslots_object* aslots = read( table->aslots );
+    vslots_object* new_aslots = aslots;
+    if ( acount != table->acount )
     {
-        if ( ! slot->next )
+        new_aslots = acount ? vslots_new( vm, acount ) : nullptr;
+        for ( size_t i = 0; i < acount; ++i )
         {
-            free_slot = slot;
-            break;
+            winit( new_aslots->slots[ i ], i < table->acount ? read( aslots->slots[ i ] ) : TABLE_ABSENT );
         }
     }
 
-    // Check for hash collision if cuckoo and new entry hash to same bucket.
-    if ( cuckoo_main_slot == main_slot )
+    // Size the hash part for the keys that are left.  If it doesn't need to
+    // grow, it is full of tombstones.  Leave it at most half full, so that
+    // tables with churn rehash less often.
+    kvslots_object* kvslots = read( table->kvslots );
+    kvslots_object* new_kvslots = nullptr;
+    size_t length = table->length + 1 - array_length;
+    if ( length )
     {
-        free_slot->next = main_slot->next;
-        main_slot->next = free_slot;
-        return free_slot;
+        size_t count = kvslots_count( length );
+        if ( kvslots && count <= kvslots->count )
+        {
+            count = kvslots_count( length * 2 );
+        }
+        new_kvslots = kvslots_new( vm, count );
     }
 
-    // Find previous slot in cuckoo's bucket's linked list.
-    kvslot* prev_slot = cuckoo_main_slot;
-    while ( prev_slot->next != main_slot )
+    // Move keys which fell out of the array part into the hash part.
+    for ( size_t i = acount; i < table->acount; ++i )
     {
-        prev_slot = prev_slot->next;
-        assert( prev_slot != (kvslot*)-1 );
+        value v = read( aslots->slots[ i ] );
+        if ( v.v != TABLE_ABSENT.v )
+        {
+            value k = box_number( (double)i );
+            kvslot* slot = kvslots_insert( new_kvslots, key_hash( vm, k ) );
+            winit( slot->k, k );
+            winit( slot->v, v );
+        }
     }
 
-    // Move item from main_slot to free_slot.
-    write( vm, free_slot->k, read( main_slot->k ) );
-    write( vm, free_slot->v, read( main_slot->v ) );
+    // Re-insert hash keys.  The new kvslots has no tombstones.
+    if ( kvslots )
+    {
+        const uint8_t* control = kvslots_control( kvslots );
+        for ( size_t i = 0; i < kvslots->count; ++i )
+        {
+            if ( control[ i ] & KVSLOT_FULL )
+            {
+                const kvslot* kval = kvslots->slots + i;
+                value k = read( kval->k );
+                size_t index;
+                if ( array_key( k, &index ) && index < acount )
+                {
+                    // Replaces TABLE_ABSENT in the unpublished array part.
+                    atomic_store( new_aslots->slots[ index ], read( kval->v ).v );
+                    continue;
+                }
 
-    // Update bucket list for amended cuckoo bucket.
-    prev_slot->next = free_slot;
-    free_slot->next = main_slot->next;
-    main_slot->next = (kvslot*)-1;
+                kvslot* slot = kvslots_insert( new_kvslots, key_hash( vm, k ) );
+                winit( slot->k, k );
+                winit( slot->v, read( kval->v ) );
+            }
+        }
+    }
 
-    return main_slot;
+    if ( new_aslots != aslots )
+    {
+        write( vm, table->aslots, new_aslots );
+        table->acount = acount;
+    }
+    write( vm, table->kvslots, new_kvslots );
 }
 
-void table_setindex( vmachine* vm, table_object* table, value key, value val )
+void table_setindex_internal( vmachine* vm, table_object* table, value key, value val )
 {
+    // Key is in the array part, but missing.
+    size_t index;
+    if ( table_array_index( table, key, &index ) )
+    {
+        ref_value& slot = read( table->aslots )->slots[ index ];
+        table->length += read( slot ).v == TABLE_ABSENT.v ? 1 : 0;
+        write( vm, slot, val );
+        return;
+    }
+
     key = key_value( key );
-    size_t hash = key_hash( key );
-    kvslot* main_slot;
+    size_t hash = key_hash( vm, key );
 
+    // Check if the key already exists in the hash part.
     kvslots_object* kvslots = read( table->kvslots );
-    size_t kvcount = kvslots ? kvslots->count : 0;
+    if ( read( table->old_kvslots ) )
+    {
+        table_migrate( vm, table, KVSLOTS_MIGRATE );
+    }
 
-    if ( kvcount )
+    if ( kvslots && table->length )
     {
-        // Check if the key already exists in the table.
-        kvslot* slot = main_slot = kvslots->slots + hash % kvcount;
-        if ( slot->next ) do
+        kvslots_object* owner;
+        kvslot* slot = table_lookup( table, key, hash, &owner );
+        if ( slot )
         {
-            if ( key_equal( read( slot->k ), key ) )
-            {
-                write( vm, slot->v, val );
-                return;
-            }
-            slot = slot->next;
+            write( vm, slot->v, val );
+            return;
         }
-        while ( slot != (kvslot*)-1 );
     }
 
-    if ( table->length >= kvcount - ( kvcount / 8 ) )
+    // Finish migrating if the keys left to migrate might not fit.
+    kvslots_object* old_kvslots = read( table->old_kvslots );
+    if ( old_kvslots && kvslots->growth_left <= old_kvslots->growth_left )
     {
-        // Reallocate kvslots with a larger count.
-        size_t new_kvcount = std::max< size_t >( ( kvcount + 1 ) * 2, 16 ) - 1;
-        kvslots_object* new_kvslots = kvslots_new( vm, new_kvcount );
+        table_migrate( vm, table, SIZE_MAX );
+    }
 
-        // Re-insert all elements.
-        for ( size_t i = 0; i < kvcount; ++i )
+    // Rehash if there are no empty slots left to fill.  Large tables rehash
+    // incrementally.  Otherwise, the key might end up in the array part.
+    if ( ! kvslots || ! kvslots->growth_left )
+    {
+        if ( kvslots && kvslots->count >= KVSLOTS_INCREMENTAL )
         {
-            kvslot* kval = kvslots->slots + i;
-            if ( kval->next )
+            table_rehash_incremental( vm, table );
+        }
+        else
+        {
+            table_rehash( vm, table, key );
+            if ( table_array_index( table, key, &index ) )
             {
-                value key = read( kval->k );
-                kvslot* slot = new_kvslots->slots + key_hash( key ) % new_kvcount;
-                slot = table_insert( vm, new_kvslots, new_kvcount, key, slot );
-                write( vm, slot->k, key );
-                write( vm, slot->v, read( kval->v ) );
+                write( vm, read( table->aslots )->slots[ index ], val );
+                table->length += 1;
+                return;
             }
         }
-
-        // Update.
-        write( vm, table->kvslots, new_kvslots );
-        kvslots = new_kvslots;
-        kvcount = new_kvcount;
-
-        // Recalculate main slot in reallocated slots list.
-        main_slot = kvslots->slots + hash % kvcount;
+        kvslots = read( table->kvslots );
     }
 
     // Insert.
-    table->length += 1;
-    kvslot* slot = table_insert( vm, kvslots, kvcount, key, main_slot );
+    kvslot* slot = kvslots_insert( kvslots, hash );
     write( vm, slot->k, key );
     write( vm, slot->v, val );
+    table->length += 1;
 }
 
 void table_delindex( vmachine* vm, table_object* table, value key )
 {
+    size_t index;
+    if ( table_array_index( table, key, &index ) )
+    {
+        ref_value& slot = read( table->aslots )->slots[ index ];
+        if ( read( slot ).v != TABLE_ABSENT.v )
+        {
+            write( vm, slot, TABLE_ABSENT );
+            table->length -= 1;
+        }
+        return;
+    }
+
     kvslots_object* kvslots = read( table->kvslots );
     if ( ! kvslots || ! table->length )
     {
         return;
     }
 
+    if ( read( table->old_kvslots ) )
+    {
+        table_migrate( vm, table, KVSLOTS_MIGRATE );
+    }
+
     key = key_value( key );
-    size_t kvcount = kvslots->count;
-    kvslot* main_slot = kvslots->slots + key_hash( key ) % kvcount;
-    kvslot* next_slot = main_slot->next;
-    if ( ! next_slot )
+    kvslot* slot = table_lookup( table, key, key_hash( vm, key ), &kvslots );
+    if ( ! slot )
     {
         return;
     }
 
-    if ( key_equal( read( main_slot->k ), key ) )
-    {
-        // Move next slot in linked list into main position.
-        if ( next_slot != (kvslot*)-1 )
-        {
-            write( vm, main_slot->k, read( next_slot->k ) );
-            write( vm, main_slot->v, read( next_slot->v ) );
-            main_slot->next = next_slot->next;
-            main_slot = next_slot;
-        }
+    write( vm, slot->k, { 0 } );
+    write( vm, slot->v, { 0 } );
+    table->length -= 1;
 
-        // Erase newly empty slot.
-        write( vm, main_slot->k, { 0 } );
-        write( vm, main_slot->v, { 0 } );
-        main_slot->next = nullptr;
-        table->length -= 1;
+    // Keys are never inserted into the old kvslots.
+    uint8_t* control = kvslots_control( kvslots );
+    size_t i = slot - kvslots->slots;
+    if ( kvslots == read( table->old_kvslots ) )
+    {
+        control[ i ] = KVSLOT_DELETED;
+        kvslots->growth_left -= 1;
         return;
     }
 
-    kvslot* prev_slot = main_slot;
-    while ( next_slot != (kvslot*)-1 )
+    // If the slot's group has an empty slot, no probe passed through it.
+    if ( control_group( control + ( i & ~( KVSLOTS_GROUP - 1 ) ) ).match_empty() )
     {
-        if ( key_equal( read( next_slot->k ), key ) )
-        {
-            // Unlink and erase next_slot.
-            write( vm, next_slot->k, { 0 } );
-            write( vm, next_slot->v, { 0 } );
-            prev_slot->next = next_slot->next;
-            next_slot->next = nullptr;
-            table->length -= 1;
-            return;
-        }
-
-        prev_slot = next_slot;
-        next_slot = next_slot->next;
+        control[ i ] = KVSLOT_EMPTY;
+        kvslots->growth_left += 1;
+    }
+    else
+    {
+        control[ i ] = KVSLOT_DELETED;
     }
 }
 
 void table_clear( vmachine* vm, table_object* table )
 {
-    kvslots_object* kvslots = read( table->kvslots );
-    if ( ! kvslots )
+    // Drop the array part.
+    if ( table->acount )
     {
-        return;
+        write( vm, table->aslots, (vslots_object*)nullptr );
+        table->acount = 0;
     }
 
-    size_t kvcount = kvslots->count;
-    for ( size_t i = 0; i < kvcount; ++i )
+    // Drop keys which haven't migrated.
+    if ( read( table->old_kvslots ) )
+    {
+        write( vm, table->old_kvslots, (kvslots_object*)nullptr );
+        table->migrate = 0;
+    }
+
+    kvslots_object* kvslots = read( table->kvslots );
+    if ( kvslots )
     {
-        kvslot* kval = kvslots->slots + i;
-        if ( kval->next )
+        uint8_t* control = kvslots_control( kvslots );
+        size_t kvcount = kvslots->count;
+        for ( size_t i = 0; i < kvcount; ++i )
         {
-            write( vm, kval->k, { 0 } );
-            write( vm, kval->v, { 0 } );
-            kval->next = nullptr;
+            if ( control[ i ] & KVSLOT_FULL )
+            {
+                kvslot* kval = kvslots->slots + i;
+                write( vm, kval->k, { 0 } );
+                write( vm, kval->v, { 0 } );
+            }
         }
+
+        memset( control, KVSLOT_EMPTY, kvcount );
+        kvslots->growth_left = kvslots_growth( kvcount );
     }
 
     table->length = 0;
@@ -370,33 +801,49 @@ void table_clear( vmachine* vm, table_object* table )
 
 size_t table_iterate( vmachine* vm, table_object* table )
 {
-    kvslots_object* kvslots = read( table->kvslots );
-    size_t i = 0;
-    while ( ! kvslots->slots[ i ].next )
+    // Indexes below acount are in the array part, and the rest are slots in
+    // the hash part.  Keys must not move during iteration.
+    if ( read( table->old_kvslots ) )
     {
-        ++i;
+        table_migrate( vm, table, SIZE_MAX );
     }
-    return i;
+    return 0;
 }
 
 bool table_next( vmachine* vm, table_object* table, size_t* i, table_keyval* keyval )
 {
-    kvslots_object* kvslots = read( table->kvslots );
-    if ( *i < kvslots->count )
+    // Find next present key in the array part.
+    size_t acount = table->acount;
+    if ( *i < acount )
     {
-        // Get key/value from this slot.
-        kvslot* kvslot = kvslots->slots + *i;
-        assert( kvslot->next );
-        keyval->k = read( kvslot->k );
-        keyval->v = read( kvslot->v );
-
-        // Find next non-empty slot.  kvslots objects always end with sentinel.
-        ++*i;
-        while ( ! kvslots->slots[ *i ].next )
+        vslots_object* aslots = read( table->aslots );
+        for ( ; *i < acount; ++*i )
         {
-            ++*i;
+            value v = read( aslots->slots[ *i ] );
+            if ( v.v != TABLE_ABSENT.v )
+            {
+                keyval->k = box_number( (double)*i );
+                keyval->v = v;
+                ++*i;
+                return true;
+            }
         }
+    }
 
+    // Find next full slot in the hash part.
+    kvslots_object* kvslots = read( table->kvslots );
+    if ( ! kvslots )
+    {
+        return false;
+    }
+
+    size_t index = kvslots_next( kvslots, *i - acount );
+    if ( index < kvslots->count )
+    {
+        kvslot* kvslot = kvslots->slots + index;
+        keyval->k = read( kvslot->k );
+        keyval->v = read( kvslot->v );
+        *i = acount + index + 1;
         return true;
     }
     else
@@ -13,9 +13,42 @@
 
 /*
     Hash table mapping arbitrary values.
+
+    Tables use open addressing, in the style of Abseil's Swiss tables.  Slots
+    are divided into groups of KVSLOTS_GROUP.  Each slot has a control byte,
+    which is KVSLOT_EMPTY, KVSLOT_DELETED, or KVSLOT_FULL plus the low seven
+    bits of the key's hash.  A lookup compares a group's control bytes against
+    the hash all at once, and only compares keys in slots which match.
+
+    Probing starts at the group selected by the rest of the hash, and visits
+    groups in triangular order until it reaches a group with an empty slot.
+    Deleting a key leaves a tombstone, unless its group has an empty slot.
+    Once no empty slots are left to fill, the table is rehashed, and grows
+    if it has to.
+
+    Zeroed memory is an empty kvslots object, and the collector visits every
+    slot, so empty and deleted slots must hold zero.
+
+    Tables also have an array part, holding the values of integer keys from 0
+    up to acount.  Integer keys in that range are never in the hash part.
+    Missing keys in the array part hold TABLE_ABSENT.  When the hash part is
+    rehashed, the array part is resized, as in Lua, to the largest power of
+    two for which more than half of the keys below it are present.
+
+    Rehashing a large hash part in one go would stall the mutator, so once it
+    has KVSLOTS_INCREMENTAL slots it is rehashed incrementally instead.  The
+    new kvslots replaces the old one, which is kept in old_kvslots until
+    every key has migrated.  Each access to the hash part migrates the keys
+    in the next KVSLOTS_MIGRATE old slots.  Slots below migrate have been
+    moved, and are ignored by lookups.  Keys are inserted only into the new
+    kvslots.  If the keys left to migrate might not fit in it, the migration
+    is finished at once.  The array part is not resized by an incremental
+    rehash, as that would need every key.  Starting an iteration finishes the
+    migration, so that keys don't move while they're being visited.
 */
 
 #include "../vmachine.h"
+#include "lookup_object.h"
 
 namespace kf
 {
@@ -24,30 +57,53 @@ namespace kf
     Structures.
 */
 
+const size_t KVSLOTS_GROUP = 16;
+const size_t KVSLOTS_INCREMENTAL = 32 * 1024;
+const size_t KVSLOTS_MIGRATE = 64;
+
+enum kvslot_control : uint8_t
+{
+    KVSLOT_EMPTY    = 0x00,
+    KVSLOT_DELETED  = 0x01,
+    KVSLOT_FULL     = 0x80,
+};
+
 struct kvslot
 {
     ref_value k;
     ref_value v;
-    kvslot* next;
 };
 
 struct kvslots_object : public object
 {
-    size_t count;
-    kvslot slots[];
+    size_t count;           // Power of two, at least KVSLOTS_GROUP.
+    size_t growth_left;     // Empty slots that can be filled before rehashing.
+    kvslot slots[];         // Followed by count control bytes.
 };
 
 struct table_object : public object
 {
     ref< kvslots_object > kvslots;
-    size_t length;
+    size_t length;          // Number of keys, in both parts.
+    ref< vslots_object > aslots;
+    size_t acount;          // Size of the array part.
+    ref< kvslots_object > old_kvslots;
+    size_t migrate;         // Index of next old slot to migrate.
 };
 
+/*
+    Marks missing keys in the array part.  This is in the encoding space of
+    boxed u64vals, but is never produced by u64val_value().
+*/
+
+const value TABLE_ABSENT = { UINT64_C( 0x0007'FFFF'FFFF'FFFF ) };
+
 /*
     Functions.
 */
 
 kvslots_object* kvslots_new( vmachine* vm, size_t count );
+uint8_t* kvslots_control( kvslots_object* kvslots );
 table_object* table_new( vmachine* vm, size_t capacity );
 value table_getindex( vmachine* vm, table_object* table, value key );
 bool table_tryindex( vmachine* vm, table_object* table, value key, value* out_value );
@@ -68,6 +124,64 @@ struct table_keyval
 size_t table_iterate( vmachine* vm, table_object* table );
 bool table_next( vmachine* vm, table_object* table, size_t* i, table_keyval* keyval );
 
+/*
+    Inline functions.
+*/
+
+inline uint8_t* kvslots_control( kvslots_object* kvslots )
+{
+    return (uint8_t*)( kvslots->slots + kvslots->count );
+}
+
+inline bool table_array_index( table_object* table, value key, size_t* out_index )
+{
+    if ( box_is_number( key ) )
+    {
+        double n = unbox_number( key );
+        if ( n >= 0 && n < (double)table->acount )
+        {
+            size_t index = (size_t)n;
+            if ( (double)index == n )
+            {
+                *out_index = index;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+inline value table_getindex( vmachine* vm, table_object* table, value key )
+{
+    extern value table_getindex_internal( vmachine* vm, table_object* table, value key );
+    size_t index;
+    if ( table_array_index( table, key, &index ) )
+    {
+        value v = read( read( table->aslots )->slots[ index ] );
+        if ( v.v != TABLE_ABSENT.v )
+        {
+            return v;
+        }
+    }
+    return table_getindex_internal( vm, table, key );
+}
+
+inline void table_setindex( vmachine* vm, table_object* table, value key, value val )
+{
+    extern void table_setindex_internal( vmachine* vm, table_object* table, value key, value val );
+    size_t index;
+    if ( table_array_index( table, key, &index ) )
+    {
+        ref_value& slot = read( table->aslots )->slots[ index ];
+        if ( read( slot ).v != TABLE_ABSENT.v )
+        {
+            write( vm, slot, val );
+            return;
+        }
+    }
+    table_setindex_internal( vm, table, key, val );
+}
+
 }
 
 #endif
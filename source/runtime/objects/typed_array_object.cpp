@@ -0,0 +1,43 @@
+//
+//  typed_array_object.cpp
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#include "typed_array_object.h"
+
+namespace kf
+{
+
+static size_t element_size( type_code type )
+{
+    switch ( type )
+    {
+    case F64ARRAY_OBJECT:   return sizeof( double );
+    case I32ARRAY_OBJECT:   return sizeof( int32_t );
+    default:                return sizeof( uint8_t );
+    }
+}
+
+typed_array_object* typed_array_new( vmachine* vm, type_code type, size_t length )
+{
+    assert( is_typed_array_type( type ) );
+    size_t esize = element_size( type );
+    if ( length > ( SIZE_MAX - sizeof( typed_array_object ) ) / esize )
+    {
+        raise_error( ERROR_MEMORY, "typed array is too large" );
+    }
+
+    // Elements are zeroed along with the rest of the object.
+    size_t size = sizeof( typed_array_object ) + length * esize;
+    typed_array_object* array = new ( object_new( vm, type, size ) ) typed_array_object();
+    array->length = length;
+    return array;
+}
+
+}
+
@@ -0,0 +1,119 @@
+//
+//  typed_array_object.h
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+#ifndef KF_TYPED_ARRAY_OBJECT_H
+#define KF_TYPED_ARRAY_OBJECT_H
+
+/*
+    Typed arrays store unboxed numbers, as doubles (f64array), 32-bit signed
+    integers (i32array), or bytes (u8array).  They have a fixed length, and
+    their elements follow the object, so they hold no references and the
+    collector never looks at their elements.  Objects don't move, so the
+    elements can be handed to native code without copying.
+
+    Storing a number into an integer array truncates it towards zero and
+    wraps it to the element's width.  NaN, infinities, and numbers too large
+    to truncate to 64 bits store 0.
+
+    Native code can write any bit pattern into an f64array, including NaNs
+    that would box as something other than a number, so loaded NaNs are
+    replaced with the canonical quiet NaN.
+*/
+
+#include <stdint.h>
+#include <limits>
+#include "../vmachine.h"
+
+namespace kf
+{
+
+/*
+    Typed array structure.
+*/
+
+struct typed_array_object : public object
+{
+    size_t length;
+    alignas( 8 ) uint8_t data[];
+};
+
+/*
+    Functions.
+*/
+
+typed_array_object* typed_array_new( vmachine* vm, type_code type, size_t length );
+bool is_typed_array_type( type_code type );
+bool box_is_typed_array( value v );
+value typed_array_getindex( vmachine* vm, typed_array_object* array, size_t index );
+void typed_array_setindex( vmachine* vm, typed_array_object* array, size_t index, value value );
+
+/*
+    Inline functions.
+*/
+
+inline bool is_typed_array_type( type_code type )
+{
+    return type >= F64ARRAY_OBJECT && type <= U8ARRAY_OBJECT;
+}
+
+inline bool box_is_typed_array( value v )
+{
+    return box_is_object( v ) && is_typed_array_type( header( unbox_object( v ) )->type );
+}
+
+inline int64_t typed_array_integer( double n )
+{
+    return n > -0x1p63 && n < 0x1p63 ? (int64_t)n : 0;
+}
+
+inline value typed_array_getindex( vmachine* vm, typed_array_object* array, size_t index )
+{
+    if ( index >= array->length )
+    {
+        raise_error( ERROR_INDEX, "array index out of range" );
+    }
+
+    switch ( header( array )->type )
+    {
+    case F64ARRAY_OBJECT:
+    {
+        double n = ( (double*)array->data )[ index ];
+        return box_number( n == n ? n : std::numeric_limits< double >::quiet_NaN() );
+    }
+    case I32ARRAY_OBJECT:   return box_number( ( (int32_t*)array->data )[ index ] );
+    default:                return box_number( array->data[ index ] );
+    }
+}
+
+inline void typed_array_setindex( vmachine* vm, typed_array_object* array, size_t index, value value )
+{
+    if ( index >= array->length )
+    {
+        raise_error( ERROR_INDEX, "array index out of range" );
+    }
+
+    if ( ! box_is_number( value ) )
+    {
+        raise_type_error( value, "a number" );
+    }
+
+    double n = unbox_number( value );
+    switch ( header( array )->type )
+    {
+    case F64ARRAY_OBJECT:   ( (double*)array->data )[ index ] = n; break;
+    case I32ARRAY_OBJECT:   ( (int32_t*)array->data )[ index ] = (int32_t)(uint32_t)typed_array_integer( n ); break;
+    default:                array->data[ index ] = (uint8_t)typed_array_integer( n ); break;
+    }
+}
+
+}
+
+#endif
+
@@ -22,6 +22,7 @@
 #include "objects/function_object.h"
 #include "objects/cothread_object.h"
 #include "objects/u64val_object.h"
+#include "objects/typed_array_object.h"
 #include "corlib/corobjects.h"
 #include "corlib/corprint.h"
 #include "corlib/cormath.h"
@@ -117,6 +118,55 @@ value get_runtime_value( runtime* r, size_t index )
         return null_value;
 }
 
+gc_tuning get_gc_tuning( runtime* r )
+{
+    return get_tuning( &r->vm );
+}
+
+void set_gc_tuning( runtime* r, const gc_tuning& tuning )
+{
+    set_tuning( &r->vm, tuning );
+}
+
+gc_triggers get_gc_triggers( runtime* r )
+{
+    return get_triggers( r->vm.gc );
+}
+
+void adjust_external_memory( runtime* r, ptrdiff_t delta )
+{
+    if ( delta >= 0 )
+    {
+        external_alloc( &r->vm, nullptr, delta );
+    }
+    else
+    {
+        external_free( &r->vm, -(size_t)delta );
+    }
+}
+
+bool gc_step( runtime* r, uint64_t budget_ns )
+{
+    return step_collection( &r->vm, budget_ns );
+}
+
+gc_statistics get_gc_statistics( runtime* r )
+{
+    gc_statistics statistics = {};
+    get_statistics( &r->vm, &statistics );
+    return statistics;
+}
+
+size_t get_gc_type_statistics( runtime* r, gc_type_statistics* types, size_t count )
+{
+    return get_type_statistics( r->vm.gc, types, count );
+}
+
+bool write_heap_snapshot( runtime* r, const char* path )
+{
+    return heap_snapshot( &r->vm, path );
+}
+
 context* create_context( runtime* r )
 {
     // Create context.
@@ -252,7 +302,20 @@ value_kind kindof( value v )
     }
     else if ( box_is_object( v ) )
     {
-        return (value_kind)( header( unbox_object( v ) )->type );
+        switch ( header( unbox_object( v ) )->type )
+        {
+        case ARRAY_OBJECT:              return ARRAY;
+        case TABLE_OBJECT:              return TABLE;
+        case FUNCTION_OBJECT:           return FUNCTION;
+        case NATIVE_FUNCTION_OBJECT:    return FUNCTION;
+        case COTHREAD_OBJECT:           return COTHREAD;
+        case GENERATOR_OBJECT:          return COTHREAD;
+        case U64VAL_OBJECT:             return U64VAL;
+        case F64ARRAY_OBJECT:           return F64ARRAY;
+        case I32ARRAY_OBJECT:           return I32ARRAY;
+        case U8ARRAY_OBJECT:            return U8ARRAY;
+        default:                        return LOOKUP;
+        }
     }
     else if ( box_is_bool( v ) )
     {
@@ -295,7 +358,7 @@ bool is_function( value v )
 
 bool is_cothread( value v )
 {
-    return box_is_object_type( v, COTHREAD_OBJECT );
+    return box_is_object_type( v, COTHREAD_OBJECT ) || box_is_object_type( v, GENERATOR_OBJECT );
 }
 
 bool is_u64val( value v )
@@ -303,6 +366,21 @@ bool is_u64val( value v )
     return box_is_u64val( v ) || box_is_object_type( v, U64VAL_OBJECT );
 }
 
+bool is_f64array( value v )
+{
+    return box_is_object_type( v, F64ARRAY_OBJECT );
+}
+
+bool is_i32array( value v )
+{
+    return box_is_object_type( v, I32ARRAY_OBJECT );
+}
+
+bool is_u8array( value v )
+{
+    return box_is_object_type( v, U8ARRAY_OBJECT );
+}
+
 bool is_number( value v )
 {
     return box_is_number( v );
@@ -489,6 +567,52 @@ void array_clear( value array )
     array_clear( current(), (array_object*)unbox_object( array ) );
 }
 
+static value create_typed_array( type_code type, size_t length, void** out_data )
+{
+    typed_array_object* array = typed_array_new( current(), type, length );
+    if ( out_data ) *out_data = array->data;
+    return box_object( array );
+}
+
+value create_f64array( size_t length, double** out_data )
+{
+    return create_typed_array( F64ARRAY_OBJECT, length, (void**)out_data );
+}
+
+value create_i32array( size_t length, int32_t** out_data )
+{
+    return create_typed_array( I32ARRAY_OBJECT, length, (void**)out_data );
+}
+
+value create_u8array( size_t length, uint8_t** out_data )
+{
+    return create_typed_array( U8ARRAY_OBJECT, length, (void**)out_data );
+}
+
+double* get_f64array( value array, size_t* out_length )
+{
+    if ( ! is_f64array( array ) ) raise_type_error( array, "an f64array" );
+    typed_array_object* a = (typed_array_object*)unbox_object( array );
+    if ( out_length ) *out_length = a->length;
+    return (double*)a->data;
+}
+
+int32_t* get_i32array( value array, size_t* out_length )
+{
+    if ( ! is_i32array( array ) ) raise_type_error( array, "an i32array" );
+    typed_array_object* a = (typed_array_object*)unbox_object( array );
+    if ( out_length ) *out_length = a->length;
+    return (int32_t*)a->data;
+}
+
+uint8_t* get_u8array( value array, size_t* out_length )
+{
+    if ( ! is_u8array( array ) ) raise_type_error( array, "a u8array" );
+    typed_array_object* a = (typed_array_object*)unbox_object( array );
+    if ( out_length ) *out_length = a->length;
+    return a->data;
+}
+
 value create_table()
 {
     return box_object( table_new( current(), 0 ) );
@@ -524,6 +648,12 @@ value get_index( value table, value k )
         size_t index = (size_t)(uint64_t)unbox_number( k );
         return array_getindex( current(), (array_object*)unbox_object( table ), index );
     }
+    else if ( box_is_typed_array( table ) )
+    {
+        if ( ! is_number( k ) ) raise_type_error( k, "a number" );
+        size_t index = (size_t)(uint64_t)unbox_number( k );
+        return typed_array_getindex( current(), (typed_array_object*)unbox_object( table ), index );
+    }
     else
     {
         raise_type_error( table, "indexable" );
@@ -540,6 +670,10 @@ value get_index( value array, size_t index )
     {
         return table_getindex( current(), (table_object*)unbox_object( array ), box_number( (double)index ) );
     }
+    else if ( box_is_typed_array( array ) )
+    {
+        return typed_array_getindex( current(), (typed_array_object*)unbox_object( array ), index );
+    }
     else
     {
         raise_type_error( array, "indexable" );
@@ -558,6 +692,12 @@ void set_index( value table, value k, value v )
         size_t index = (size_t)(uint64_t)unbox_number( k );
         array_setindex( current(), (array_object*)unbox_object( table ), index, v );
     }
+    else if ( box_is_typed_array( table ) )
+    {
+        if ( ! is_number( k ) ) raise_type_error( k, "a number" );
+        size_t index = (size_t)(uint64_t)unbox_number( k );
+        typed_array_setindex( current(), (typed_array_object*)unbox_object( table ), index, v );
+    }
     else
     {
         raise_type_error( table, "indexable" );
@@ -574,6 +714,10 @@ void set_index( value array, size_t index, value v )
     {
         table_setindex( current(), (table_object*)unbox_object( array ), box_number( (double)index ), v );
     }
+    else if ( box_is_typed_array( array ) )
+    {
+        typed_array_setindex( current(), (typed_array_object*)unbox_object( array ), index, v );
+    }
     else
     {
         raise_type_error( array, "indexable" );
@@ -604,9 +748,10 @@ value create_function( std::string_view name, native_function native, void* cook
 
 stack_values push_results( frame* frame, size_t count )
 {
+    vmachine* vm = current();
     cothread_object* cothread = (cothread_object*)frame->sp;
-    assert( current()->c->cothread == cothread );
-    return { resize_stack( cothread, frame->bp, frame->bp + count ), count };
+    assert( vm->c->cothread == cothread );
+    return { resize_stack( vm, cothread, frame->bp, frame->bp + count ), count };
 }
 
 result return_results( frame* frame )
@@ -619,9 +764,10 @@ result return_results( frame* frame )
 
 result return_value( frame* frame, value v )
 {
+    vmachine* vm = current();
     cothread_object* cothread = (cothread_object*)frame->sp;
-    assert( current()->c->cothread == cothread );
-    value* r = resize_stack( cothread, frame->bp, frame->bp + 1 );
+    assert( vm->c->cothread == cothread );
+    value* r = resize_stack( vm, cothread, frame->bp, frame->bp + 1 );
     r[ 0 ] = v;
     return 1;
 }
@@ -643,7 +789,7 @@ stack_values push_frame( frame* frame, size_t count )
     cothread->stack_frames.push_back( { nullptr, bp, bp, 0, RESUME_CALL, 0, OP_STACK_MARK, 0 } );
     frame->sp = vm;
     frame->bp = bp;
-    return { resize_stack( cothread, bp, 1 + count ) + 1, count };
+    return { resize_stack( vm, cothread, bp, 1 + count ) + 1, count };
 }
 
 stack_values call_frame( frame* frame, value function )
@@ -657,7 +803,7 @@ stack_values call_frame( frame* frame, value function )
     assert( stack_frame->fp < cothread->xp );
 
     unsigned xp = cothread->xp - frame->bp;
-    value* r = cothread->stack.data() + frame->bp;
+    value* r = cothread->stack + frame->bp;
     r[ 0 ] = function;
 
     xstate state;
@@ -673,7 +819,7 @@ stack_values call_frame( frame* frame, value function )
 
     assert( vm->c->cothread == cothread );
     assert( frame->bp <= cothread->xp );
-    return { cothread->stack.data() + frame->bp, cothread->xp - frame->bp };
+    return { cothread->stack + frame->bp, cothread->xp - frame->bp };
 }
 
 void pop_frame( frame* frame )
@@ -762,7 +908,11 @@ static std::string format_value( value v )
         case FUNCTION_OBJECT:           type_name = "function";         break;
         case NATIVE_FUNCTION_OBJECT:    type_name = "native function";  break;
         case COTHREAD_OBJECT:           type_name = "cothread";         break;
+        case GENERATOR_OBJECT:          type_name = "cothread";         break;
         case U64VAL_OBJECT:             type_name = "u64val";           break;
+        case F64ARRAY_OBJECT:           type_name = "f64array";         break;
+        case I32ARRAY_OBJECT:           type_name = "i32array";         break;
+        case U8ARRAY_OBJECT:            type_name = "u8array";          break;
         default: break;
         }
         s = format_string( "<%s %p>", type_name, unbox_object( v ) );
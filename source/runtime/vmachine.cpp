@@ -10,10 +10,12 @@
 
 #include "vmachine.h"
 #include <stdlib.h>
+#include <stdio.h>
 #include "heap.h"
 #include "collector.h"
 #include "call_stack.h"
 #include "tick.h"
+#include "jit.h"
 #include "objects/lookup_object.h"
 #include "objects/cothread_object.h"
 
@@ -29,26 +31,103 @@ vcontext::~vcontext()
 {
 }
 
+static size_t nursery_size()
+{
+    if ( const char* size = getenv( "KENAF_GC_NURSERY_SIZE" ) )
+    {
+        return strtoul( size, nullptr, 10 );
+    }
+    return NURSERY_DEFAULT_SIZE;
+}
+
+static size_t large_size()
+{
+    if ( const char* size = getenv( "KENAF_GC_LARGE_SIZE" ) )
+    {
+        return strtoul( size, nullptr, 10 );
+    }
+    return LARGE_DEFAULT_SIZE;
+}
+
 vmachine::vmachine()
     :   old_color( GC_COLOR_NONE )
     ,   new_color( GC_COLOR_PURPLE )
     ,   phase( GC_PHASE_NONE )
-    ,   countdown( 512 * 1024 )
+    ,   countdown( GC_DEFAULT_MIN_TRIGGER )
+    ,   limit_countdown( SIZE_MAX )
+    ,   handshake_pending( false )
     ,   c( nullptr )
     ,   prototypes{}
     ,   self_key( nullptr )
     ,   self_sel{}
     ,   next_cookie( 0 )
+    ,   megamorphic_cache{}
+    ,   selector_stats{}
+#ifdef KF_JIT
+    ,   jit_threshold( JIT_DEFAULT_THRESHOLD )
+#endif
     ,   context_list( nullptr )
-    ,   heap( heap_create() )
+    ,   nursery( nursery_size() )
+    ,   large( large_size() )
+    ,   external_size( 0 )
+    ,   arena_index( 0 )
+    ,   arena_countdown( 0 )
     ,   gc( collector_create() )
+    ,   pool( cothread_pool_create() )
 {
+    size_t arena_count = HEAP_DEFAULT_ARENAS;
+    if ( const char* count = getenv( "KENAF_GC_HEAP_ARENAS" ) )
+    {
+        arena_count = std::max< size_t >( strtoul( count, nullptr, 10 ), 1 );
+    }
+    unsigned heap_flags = getenv( "KENAF_GC_HUGE_PAGES" ) ? HEAP_HUGE_PAGES : HEAP_NONE;
+    for ( size_t i = 0; i < arena_count; ++i )
+    {
+        arenas.push_back( heap_arena_create( heap_flags ) );
+    }
+
+    if ( const char* limit = getenv( "KENAF_COTHREAD_POOL_LIMIT" ) )
+    {
+        pool->limit = strtoul( limit, nullptr, 10 );
+    }
+
+#ifdef KF_JIT
+    if ( const char* threshold = getenv( "KENAF_JIT_THRESHOLD" ) )
+    {
+        jit_threshold = strtoul( threshold, nullptr, 10 );
+    }
+#endif
 }
 
 vmachine::~vmachine()
 {
+    if ( getenv( "KENAF_SELECTOR_PRINT_STATS" ) )
+    {
+        printf( "selector report:\n" );
+#ifdef KF_SELECTOR_STATS
+        printf( "    mono : %llu\n", (unsigned long long)selector_stats.mono_hits );
+#endif
+        printf( "    poly : %llu\n", (unsigned long long)selector_stats.poly_hits );
+        printf( "    mega : %llu\n", (unsigned long long)selector_stats.mega_hits );
+        printf( "    miss : %llu\n", (unsigned long long)selector_stats.misses );
+    }
+
+    if ( getenv( "KENAF_COTHREAD_POOL_PRINT_STATS" ) )
+    {
+        const cothread_pool_statistics& stats = pool->statistics;
+        printf( "cothread pool report:\n" );
+        printf( "    hits     : %llu\n", (unsigned long long)stats.hits );
+        printf( "    misses   : %llu\n", (unsigned long long)stats.misses );
+        printf( "    recycled : %llu\n", (unsigned long long)stats.recycled );
+        printf( "    released : %llu\n", (unsigned long long)stats.released );
+    }
+
+    cothread_pool_destroy( pool );
     collector_destroy( gc );
-    heap_destroy( heap );
+    for ( heap_arena* arena : arenas )
+    {
+        heap_arena_destroy( arena );
+    }
 }
 
 void link_vcontext( vmachine* vm, vcontext* vc )
@@ -87,8 +166,11 @@ void destroy_vmachine( vmachine* vm )
     collector_destroy( vm->gc );
     vm->gc = nullptr;
 
-    heap_destroy( vm->heap );
-    vm->heap = nullptr;
+    for ( heap_arena* arena : vm->arenas )
+    {
+        heap_arena_destroy( arena );
+    }
+    vm->arenas.clear();
 }
 
 /*
@@ -97,36 +179,122 @@ void destroy_vmachine( vmachine* vm )
 
 void* object_new( vmachine* vm, type_code type, size_t size )
 {
-    std::unique_lock lock_heap( vm->heap_mutex, std::defer_lock );
-    if ( vm->phase == GC_PHASE_SWEEP )
+    // Allocate small objects from the nursery.
+    std::unique_lock< std::mutex > lock_heap;
+    void* p = nursery_malloc( &vm->nursery, size );
+    bool young = p != nullptr;
+    bool large = false;
+    if ( ! young )
     {
-        uint64_t pause_start = tick();
-        lock_heap.lock();
-        add_heap_pause( vm->gc, tick() - pause_start );
+        // Check hard heap limit.
+        if ( size > vm->limit_countdown )
+        {
+            heap_limit_exceeded( vm, size );
+        }
+
+        if ( size >= vm->large.threshold )
+        {
+            // Large objects are mapped separately.
+            p = large_malloc( &vm->large, size );
+            large = true;
+        }
+        else
+        {
+            // Arena is locked if it might be swept concurrently.
+            heap_arena* arena = acquire_arena( vm, size, lock_heap );
+            p = heap_malloc( arena->heap, size );
+        }
     }
 
-    // Allocate object from heap.
-    void* p = heap_malloc( vm->heap, size );
     size = heap_malloc_size( p );
-    vm->countdown -= std::min< size_t >( vm->countdown, size );
+    if ( ! young )
+    {
+        vm->countdown -= std::min< size_t >( vm->countdown, size );
+        vm->limit_countdown -= std::min( vm->limit_countdown, size );
+    }
 
     // Initialize object header.
     object_header* h = header( (object*)p );
     atomic_store( h->color, vm->new_color );
     h->type = type;
-    h->flags = 0;
+    h->flags = large ? FLAG_LARGE : 0;
     h->refcount = 0;
 
+    // Objects allocated from the heap are initialized without barriers.
+    // Strings and typed arrays hold no references.
+    if ( ! young && type != STRING_OBJECT && ( type < F64ARRAY_OBJECT || type > U8ARRAY_OBJECT ) )
+    {
+        remember_object( vm, (object*)p );
+    }
+
     // Fence so that consume reads of reference from GC thread get an
     // initialized object header with correct colour.
     atomic_produce_fence();
-    if ( vm->phase == GC_PHASE_SWEEP )
+    if ( lock_heap.owns_lock() )
     {
         lock_heap.unlock();
     }
 
-    // Zero memory.
-    memset( p, 0, size );
+    // Zero memory.  Large objects are mapped already zeroed, and can be
+    // swept once they are linked.
+    if ( ! large )
+    {
+        memset( p, 0, size );
+    }
+    else
+    {
+        large_link( &vm->large, p );
+    }
+    return p;
+}
+
+template < typename T > static void rebase_remembered( std::vector< T* >* remembered, char* old_p, size_t old_size, char* new_p )
+{
+    for ( T*& r : *remembered )
+    {
+        if ( (char*)r >= old_p && (char*)r < old_p + old_size )
+        {
+            r = (T*)( new_p + ( (char*)r - old_p ) );
+        }
+    }
+}
+
+void* object_resize( vmachine* vm, object* object, size_t size )
+{
+    // Only large objects can be resized.  The object might move, so it must
+    // not be visible to the collector, which is only true between collections.
+    if ( ! ( header( object )->flags & FLAG_LARGE ) || vm->phase != GC_PHASE_NONE )
+    {
+        return nullptr;
+    }
+
+    // Check hard heap limit.
+    size_t old_size = heap_malloc_size( object );
+    if ( size > old_size && size - old_size > vm->limit_countdown )
+    {
+        return nullptr;
+    }
+
+    void* p = large_resize( &vm->large, object, size );
+    if ( ! p )
+    {
+        return nullptr;
+    }
+
+    size = heap_malloc_size( p );
+    vm->countdown -= std::min< size_t >( vm->countdown, size - old_size );
+    vm->limit_countdown -= std::min( vm->limit_countdown, size - old_size );
+
+    // Update remembered slots in the moved object.  The caller must update
+    // the object's only reference.
+    if ( p != object )
+    {
+        nursery_space* n = &vm->nursery;
+        rebase_remembered( &n->remembered_values, (char*)object, old_size, (char*)p );
+        rebase_remembered( &n->remembered_refs, (char*)object, old_size, (char*)p );
+        rebase_remembered( &n->remembered_objects, (char*)object, 1, (char*)p );
+    }
+
     return p;
 }
 
@@ -135,6 +303,31 @@ size_t object_size( vmachine* vm, object* object )
     return heap_malloc_size( object );
 }
 
+void external_alloc( vmachine* vm, object* owner, size_t size )
+{
+    vm->external_size.fetch_add( size, std::memory_order_relaxed );
+
+    // Memory owned by young objects is reclaimed by minor collections.
+    nursery_space* n = &vm->nursery;
+    if ( owner && nursery_young( n, owner ) )
+    {
+        n->countdown -= std::min( n->countdown, size );
+    }
+    else
+    {
+        vm->countdown -= std::min< size_t >( vm->countdown, size );
+    }
+}
+
+void external_free( vmachine* vm, size_t size )
+{
+    // Never let the total wrap, even if frees are unbalanced.
+    size_t external_size = vm->external_size.load( std::memory_order_relaxed );
+    while ( ! vm->external_size.compare_exchange_weak( external_size, external_size - std::min( external_size, size ), std::memory_order_relaxed ) )
+    {
+    }
+}
+
 void object_retain( vmachine* vm, object* object )
 {
     object_header* h = header( object );
@@ -198,8 +391,44 @@ void write_barrier( vmachine* vm, string_object* old )
     atomic_store( header( old )->color, vm->new_color );
 }
 
+void remember_barrier( vmachine* vm, ref_value& ref )
+{
+    nursery_space* n = &vm->nursery;
+    n->remembered_values.push_back( &ref );
+    if ( n->remembered_values.size() >= NURSERY_REMEMBERED_LIMIT )
+    {
+        n->countdown = 0;
+    }
+}
+
+void remember_barrier( vmachine* vm, ref< object >& ref )
+{
+    nursery_space* n = &vm->nursery;
+    n->remembered_refs.push_back( &ref );
+    if ( n->remembered_refs.size() >= NURSERY_REMEMBERED_LIMIT )
+    {
+        n->countdown = 0;
+    }
+}
+
+void remember_object( vmachine* vm, object* o )
+{
+    // Remember old objects which might be written without barriers.
+    object_header* h = header( o );
+    if ( ! vm->nursery.base || ( h->flags & FLAG_REMEMBERED ) || nursery_young( &vm->nursery, o ) )
+    {
+        return;
+    }
+
+    h->flags |= FLAG_REMEMBERED;
+    vm->nursery.remembered_objects.push_back( o );
+}
+
 cothread_object* mark_cothread( vmachine* vm, cothread_object* cothread )
 {
+    // Cothread stacks are written without barriers.
+    remember_object( vm, cothread );
+
     // Mark entire cothread.  We mark references eagerly here rather than when
     // we write values into the stack in order to reduce the number of write
     // barriers required.
@@ -212,8 +441,9 @@ cothread_object* mark_cothread( vmachine* vm, cothread_object* cothread )
     // the cothread has been pushed onto the mark list, we need it to be
     // completely marked before it can be used.
 
-    // Must lock before marking because marked cothreads can be resized, which
-    // would be disastrous if done while the GC is marking the cothread.
+    // Must lock before marking because marked cothreads are written without
+    // barriers, which would be disastrous if done while the GC is marking the
+    // cothread.
     // Either we mark, in which case the GC will not, or the GC has already
     // marked, in which case we will not.
 
@@ -226,19 +456,27 @@ cothread_object* mark_cothread( vmachine* vm, cothread_object* cothread )
         return cothread;
     }
 
-    // Add all referenced objects to the mark list.
-    for ( value v : cothread->stack )
+    // Add all unmarked referenced objects to the mark list.
+    for ( unsigned i = 0; i < cothread->stack_size; ++i )
     {
-        write_barrier( vm, v );
+        value v = cothread->stack[ i ];
+        if ( box_is_object_or_string( v ) && atomic_load( header( unbox_object_or_string( v ) )->color ) == vm->old_color )
+        {
+            write_barrier( vm, v );
+        }
     }
 
-    // Add all functions in stack frames to the mark list.
+    // Add all unmarked functions in stack frames to the mark list.
     for ( const stack_frame& frame : cothread->stack_frames )
     {
-        if ( frame.function )
+        if ( frame.function && atomic_load( header( frame.function )->color ) == vm->old_color )
         {
             write_barrier( vm, frame.function );
         }
+        if ( frame.generator && atomic_load( header( frame.generator )->color ) == vm->old_color )
+        {
+            write_barrier( vm, frame.generator );
+        }
     }
 
     // Mark with mark colour.
@@ -273,7 +511,11 @@ void setup_object_model( vmachine* vm )
     vm->prototypes[ FUNCTION_OBJECT ] = lookup_new( vm, object );
     vm->prototypes[ NATIVE_FUNCTION_OBJECT ] = vm->prototypes[ FUNCTION_OBJECT ];
     vm->prototypes[ COTHREAD_OBJECT ] = lookup_new( vm, object );
+    vm->prototypes[ GENERATOR_OBJECT ] = vm->prototypes[ COTHREAD_OBJECT ];
     vm->prototypes[ U64VAL_OBJECT ] = lookup_new( vm, object );
+    vm->prototypes[ F64ARRAY_OBJECT ] = lookup_new( vm, object );
+    vm->prototypes[ I32ARRAY_OBJECT ] = lookup_new( vm, object );
+    vm->prototypes[ U8ARRAY_OBJECT ] = lookup_new( vm, object );
     vm->prototypes[ NUMBER_OBJECT ] = lookup_new( vm, object );
     vm->prototypes[ BOOL_OBJECT ] = lookup_new( vm, object );
     vm->prototypes[ NULL_OBJECT ] = lookup_new( vm, object );
@@ -18,6 +18,7 @@
 #include <stddef.h>
 #include <assert.h>
 #include <string.h>
+#include <atomic>
 #include <vector>
 #include <mutex>
 #include "datatypes/hash_table.h"
@@ -25,16 +26,20 @@
 #include "kenaf/runtime.h"
 #include "atomic_load_store.h"
 #include "hashkeys.h"
+#include "nursery.h"
+#include "large_space.h"
 
 namespace kf
 {
 
-struct heap_state;
+struct heap_arena;
 struct layout_object;
 struct lookup_object;
 struct string_object;
 struct u64val_object;
 struct cothread_object;
+struct cothread_pool;
+struct generator_object;
 struct collector;
 
 /*
@@ -50,7 +55,11 @@ enum type_code : uint8_t
     FUNCTION_OBJECT,
     NATIVE_FUNCTION_OBJECT,
     COTHREAD_OBJECT,
+    GENERATOR_OBJECT,
     U64VAL_OBJECT,
+    F64ARRAY_OBJECT,
+    I32ARRAY_OBJECT,
+    U8ARRAY_OBJECT,
     NUMBER_OBJECT,
     BOOL_OBJECT,
     NULL_OBJECT,
@@ -68,9 +77,12 @@ enum type_code : uint8_t
 
 enum
 {
-    FLAG_KEY    = 1 << 0, // String object is a key.
-    FLAG_SEALED = 1 << 1, // Lookup object is sealed.
-    FLAG_DIRECT = 1 << 2, // Function is a direct constructor.
+    FLAG_KEY        = 1 << 0, // String object is a key.
+    FLAG_SEALED     = 1 << 1, // Lookup object is sealed.
+    FLAG_DIRECT     = 1 << 2, // Function is a direct constructor.
+    FLAG_HASHED     = 1 << 3, // String object has a cached hash.
+    FLAG_LARGE      = 1 << 6, // Object is in the large object space.
+    FLAG_REMEMBERED = 1 << 7, // Object is in the nursery's remembered set.
 };
 
 /*
@@ -168,22 +180,54 @@ template < typename T > using ref = atomic_p< T >;
 using ref_value = atomic_u64;
 
 /*
-    Selectors.
+    Selectors.  A selector is an inline cache for key lookup.  Each selector
+    remembers the result of lookup for up to SELECTOR_WAYS different layouts.
+    Once every way is in use the selector is megamorphic, and further misses
+    are satisfied from a cache shared by all selectors in the vm.
 */
 
-struct selector
+const size_t SELECTOR_WAYS = 4;
+
+struct selector_way
 {
     uint32_t cookie;
     uint32_t sindex;
     ref_value* slot;
 };
 
+struct selector
+{
+    selector_way ways[ SELECTOR_WAYS ];
+    uint32_t next_way;
+    bool megamorphic;
+};
+
 struct key_selector
 {
     ref< string_object > key;
     selector sel;
 };
 
+/*
+    Shared cache for megamorphic selectors, indexed by layout cookie and key.
+*/
+
+const size_t MEGAMORPHIC_CACHE_SIZE = 1024;
+
+struct megamorphic_entry
+{
+    string_object* key;
+    selector_way way;
+};
+
+struct selector_statistics
+{
+    uint64_t mono_hits;     // hit first way of selector, with KF_SELECTOR_STATS.
+    uint64_t poly_hits;     // hit another way of selector.
+    uint64_t mega_hits;     // hit in megamorphic cache.
+    uint64_t misses;        // searched layout chain.
+};
+
 /*
     Global GC state.
 */
@@ -237,6 +281,8 @@ struct vmachine
     gc_color new_color;     // allocated objects must have this colour.
     gc_phase phase;         // gc phase.
     unsigned countdown;     // GC allocation countdown.
+    size_t limit_countdown; // Allocation countdown to the hard heap limit.
+    std::atomic< bool > handshake_pending; // GC thread is waiting for a handshake.
 
     // Context state.
     vcontext* c;
@@ -252,6 +298,15 @@ struct vmachine
     hash_table< layout_hashkey, layout_object* > splitkey_layouts;
     uint32_t next_cookie;
 
+    // Selector cache.
+    megamorphic_entry megamorphic_cache[ MEGAMORPHIC_CACHE_SIZE ];
+    selector_statistics selector_stats;
+
+#ifdef KF_JIT
+    // Number of calls before a program is compiled.
+    unsigned jit_threshold;
+#endif
+
     // Unique u64vals.
     hash_table< uint64_t, u64val_object* > u64vals;
 
@@ -267,9 +322,16 @@ struct vmachine
 
     // GC state.
     std::mutex mark_mutex;  // Serialize marking of cothread stacks.
-    std::mutex heap_mutex;  // Serialize access to heap during sweeping.
-    heap_state* heap;       // GC heap.
+    nursery_space nursery;  // Young generation.
+    large_space large;      // Large objects, each with its own mapping.
+    std::atomic< size_t > external_size; // Memory held outside the heap.
+    std::vector< heap_arena* > arenas;  // GC heap, split into arenas.
+    size_t arena_index;     // Arena the mutator is allocating from.
+    size_t arena_countdown; // Bytes to allocate before moving to next arena.
     collector* gc;          // GC thread.
+
+    // Recycled cothread stacks.
+    cothread_pool* pool;
 };
 
 void link_vcontext( vmachine* vm, vcontext* vc );
@@ -280,10 +342,21 @@ void unlink_vcontext( vmachine* vm, vcontext* vc );
 */
 
 void* object_new( vmachine* vm, type_code type, size_t size );
+void* object_resize( vmachine* vm, object* object, size_t size );
 size_t object_size( vmachine* vm, object* object );
 void object_retain( vmachine* vm, object* object );
 void object_release( vmachine* vm, object* object );
 
+/*
+    External memory is held outside the GC heap, by objects such as cothreads
+    or by the embedder.  Allocating it counts towards the next collection, or
+    the next minor collection if the owning object is young.  Memory can be
+    allocated only by the mutator, but freed by the sweeper.
+*/
+
+void external_alloc( vmachine* vm, object* owner, size_t size );
+void external_free( vmachine* vm, size_t size );
+
 /*
     Writes to GC references must use a write barrier.
 */
@@ -300,6 +373,10 @@ void write_barrier( vmachine* vm, value oldv );
 void write_barrier( vmachine* vm, object* old );
 void write_barrier( vmachine* vm, string_object* old );
 
+void remember_barrier( vmachine* vm, ref_value& ref );
+void remember_barrier( vmachine* vm, ref< object >& ref );
+void remember_object( vmachine* vm, object* o );
+
 cothread_object* mark_cothread( vmachine* vm, cothread_object* cothread );
 
 /*
@@ -341,6 +418,11 @@ template < typename T > inline void write( vmachine* vm, ref< T >& ref, T* v )
         }
     }
 
+    if ( nursery_young( &vm->nursery, v ) && ! nursery_young( &vm->nursery, &ref ) )
+    {
+        remember_barrier( vm, reinterpret_cast< atomic_p< object >& >( ref ) );
+    }
+
     atomic_store( ref, v );
 }
 
@@ -366,6 +448,11 @@ inline void write( vmachine* vm, ref_value& ref, value v )
         }
     }
 
+    if ( box_is_object_or_string( v ) && nursery_young( &vm->nursery, unbox_object_or_string( v ) ) && ! nursery_young( &vm->nursery, &ref ) )
+    {
+        remember_barrier( vm, ref );
+    }
+
     atomic_store( ref, v.v );
 }
 
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+#
+#   kenaf
+#
+#   Created by Edmund Kapusniak on 16/10/2026.
+#   Copyright © 2026 Edmund Kapusniak
+#
+#   Licensed under the MIT License. See LICENSE file in the project root for
+#   full license information.
+#
+
+'''
+Compare interpreter dispatch strategies.
+
+Configures and builds kenaf once for each value of the 'dispatch' meson
+option, then runs each benchmark script with each build.  Reports the best
+wall-clock time of several runs, relative to the switch build.
+
+    test/bench/dispatch.py [--runs N] [--build-dir DIR] [--kenaf STRATEGY=PATH ...] [SCRIPT ...]
+
+Builds go in DIR/build-dispatch-STRATEGY.  DIR defaults to kenaf in the system
+temp directory, and builds are reused by later runs.  Pass --kenaf to use
+existing builds instead of building with meson.
+'''
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+STRATEGIES = [ 'switch', 'computed_goto', 'tail_call' ]
+
+ROOT = os.path.normpath( os.path.join( os.path.dirname( __file__ ), '..', '..' ) )
+
+BENCHMARKS = [
+    'test/bench/dispatch.kf',
+    'test/cases/fib.kf',
+    'test/cases/n-body.kf',
+    'test/cases/spectral-norm.kf',
+    'test/cases/fannkuch-redux.kf',
+    'test/cases/binary-trees.kf',
+]
+
+def build( strategy, build_dir ):
+    builddir = os.path.join( build_dir, 'build-dispatch-' + strategy )
+    if not os.path.exists( builddir ):
+        # Configuration fails if the compiler does not support the strategy.
+        if subprocess.run( [ 'meson', 'setup', builddir, ROOT, '--buildtype=release', '-Ddispatch=' + strategy ] ).returncode != 0:
+            print( 'skipping %s, which this compiler does not support' % strategy )
+            shutil.rmtree( builddir, ignore_errors=True )
+            return None
+    subprocess.run( [ 'meson', 'compile', '-C', builddir ], check=True )
+    return os.path.join( builddir, 'kenaf' )
+
+def measure( kenaf, script, runs ):
+    best = None
+    for _ in range( runs ):
+        start = time.perf_counter()
+        subprocess.run( [ kenaf, script ], cwd=os.path.dirname( script ), stdout=subprocess.DEVNULL, check=True )
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min( best, elapsed )
+    return best
+
+def main():
+    parser = argparse.ArgumentParser( description='Compare interpreter dispatch strategies.' )
+    parser.add_argument( '--runs', type=int, default=3 )
+    parser.add_argument( '--build-dir', default=os.path.join( tempfile.gettempdir(), 'kenaf' ) )
+    parser.add_argument( '--kenaf', action='append', default=[], metavar='STRATEGY=PATH' )
+    parser.add_argument( 'scripts', nargs='*' )
+    args = parser.parse_args()
+
+    kenafs = {}
+    for k in args.kenaf:
+        strategy, path = k.split( '=', 1 )
+        kenafs[ strategy ] = os.path.abspath( path )
+    if not kenafs:
+        for strategy in STRATEGIES:
+            kenaf = build( strategy, os.path.abspath( args.build_dir ) )
+            if kenaf:
+                kenafs[ strategy ] = kenaf
+
+    scripts = args.scripts or [ os.path.join( ROOT, b ) for b in BENCHMARKS ]
+    strategies = [ s for s in STRATEGIES if s in kenafs ] + [ s for s in kenafs if s not in STRATEGIES ]
+
+    print( '%-20s' % 'benchmark' + ''.join( '%22s' % s for s in strategies ) )
+    for script in scripts:
+        script = os.path.abspath( script )
+        times = [ measure( kenafs[ s ], script, args.runs ) for s in strategies ]
+        base = times[ 0 ]
+        line = '%-20s' % os.path.basename( script )
+        for t in times:
+            line += '%13.3fs (%4.2fx)' % ( t, base / t )
+        print( line )
+        sys.stdout.flush()
+
+if __name__ == '__main__':
+    main()
+
@@ -0,0 +1,532 @@
+//
+//  heap_analyze.cpp
+//
+//  Created by Edmund Kapusniak on 16/10/2026.
+//  Copyright © 2026 Edmund Kapusniak.
+//
+//  Licensed under the MIT License. See LICENSE file in the project root for
+//  full license information.
+//
+
+/*
+    kenaf-heap reads a heap snapshot written by write_heap_snapshot, and
+    reports:
+
+      - Counts and sizes of objects by type, and how much of the heap is
+        reachable from roots.
+      - The objects which retain the most memory.  An object's retained size
+        is the total size of the objects it dominates, which are the objects
+        that would become unreachable if it were freed.
+      - The shortest path from a root to each of those objects.
+
+    Dominators are found using the iterative algorithm from "A Simple, Fast
+    Dominance Algorithm" by Cooper, Harvey and Kennedy.  The graph has an
+    extra node, which is the parent of every root.
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "heap_snapshot.h"
+
+using namespace kf;
+
+struct heap_node
+{
+    uint64_t id;
+    uint8_t type;
+    uint32_t size;
+    std::string label;
+};
+
+struct heap_graph
+{
+    std::string type_names[ 256 ];
+    std::string root_names[ 256 ];
+    std::vector< heap_node > nodes;
+    std::vector< uint8_t > root_kinds;
+    std::vector< size_t > edge_index;
+    std::vector< uint32_t > edges;
+};
+
+const uint32_t NO_NODE = UINT32_MAX;
+const size_t PATH_LENGTH = 12;
+
+/*
+    Reading snapshots.
+*/
+
+struct snapshot_reader
+{
+    FILE* file;
+    bool ok;
+
+    uint64_t read( size_t size )
+    {
+        uint8_t bytes[ 8 ] = {};
+        ok = ok && fread( bytes, 1, size, file ) == size;
+        uint64_t u = 0;
+        for ( size_t i = 0; i < size; ++i )
+        {
+            u |= (uint64_t)bytes[ i ] << i * 8;
+        }
+        return u;
+    }
+
+    std::string read_text()
+    {
+        std::string text( (size_t)read( 1 ), '\0' );
+        ok = ok && fread( text.data(), 1, text.size(), file ) == text.size();
+        return text;
+    }
+};
+
+static bool read_snapshot( const char* path, heap_graph* graph )
+{
+    FILE* file = fopen( path, "rb" );
+    if ( ! file )
+    {
+        fprintf( stderr, "cannot open snapshot '%s'\n", path );
+        return false;
+    }
+
+    snapshot_reader r = { file, true };
+
+    // Header.
+    char magic[ sizeof( SNAPSHOT_MAGIC ) ] = {};
+    r.ok = fread( magic, 1, sizeof( magic ), file ) == sizeof( magic );
+    if ( ! r.ok || memcmp( magic, SNAPSHOT_MAGIC, sizeof( magic ) ) != 0 || r.read( 4 ) != SNAPSHOT_VERSION )
+    {
+        fprintf( stderr, "'%s' is not a kenaf heap snapshot\n", path );
+        fclose( file );
+        return false;
+    }
+
+    size_t type_count = r.read( 4 );
+    for ( size_t i = 0; i < type_count && r.ok; ++i )
+    {
+        uint8_t type = r.read( 1 );
+        graph->type_names[ type ] = r.read_text();
+    }
+
+    graph->root_names[ SNAPSHOT_ROOT_HANDLE ] = "handle";
+    graph->root_names[ SNAPSHOT_ROOT_GLOBAL ] = "global";
+    graph->root_names[ SNAPSHOT_ROOT_COTHREAD ] = "cothread";
+    graph->root_names[ SNAPSHOT_ROOT_KEY ] = "key";
+
+    // Node 0 is the parent of the roots.
+    std::vector< uint64_t > root_ids;
+    std::vector< uint64_t > ref_ids;
+    std::vector< size_t > ref_index;
+    graph->nodes.push_back( { 0, 0, 0, "roots" } );
+    ref_index.push_back( 0 );
+
+    while ( r.ok )
+    {
+        uint8_t tag = r.read( 1 );
+        if ( tag == SNAPSHOT_END )
+        {
+            break;
+        }
+        else if ( tag == SNAPSHOT_ROOT )
+        {
+            graph->root_kinds.push_back( r.read( 1 ) );
+            root_ids.push_back( r.read( 8 ) );
+        }
+        else if ( tag == SNAPSHOT_OBJECT )
+        {
+            heap_node node;
+            node.id = r.read( 8 );
+            node.type = r.read( 1 );
+            node.size = r.read( 4 );
+            node.label = r.read_text();
+            graph->nodes.push_back( std::move( node ) );
+
+            size_t ref_count = r.read( 4 );
+            ref_index.push_back( ref_ids.size() );
+            for ( size_t i = 0; i < ref_count && r.ok; ++i )
+            {
+                ref_ids.push_back( r.read( 8 ) );
+            }
+        }
+        else
+        {
+            r.ok = false;
+        }
+    }
+
+    fclose( file );
+    if ( ! r.ok )
+    {
+        fprintf( stderr, "snapshot '%s' is truncated or corrupt\n", path );
+        return false;
+    }
+
+    // Resolve ids.  References to objects not in the snapshot are dropped.
+    std::unordered_map< uint64_t, uint32_t > lookup;
+    lookup.reserve( graph->nodes.size() );
+    for ( size_t i = 1; i < graph->nodes.size(); ++i )
+    {
+        lookup.emplace( graph->nodes[ i ].id, (uint32_t)i );
+    }
+
+    auto resolve = [&]( const uint64_t* ids, size_t count )
+    {
+        for ( size_t i = 0; i < count; ++i )
+        {
+            auto j = lookup.find( ids[ i ] );
+            if ( j != lookup.end() )
+            {
+                graph->edges.push_back( j->second );
+            }
+        }
+        graph->edge_index.push_back( graph->edges.size() );
+    };
+
+    // Edges from node 0 are in root order, so root_kinds can be indexed by
+    // edge.  Roots which are not in the snapshot keep a placeholder.
+    graph->edge_index.push_back( 0 );
+    for ( size_t i = 0; i < root_ids.size(); ++i )
+    {
+        auto j = lookup.find( root_ids[ i ] );
+        graph->edges.push_back( j != lookup.end() ? j->second : NO_NODE );
+    }
+    graph->edge_index.push_back( graph->edges.size() );
+
+    ref_index.push_back( ref_ids.size() );
+    for ( size_t i = 1; i < graph->nodes.size(); ++i )
+    {
+        resolve( ref_ids.data() + ref_index[ i ], ref_index[ i + 1 ] - ref_index[ i ] );
+    }
+
+    return true;
+}
+
+/*
+    Analysis.
+*/
+
+struct heap_analysis
+{
+    std::vector< uint32_t > order;      // Reverse postorder of reachable nodes.
+    std::vector< uint32_t > number;     // Index of each node in order.
+    std::vector< uint32_t > idom;       // Immediate dominator.
+    std::vector< uint64_t > retained;   // Retained size.
+    std::vector< uint32_t > parent;     // Parent on shortest path from a root.
+    std::vector< uint32_t > root_edge;  // Root edge at the start of that path.
+};
+
+template < typename F > static void for_each_edge( const heap_graph& graph, uint32_t node, F f )
+{
+    for ( size_t i = graph.edge_index[ node ]; i < graph.edge_index[ node + 1 ]; ++i )
+    {
+        if ( graph.edges[ i ] != NO_NODE )
+        {
+            f( graph.edges[ i ], i );
+        }
+    }
+}
+
+static void depth_first_order( const heap_graph& graph, heap_analysis* a )
+{
+    size_t node_count = graph.nodes.size();
+    std::vector< uint32_t > postorder;
+    std::vector< bool > visited( node_count, false );
+    std::vector< std::pair< uint32_t, size_t > > stack;
+
+    visited[ 0 ] = true;
+    stack.push_back( { 0, graph.edge_index[ 0 ] } );
+    while ( ! stack.empty() )
+    {
+        auto& top = stack.back();
+        uint32_t node = top.first;
+        if ( top.second < graph.edge_index[ node + 1 ] )
+        {
+            uint32_t next = graph.edges[ top.second++ ];
+            if ( next != NO_NODE && ! visited[ next ] )
+            {
+                visited[ next ] = true;
+                stack.push_back( { next, graph.edge_index[ next ] } );
+            }
+        }
+        else
+        {
+            postorder.push_back( node );
+            stack.pop_back();
+        }
+    }
+
+    a->order.assign( postorder.rbegin(), postorder.rend() );
+    a->number.assign( node_count, NO_NODE );
+    for ( size_t i = 0; i < a->order.size(); ++i )
+    {
+        a->number[ a->order[ i ] ] = (uint32_t)i;
+    }
+}
+
+static void find_dominators( const heap_graph& graph, heap_analysis* a )
+{
+    size_t node_count = graph.nodes.size();
+
+    // Predecessors of reachable nodes.
+    std::vector< size_t > pred_index( node_count + 1, 0 );
+    for ( uint32_t node : a->order )
+    {
+        for_each_edge( graph, node, [&]( uint32_t next, size_t ) { pred_index[ next + 1 ] += 1; } );
+    }
+    for ( size_t i = 0; i < node_count; ++i )
+    {
+        pred_index[ i + 1 ] += pred_index[ i ];
+    }
+    std::vector< uint32_t > preds( pred_index[ node_count ] );
+    std::vector< size_t > pred_fill( pred_index.begin(), pred_index.end() - 1 );
+    for ( uint32_t node : a->order )
+    {
+        for_each_edge( graph, node, [&]( uint32_t next, size_t ) { preds[ pred_fill[ next ]++ ] = node; } );
+    }
+
+    // Iterate to a fixed point, in reverse postorder.  Nodes are compared
+    // using their reverse postorder numbers.
+    a->idom.assign( node_count, NO_NODE );
+    a->idom[ 0 ] = 0;
+
+    auto intersect = [&]( uint32_t b1, uint32_t b2 )
+    {
+        while ( b1 != b2 )
+        {
+            while ( a->number[ b1 ] > a->number[ b2 ] ) b1 = a->idom[ b1 ];
+            while ( a->number[ b2 ] > a->number[ b1 ] ) b2 = a->idom[ b2 ];
+        }
+        return b1;
+    };
+
+    bool changed = true;
+    while ( changed )
+    {
+        changed = false;
+        for ( size_t i = 1; i < a->order.size(); ++i )
+        {
+            uint32_t node = a->order[ i ];
+            uint32_t new_idom = NO_NODE;
+            for ( size_t j = pred_index[ node ]; j < pred_index[ node + 1 ]; ++j )
+            {
+                uint32_t pred = preds[ j ];
+                if ( a->idom[ pred ] == NO_NODE ) continue;
+                new_idom = new_idom == NO_NODE ? pred : intersect( pred, new_idom );
+            }
+            if ( a->idom[ node ] != new_idom )
+            {
+                a->idom[ node ] = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    // Every node dominated by a node comes after it in reverse postorder, so
+    // walking backwards completes each retained size before it is added to
+    // the size retained by its dominator.
+    a->retained.assign( node_count, 0 );
+    for ( size_t i = a->order.size(); i-- > 1; )
+    {
+        uint32_t node = a->order[ i ];
+        a->retained[ node ] += graph.nodes[ node ].size;
+        a->retained[ a->idom[ node ] ] += a->retained[ node ];
+    }
+}
+
+static void find_shortest_paths( const heap_graph& graph, heap_analysis* a )
+{
+    size_t node_count = graph.nodes.size();
+    a->parent.assign( node_count, NO_NODE );
+    a->root_edge.assign( node_count, NO_NODE );
+
+    std::vector< uint32_t > queue;
+    queue.push_back( 0 );
+    a->parent[ 0 ] = 0;
+    for ( size_t head = 0; head < queue.size(); ++head )
+    {
+        uint32_t node = queue[ head ];
+        for_each_edge( graph, node, [&]( uint32_t next, size_t edge )
+        {
+            if ( a->parent[ next ] != NO_NODE ) return;
+            a->parent[ next ] = node;
+            a->root_edge[ next ] = node == 0 ? (uint32_t)edge : a->root_edge[ node ];
+            queue.push_back( next );
+        } );
+    }
+}
+
+/*
+    Reporting.
+*/
+
+static std::string describe( const heap_graph& graph, uint32_t node )
+{
+    const heap_node& n = graph.nodes[ node ];
+    char id[ 32 ];
+    snprintf( id, sizeof( id ), "0x%llx", (unsigned long long)n.id );
+    std::string s = graph.type_names[ n.type ] + " " + id;
+    if ( n.label.size() )
+    {
+        s += " '";
+        for ( char c : n.label )
+        {
+            s += (unsigned char)c >= 0x20 && c != 0x7F ? c : '?';
+        }
+        s += "'";
+    }
+    return s;
+}
+
+static void print_path( const heap_graph& graph, const heap_analysis& a, uint32_t node )
+{
+    std::vector< uint32_t > path;
+    for ( uint32_t n = node; n != 0; n = a.parent[ n ] )
+    {
+        path.push_back( n );
+    }
+
+    uint32_t edge = a.root_edge[ node ];
+    printf( "        %s root", graph.root_names[ graph.root_kinds[ edge ] ].c_str() );
+    for ( size_t i = path.size(); i-- > 0; )
+    {
+        // Elide the middle of long paths.
+        size_t step = path.size() - i;
+        if ( path.size() > PATH_LENGTH && step == PATH_LENGTH / 2 )
+        {
+            printf( "\n        -> ... %zu more ...", path.size() - PATH_LENGTH + 1 );
+            i -= path.size() - PATH_LENGTH;
+            continue;
+        }
+        printf( "\n        -> %s", describe( graph, path[ i ] ).c_str() );
+    }
+    printf( "\n" );
+}
+
+static void print_summary( const heap_graph& graph, const heap_analysis& a )
+{
+    struct type_total { size_t count; uint64_t bytes; size_t dead_count; uint64_t dead_bytes; };
+    type_total totals[ 256 ] = {};
+    type_total all = {};
+    for ( size_t i = 1; i < graph.nodes.size(); ++i )
+    {
+        const heap_node& n = graph.nodes[ i ];
+        type_total& t = totals[ n.type ];
+        if ( a.number[ i ] != NO_NODE )
+        {
+            t.count += 1; t.bytes += n.size;
+            all.count += 1; all.bytes += n.size;
+        }
+        else
+        {
+            t.dead_count += 1; t.dead_bytes += n.size;
+            all.dead_count += 1; all.dead_bytes += n.size;
+        }
+    }
+
+    printf( "%-10s %10s %12s %12s %12s\n", "type", "count", "bytes", "unreachable", "bytes" );
+    for ( size_t i = 0; i < 256; ++i )
+    {
+        const type_total& t = totals[ i ];
+        if ( ! t.count && ! t.dead_count ) continue;
+        printf( "%-10s %10zu %12llu %12zu %12llu\n", graph.type_names[ i ].c_str(), t.count, (unsigned long long)t.bytes, t.dead_count, (unsigned long long)t.dead_bytes );
+    }
+    printf( "%-10s %10zu %12llu %12zu %12llu\n", "total", all.count, (unsigned long long)all.bytes, all.dead_count, (unsigned long long)all.dead_bytes );
+}
+
+static void print_object( const heap_graph& graph, const heap_analysis& a, uint32_t node )
+{
+    printf( "%12llu %8u  %s\n", (unsigned long long)a.retained[ node ], graph.nodes[ node ].size, describe( graph, node ).c_str() );
+    print_path( graph, a, node );
+}
+
+static int print_usage()
+{
+    fprintf( stderr, "usage: kenaf-heap [--top count] [--path id] snapshot\n" );
+    return EXIT_FAILURE;
+}
+
+int main( int argc, char* argv[] )
+{
+    // Parse arguments.
+    const char* filename = nullptr;
+    size_t top = 20;
+    const char* path_id = nullptr;
+
+    for ( int i = 1; i < argc; ++i )
+    {
+        const char* option = argv[ i ];
+        if ( strcmp( option, "--top" ) == 0 && i + 1 < argc )
+        {
+            top = strtoull( argv[ ++i ], nullptr, 10 );
+        }
+        else if ( strcmp( option, "--path" ) == 0 && i + 1 < argc )
+        {
+            path_id = argv[ ++i ];
+        }
+        else if ( option[ 0 ] != '-' && ! filename )
+        {
+            filename = option;
+        }
+        else
+        {
+            return print_usage();
+        }
+    }
+
+    if ( ! filename ) return print_usage();
+
+    // Load and analyze snapshot.
+    heap_graph graph;
+    if ( ! read_snapshot( filename, &graph ) )
+    {
+        return EXIT_FAILURE;
+    }
+
+    heap_analysis a;
+    depth_first_order( graph, &a );
+    find_dominators( graph, &a );
+    find_shortest_paths( graph, &a );
+
+    // Report on a single object.
+    if ( path_id )
+    {
+        uint64_t id = strtoull( path_id, nullptr, 16 );
+        for ( uint32_t node = 1; node < graph.nodes.size(); ++node )
+        {
+            if ( graph.nodes[ node ].id != id ) continue;
+            if ( a.number[ node ] == NO_NODE )
+            {
+                printf( "%s is unreachable\n", describe( graph, node ).c_str() );
+                return EXIT_SUCCESS;
+            }
+            printf( "%12s %8s  %s\n", "retained", "size", "object" );
+            print_object( graph, a, node );
+            return EXIT_SUCCESS;
+        }
+        fprintf( stderr, "object %s is not in the snapshot\n", path_id );
+        return EXIT_FAILURE;
+    }
+
+    // Summary, and the objects which retain the most memory.
+    print_summary( graph, a );
+
+    std::vector< uint32_t > largest( a.order.begin() + 1, a.order.end() );
+    top = std::min( top, largest.size() );
+    std::partial_sort( largest.begin(), largest.begin() + top, largest.end(), [&]( uint32_t x, uint32_t y )
+    {
+        return a.retained[ x ] > a.retained[ y ];
+    } );
+
+    printf( "\n%12s %8s  %s\n", "retained", "size", "object" );
+    for ( size_t i = 0; i < top; ++i )
+    {
+        print_object( graph, a, largest[ i ] );
+    }
+
+    return EXIT_SUCCESS;
+}